@@ -0,0 +1,231 @@
+#include "EventLoop.h"
+#include "InlineFunction.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+/**
+ * 统计回调热点路径上每次操作的堆分配次数，替换全局 operator new 计数
+ * - 对比 std::function 和 EventLoop::Functor(InlineFunction) 保存常见的 bind
+ * - loop 线程中 runInLoop/queueInLoop/runAfter 的完整路径(构造、入队、执行、释放)
+ * - 其他线程 queueInLoop/runAfter: 每轮投递一批，等 loop 执行完再投递下一轮，节点经过 NodeCache 的共享栈回到投递线程
+ *   预热时投递过一轮大批次，投递线程缓存中的节点多于一轮
+ * 预热之后的稳定状态，要求为 0 的路径出现分配时返回 1
+ * 用法: callback_alloc_count
+ */
+
+namespace {
+std::atomic<uint64_t> g_allocations(0);
+}
+
+void *operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+const int kIterations = 100000;
+
+// 模拟 TcpConnection: 回调里 bind 成员函数和 shared_from_this()
+class Conn : public std::enable_shared_from_this<Conn> {
+  public:
+    Conn() : calls(0) {}
+
+    void onWriteComplete() { ++calls; }
+    void sendFileInLoop(int fd, off_t offset, size_t length) { calls += fd + offset + length > 0 ? 1 : 0; }
+
+    uint64_t calls;
+};
+
+struct Row {
+    const char *name;
+    double perOp;
+    bool mustBeZero;
+};
+
+std::vector<Row> g_rows;
+
+const int kBatch = 16;
+
+// 每轮 loop 投递 kBatch 个回调(或者立即到期的定时器)和下一轮，和实际使用一样跨越多轮 loop
+class Chain {
+  public:
+    static const int kWarmupRounds = 100;
+
+    Chain(EventLoop *loop, const std::shared_ptr<Conn> &conn, bool timers)
+        : loop_(loop), conn_(conn), timers_(timers), round_(0), before_(0) {}
+
+    void step() {
+        if (round_ == kWarmupRounds) {
+            before_ = g_allocations.load(std::memory_order_relaxed);
+        }
+        if (round_ == kWarmupRounds + kIterations / kBatch) {
+            uint64_t after = g_allocations.load(std::memory_order_relaxed);
+            int ops = (kIterations / kBatch) * (kBatch + 1);
+            Row row = {timers_ ? "runAfter in loop thread (add + fire)" : "queueInLoop in loop thread (post + run)",
+                       static_cast<double>(after - before_) / ops, true};
+            g_rows.push_back(row);
+            loop_->quit();
+            return;
+        }
+        ++round_;
+        for (int i = 0; i < kBatch; ++i) {
+            post(std::bind(&Conn::onWriteComplete, conn_->shared_from_this()));
+        }
+        post(std::bind(&Chain::step, this));
+    }
+
+  private:
+    void post(EventLoop::Functor cb) {
+        if (timers_) {
+            loop_->runAfter(0.0, std::move(cb));
+        } else {
+            loop_->queueInLoop(std::move(cb));
+        }
+    }
+
+    EventLoop *loop_;
+    std::shared_ptr<Conn> conn_;
+    bool timers_;
+    int round_;
+    uint64_t before_;
+};
+
+// 其他线程每轮投递 batch 个回调和一个标记，等标记执行之后再投递下一轮，队列深度和实际使用一样有限
+//!NOTE: 标记再从 loop 线程投递一次才置 done，这时这一轮投递的回调和 Timer 都已经释放；
+// 但第二跳用的是 loop 线程本地的节点，它在置 done 之后才放进共享栈，所以投递线程缓存中的节点要比一轮多出余量
+// hold 为 true 时 loop 等这一轮全部投递完才开始执行，这一轮的节点都是新申请的，用来预留这部分余量
+void postRounds(EventLoop *loop, const std::shared_ptr<Conn> &conn, bool timers, int n, int batch = kBatch,
+                bool hold = false) {
+    std::atomic_bool done(false);
+    std::atomic_bool posted(false);
+    for (int i = 0; i < n; i += batch + 1) {
+        done.store(false);
+        posted.store(false);
+        if (hold) {
+            loop->queueInLoop([&posted]() {
+                while (!posted.load()) {
+                    std::this_thread::yield();
+                }
+            });
+        }
+        for (int j = 0; j < batch; ++j) {
+            EventLoop::Functor cb(std::bind(&Conn::onWriteComplete, conn->shared_from_this()));
+            if (timers) {
+                loop->runAfter(0.0, std::move(cb));
+            } else {
+                loop->queueInLoop(std::move(cb));
+            }
+        }
+        EventLoop::Functor mark([loop, &done]() { loop->queueInLoop([&done]() { done.store(true); }); });
+        if (timers) {
+            loop->runAfter(0.0, std::move(mark));
+        } else {
+            loop->queueInLoop(std::move(mark));
+        }
+        posted.store(true);
+        while (!done.load()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+template <typename Fn>
+void measure(const char *name, bool mustBeZero, Fn fn) {
+    fn(1000);  // 预热，填满节点缓存
+    uint64_t before = g_allocations.load(std::memory_order_relaxed);
+    fn(kIterations);
+    uint64_t after = g_allocations.load(std::memory_order_relaxed);
+    Row row = {name, static_cast<double>(after - before) / kIterations, mustBeZero};
+    g_rows.push_back(row);
+}
+
+}  // namespace
+
+int main() {
+    std::shared_ptr<Conn> conn = std::make_shared<Conn>();
+    EventLoop loop;
+
+    measure("std::function bind(member, shared_ptr)", false, [&conn](int n) {
+        for (int i = 0; i < n; ++i) {
+            std::function<void()> f(std::bind(&Conn::onWriteComplete, conn->shared_from_this()));
+            std::function<void()> g(std::move(f));
+            g();
+        }
+    });
+    measure("Functor bind(member, shared_ptr)", true, [&conn](int n) {
+        for (int i = 0; i < n; ++i) {
+            EventLoop::Functor f(std::bind(&Conn::onWriteComplete, conn->shared_from_this()));
+            EventLoop::Functor g(std::move(f));
+            g();
+        }
+    });
+    measure("std::function bind(member, shared_ptr, 3 args)", false, [&conn](int n) {
+        for (int i = 0; i < n; ++i) {
+            std::function<void()> f(std::bind(&Conn::sendFileInLoop, conn->shared_from_this(), 3, off_t(0), size_t(4096)));
+            f();
+        }
+    });
+    measure("Functor bind(member, shared_ptr, 3 args)", true, [&conn](int n) {
+        for (int i = 0; i < n; ++i) {
+            EventLoop::Functor f(std::bind(&Conn::sendFileInLoop, conn->shared_from_this(), 3, off_t(0), size_t(4096)));
+            f();
+        }
+    });
+
+    // loop 线程中的完整路径，在 loop 运行时测量
+    loop.queueInLoop([&]() {
+        measure("runInLoop in loop thread", true, [&](int n) {
+            for (int i = 0; i < n; ++i) {
+                loop.runInLoop(std::bind(&Conn::onWriteComplete, conn->shared_from_this()));
+            }
+        });
+    });
+    Chain chain(&loop, conn, false);
+    loop.queueInLoop(std::bind(&Chain::step, &chain));
+    loop.loop();
+
+    // 定时器到期之后 Timer 回到 NodeCache，堆的容量复用
+    Chain timerChain(&loop, conn, true);
+    loop.queueInLoop(std::bind(&Chain::step, &timerChain));
+    loop.loop();
+
+    // 其他线程投递时 loop 在主线程中运行
+    // 先用普通批次填满 loop 线程的本地链表，再投递一轮 loop 暂停时的大批次，和突发投递之后的稳定状态一样
+    std::thread producer([&]() {
+        const int kBurst = 4 * kBatch;
+        postRounds(&loop, conn, false, 1000);
+        postRounds(&loop, conn, false, kBurst + 1, kBurst, true);
+        measure("queueInLoop from another thread", true, [&](int n) { postRounds(&loop, conn, false, n); });
+        postRounds(&loop, conn, true, 1000);
+        postRounds(&loop, conn, true, kBurst + 1, kBurst, true);
+        measure("runAfter from another thread", true, [&](int n) { postRounds(&loop, conn, true, n); });
+        loop.quit();
+    });
+    loop.loop();
+    producer.join();
+
+    bool ok = true;
+    printf("%-50s %12s\n", "path", "allocs/op");
+    for (const Row &row : g_rows) {
+        bool failed = row.mustBeZero && row.perOp != 0;
+        ok = ok && !failed;
+        printf("%-50s %12.3f%s\n", row.name, row.perOp, failed ? "  FAILED" : "");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "TcpServer.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 水平触发、水平触发 + 延迟提交、边缘触发的对比: epoll_ctl 次数和吞吐
+ * 每个客户端连接发 1 字节请求，服务器用 send(PayloadPtr) 回 size 字节，客户端读完再发下一个请求；
+ * 两端的 socket 缓冲区都设得很小，大响应会多次写不完，水平触发每次都要 epoll_ctl 打开/关闭 EPOLLOUT
+ * budget 列开启单连接输出预算(64K)，大响应同时会暂停/恢复读，和 EPOLLOUT 的开关在同一轮 loop 中，延迟提交可以合并
+ * 服务器单线程，epoll_ctl 在本程序中重新定义，统计 libmuduo-http 的所有调用
+ * 用法: epoll_mode_bench [客户端数] [每个客户端请求数]
+ */
+
+namespace {
+std::atomic<uint64_t> g_epollCtls(0);
+}
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) __THROW {
+    g_epollCtls.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<int>(::syscall(SYS_epoll_ctl, epfd, op, fd, event));
+}
+
+namespace {
+
+const uint16_t kPort = 9970;
+const int kSocketBuffer = 16 * 1024;  // 客户端 SO_RCVBUF 和服务器 SO_SNDBUF
+
+enum Mode { kLevel, kLevelDeferred, kEdge };
+const char *const kModeNames[] = {"LT", "LT+defer", "ET"};
+
+struct Result {
+    double seconds;
+    uint64_t epollCtls;
+    uint64_t elided;
+};
+
+// 阻塞 socket 的客户端: 请求 1 字节，读满 size 字节的响应
+void runClient(size_t size, int requests) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = kSocketBuffer;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+
+    std::vector<char> buf(64 * 1024);
+    for (int i = 0; i < requests; ++i) {
+        if (::write(fd, "g", 1) != 1) {
+            perror("write");
+            exit(1);
+        }
+        size_t received = 0;
+        while (received < size) {
+            ssize_t n = ::read(fd, buf.data(), buf.size());
+            if (n <= 0) {
+                perror("read");
+                exit(1);
+            }
+            received += n;
+        }
+    }
+    ::close(fd);
+}
+
+Result runOnce(Mode mode, bool budget, size_t size, int clients, int requests) {
+    EventLoop loop;
+    InetAddress addr(kPort);
+    TcpServer server(&loop, addr, "bench", TcpServer::kReusePort);
+    server.setEdgeTriggered(mode == kEdge);
+    server.setDeferredUpdates(mode == kLevelDeferred);
+    if (budget) {
+        OutputBudgetOptions options;
+        options.connectionHighMark = 64 * 1024;
+        server.setOutputBudget(options);
+    }
+
+    PayloadPtr payload = std::make_shared<const std::string>(size, 'x');
+    std::atomic<int> finished(0);
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected()) {
+            int sndbuf = kSocketBuffer;
+            ::setsockopt(conn->fd(), SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        } else if (++finished == clients) {
+            loop.quit();
+        }
+    });
+    server.setMessageCallback([payload](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        size_t n = buf->readableBytes();
+        buf->retrieveAll();
+        for (size_t i = 0; i < n; ++i) {
+            conn->send(payload);
+        }
+    });
+    server.start();
+
+    g_epollCtls.store(0);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) {
+        threads.emplace_back(runClient, size, requests);
+    }
+    loop.loop();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    Result r;
+    r.seconds = std::chrono::duration<double>(end - begin).count();
+    r.epollCtls = g_epollCtls.load();
+    r.elided = loop.updateStats().elided;
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int clients = argc > 1 ? atoi(argv[1]) : 4;
+    int requests = argc > 2 ? atoi(argv[2]) : 2000;
+    const size_t kSizes[] = {64, 16 * 1024, 256 * 1024};
+
+    printf("%d clients x %d requests, socket buffers %d\n", clients, requests, kSocketBuffer);
+    printf("%-10s %-9s %-6s %12s %12s %12s %10s\n", "response", "mode", "budget", "req/s", "MB/s", "epoll_ctl",
+           "elided");
+    for (size_t size : kSizes) {
+        for (int budget = 0; budget < 2; ++budget) {
+            for (int mode = kLevel; mode <= kEdge; ++mode) {
+                Result r = runOnce(static_cast<Mode>(mode), budget == 1, size, clients, requests);
+                double total = static_cast<double>(clients) * requests;
+                printf("%-10zu %-9s %-6s %12.0f %12.1f %12llu %10llu\n", size, kModeNames[mode], budget ? "64K" : "-",
+                       total / r.seconds, total * size / r.seconds / (1024 * 1024),
+                       static_cast<unsigned long long>(r.epollCtls), static_cast<unsigned long long>(r.elided));
+            }
+        }
+    }
+    return 0;
+}
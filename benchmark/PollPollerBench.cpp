@@ -0,0 +1,154 @@
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Poller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * poll 和 epoll 两种 Poller 在不同 fd 个数、不同活跃比例下的对比
+ * loop 上注册 fds 个 eventfd(都关注读事件)，每轮写其中 active 个，等这 active 个的读回调都执行完算一轮，
+ * 下一轮在 doPendingFunctors 中开始，每轮正好一次 poll；active 个 fd 按轮转的方式选取
+ * 统计一轮的耗时(写 eventfd + poll + 分发 + 读 eventfd)，poll 要扫描整个数组，fd 少的时候省掉的是 epoll 的内核数据结构
+ * 用法: poll_poller_bench [最大 fd 数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int kFdCounts[] = {8, 16, 64, 256, 1024, 4096, 10000};
+const int kActivePercents[] = {0, 1, 10, 100};  // 0 表示每轮只有一个活跃 fd
+const int64_t kWorkPerCell = 2000000;            // 每组的轮数按 (fds + active) 折算，大的组少跑几轮
+
+int64_t nanosSince(Clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+}
+
+class Rounds {
+  public:
+    Rounds(EventLoop *loop, int fds, int active, int rounds)
+        : loop_(loop), active_(active), rounds_(rounds), remaining_(0), next_(0) {
+        samples_.reserve(rounds);
+        for (int i = 0; i < fds; ++i) {
+            int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd < 0) {
+                perror("eventfd");
+                exit(1);
+            }
+            fds_.push_back(fd);
+            channels_.emplace_back(new Channel(loop, fd));
+            channels_.back()->setReadCallback([this, fd](Timestamp) { onRead(fd); });
+            channels_.back()->enableReading();
+        }
+    }
+
+    ~Rounds() {
+        for (size_t i = 0; i < fds_.size(); ++i) {
+            channels_[i]->disableAll();
+            channels_[i]->remove();
+            ::close(fds_[i]);
+        }
+    }
+
+    void start() {
+        remaining_ = active_;
+        begin_ = Clock::now();
+        uint64_t one = 1;
+        for (int i = 0; i < active_; ++i) {
+            ::write(fds_[next_], &one, sizeof(one));
+            next_ = next_ + 1 == fds_.size() ? 0 : next_ + 1;
+        }
+    }
+
+    std::vector<int64_t> &samples() { return samples_; }
+
+  private:
+    void onRead(int fd) {
+        uint64_t value;
+        ::read(fd, &value, sizeof(value));
+        if (--remaining_ > 0) {
+            return;
+        }
+        samples_.push_back(nanosSince(begin_));
+        if (static_cast<int>(samples_.size()) == rounds_) {
+            loop_->quit();
+        } else {
+            loop_->queueInLoop([this]() { start(); });
+        }
+    }
+
+    EventLoop *loop_;
+    int active_;
+    int rounds_;
+    int remaining_;
+    size_t next_;
+    Clock::time_point begin_;
+    std::vector<int> fds_;
+    std::vector<std::unique_ptr<Channel>> channels_;
+    std::vector<int64_t> samples_;
+};
+
+struct Result {
+    int64_t p50;
+    int64_t p99;
+};
+
+Result runOnce(Poller::Backend backend, int fds, int active) {
+    Poller::setDefaultBackend(backend);
+    EventLoop loop;
+    int rounds = static_cast<int>(std::max<int64_t>(100, kWorkPerCell / (fds + active)));
+    Rounds bench(&loop, fds, active, rounds);
+    loop.runInLoop([&bench]() { bench.start(); });
+    loop.loop();
+
+    std::vector<int64_t> &samples = bench.samples();
+    std::sort(samples.begin(), samples.end());
+    Result r;
+    r.p50 = samples[samples.size() / 2];
+    r.p99 = samples[samples.size() * 99 / 100];
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int maxFds = argc > 1 ? atoi(argv[1]) : 10000;
+
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < static_cast<rlim_t>(maxFds + 64)) {
+        rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, maxFds + 64);
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    printf("ns per round (write active eventfds + poll + dispatch + read)\n");
+    printf("%6s %6s %10s %10s %10s %10s %10s\n", "fds", "active", "epoll p50", "epoll p99", "poll p50", "poll p99",
+           "poll/epoll");
+    for (int fds : kFdCounts) {
+        if (fds > maxFds) {
+            break;
+        }
+        int last = 0;
+        for (int percent : kActivePercents) {
+            int active = std::max(1, fds * percent / 100);
+            if (active == last) {
+                continue;
+            }
+            last = active;
+            Result epoll = runOnce(Poller::kEpoll, fds, active);
+            Result poll = runOnce(Poller::kPoll, fds, active);
+            printf("%6d %6d %10lld %10lld %10lld %10lld %10.2f\n", fds, active, static_cast<long long>(epoll.p50),
+                   static_cast<long long>(epoll.p99), static_cast<long long>(poll.p50),
+                   static_cast<long long>(poll.p99), static_cast<double>(poll.p50) / epoll.p50);
+        }
+    }
+    return 0;
+}
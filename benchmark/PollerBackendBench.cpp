@@ -0,0 +1,187 @@
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Poller.h"
+#include "TcpServer.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * epoll 和 io_uring 两种 Poller 的对比，水平触发和边缘触发各跑一遍，io_uring 再跑一遍完成模式(CQ，见 EventLoop::setCompletionMode)
+ * - echo: 每个客户端发 64 字节，读回 64 字节再发下一个
+ * - http: 每个客户端在长连接上发 GET 请求，服务器找到 "\r\n\r\n" 之后回一个固定的 HTTP 响应(头 + size 字节)
+ *   服务器的 SO_SNDBUF 和客户端的 SO_RCVBUF 设成 16K，大响应要多次写，水平触发每次都要打开/关闭写事件
+ * 服务器单线程，客户端每个连接一个线程；注册变化列是 Channel 的 update/remove 次数和实际的系统调用次数，
+ * epoll 每次变化一次 epoll_ctl，io_uring 的变化放在提交队列中，和等待事件在同一次 io_uring_enter 中提交；
+ * 完成模式没有读写事件的注册变化，recv/send 本身也不再是单独的系统调用
+ * 用法: poller_backend_bench [客户端数] [每个客户端请求数]
+ */
+
+namespace {
+
+const uint16_t kPort = 9971;
+const size_t kEchoSize = 64;
+const int kHttpSocketBuffer = 16 * 1024;  // http 客户端 SO_RCVBUF 和服务器 SO_SNDBUF
+const char kRequest[] = "GET /index.html HTTP/1.1\r\nHost: bench\r\nConnection: keep-alive\r\n\r\n";
+
+enum Workload { kEcho, kHttp };
+enum Mode { kLevel, kEdge, kCompletion };
+
+struct Result {
+    const char *poller;
+    double seconds;
+    EventLoop::UpdateStats updates;
+};
+
+int connectServer(int rcvbuf) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (rcvbuf > 0) {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// 阻塞 socket 的客户端: 发 request，读满 responseSize 字节
+void runClient(const std::string &request, size_t responseSize, int requests, int rcvbuf) {
+    int fd = connectServer(rcvbuf);
+    std::vector<char> buf(64 * 1024);
+    for (int i = 0; i < requests; ++i) {
+        if (::write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size())) {
+            perror("write");
+            exit(1);
+        }
+        size_t received = 0;
+        while (received < responseSize) {
+            ssize_t n = ::read(fd, buf.data(), buf.size());
+            if (n <= 0) {
+                perror("read");
+                exit(1);
+            }
+            received += n;
+        }
+    }
+    ::close(fd);
+}
+
+Result runOnce(Poller::Backend backend, Mode mode, Workload workload, size_t size, int clients, int requests) {
+    Poller::setDefaultBackend(backend);
+    EventLoop loop;
+    InetAddress addr(kPort);
+    TcpServer server(&loop, addr, "bench", TcpServer::kReusePort);
+    server.setEdgeTriggered(mode == kEdge);
+    server.setCompletionMode(mode == kCompletion);
+
+    std::string header = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(size) +
+                         "\r\nConnection: keep-alive\r\n\r\n";
+    PayloadPtr response = std::make_shared<const std::string>(header + std::string(size, 'x'));
+
+    std::atomic<int> finished(0);
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected()) {
+            int one = 1;
+            ::setsockopt(conn->fd(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (workload == kHttp) {
+                int sndbuf = kHttpSocketBuffer;
+                ::setsockopt(conn->fd(), SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+            }
+        } else if (++finished == clients) {
+            loop.quit();
+        }
+    });
+    if (workload == kEcho) {
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->send(buf->retrieveAllAsString());
+        });
+    } else {
+        server.setMessageCallback([response](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            static const char kEnd[] = "\r\n\r\n";
+            for (;;) {
+                const char *last = buf->peek() + buf->readableBytes();
+                const char *end = std::search(buf->peek(), last, kEnd, kEnd + 4);
+                if (end == last) {
+                    break;
+                }
+                buf->retrieveUntil(end + 4);
+                conn->send(response);
+            }
+        });
+    }
+    server.start();
+
+    std::string request = workload == kEcho ? std::string(kEchoSize, 'e') : std::string(kRequest);
+    size_t responseSize = workload == kEcho ? kEchoSize : response->size();
+    int rcvbuf = workload == kEcho ? 0 : kHttpSocketBuffer;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) {
+        threads.emplace_back(runClient, request, responseSize, requests, rcvbuf);
+    }
+    loop.loop();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    Result r;
+    r.poller = loop.pollerName();
+    r.seconds = std::chrono::duration<double>(end - begin).count();
+    r.updates = loop.updateStats();
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int clients = argc > 1 ? atoi(argv[1]) : 8;
+    int requests = argc > 2 ? atoi(argv[2]) : 20000;
+
+    struct Case {
+        Workload workload;
+        size_t size;
+        const char *name;
+    };
+    const Case kCases[] = {{kEcho, kEchoSize, "echo 64"}, {kHttp, 128, "http 128"}, {kHttp, 64 * 1024, "http 64K"}};
+    const Poller::Backend kBackends[] = {Poller::kEpoll, Poller::kIoUring};
+
+    printf("%d clients x %d requests\n", clients, requests);
+    printf("%-10s %-9s %-3s %12s %12s %12s\n", "workload", "poller", "mode", "req/s", "updates", "syscalls");
+    const char *kModeNames[] = {"LT", "ET", "CQ"};
+    for (const Case &c : kCases) {
+        for (int mode = kLevel; mode <= kCompletion; ++mode) {
+            for (Poller::Backend backend : kBackends) {
+                if (mode == kCompletion && backend != Poller::kIoUring) {
+                    continue;
+                }
+                Result r = runOnce(backend, static_cast<Mode>(mode), c.workload, c.size, clients, requests);
+                double total = static_cast<double>(clients) * requests;
+                printf("%-10s %-9s %-3s %12.0f %12llu %12llu\n", c.name, r.poller, kModeNames[mode], total / r.seconds,
+                       static_cast<unsigned long long>(r.updates.requests),
+                       static_cast<unsigned long long>(r.updates.syscalls));
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "Channel.h"
+#include "EventLoop.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Poller 注册表在连接频繁建立/断开时的开销
+ * 按固定速率模拟连接: 每个新连接 enableReading(ADD)、enableWriting/disableWriting(MOD)，
+ * 达到 live 个连接之后每建立一个就断开最老的一个(disableAll + remove，DEL)，fd 用 eventfd 代替 socket
+ * 统计每个连接一次建立 + 一次断开的耗时分布，慢的那部分就是哈希表扩容、冲突造成的尖刺
+ * 两轮: 真实的 epoll_ctl；epoll_ctl 在本程序中替换为空操作，只剩 Poller 自己的开销
+ * 用法: poller_churn_bench [live 连接数] [每秒连接数] [秒数]
+ */
+
+namespace {
+bool g_stubEpollCtl = false;
+}
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) __THROW {
+    if (g_stubEpollCtl) {
+        return 0;
+    }
+    return static_cast<int>(::syscall(SYS_epoll_ctl, epfd, op, fd, event));
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Conn {
+    int fd;
+    std::unique_ptr<Channel> channel;
+};
+
+int64_t nanosSince(Clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+}
+
+Conn openConn(EventLoop *loop) {
+    Conn conn;
+    conn.fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (conn.fd < 0) {
+        perror("eventfd");
+        exit(1);
+    }
+    conn.channel.reset(new Channel(loop, conn.fd));
+    return conn;
+}
+
+void runOnce(const char *name, int live, int rate, int seconds) {
+    EventLoop loop;
+    std::deque<Conn> conns;
+    std::vector<int64_t> samples;
+    samples.reserve(static_cast<size_t>(rate) * seconds);
+
+    const int perTick = std::max(1, rate / 1000);  // 每毫秒建立的连接数
+    const int ticks = seconds * 1000;
+    Clock::time_point start = Clock::now();
+    int64_t late = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        for (int i = 0; i < perTick; ++i) {
+            // 新建、关闭 fd 不计时，只计 Channel 和 Poller 上的操作
+            Conn conn = openConn(&loop);
+            Conn old;
+            old.fd = -1;
+            bool closing = static_cast<int>(conns.size()) >= live;
+            if (closing) {
+                old = std::move(conns.front());
+                conns.pop_front();
+            }
+
+            Clock::time_point begin = Clock::now();
+            conn.channel->enableReading();
+            conn.channel->enableWriting();
+            conn.channel->disableWriting();
+            if (closing) {
+                old.channel->disableAll();
+                old.channel->remove();
+            }
+            samples.push_back(nanosSince(begin));
+
+            if (closing) {
+                ::close(old.fd);
+            }
+            conns.push_back(std::move(conn));
+        }
+
+        // 按速率节拍，跟不上时不睡眠
+        Clock::time_point next = start + std::chrono::microseconds(1000 * (tick + 1));
+        if (Clock::now() < next) {
+            std::this_thread::sleep_until(next);
+        } else {
+            ++late;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (Conn &conn : conns) {
+        conn.channel->disableAll();
+        conn.channel->remove();
+        ::close(conn.fd);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    int64_t over10us = n - (std::upper_bound(samples.begin(), samples.end(), 10000) - samples.begin());
+    printf("%-22s %10.0f %8lld %8lld %8lld %8lld %10lld %6lld\n", name, n / elapsed,
+           static_cast<long long>(samples[n / 2]), static_cast<long long>(samples[n * 99 / 100]),
+           static_cast<long long>(samples[n * 999 / 1000]), static_cast<long long>(samples[n - 1]),
+           static_cast<long long>(over10us), static_cast<long long>(late));
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int live = argc > 1 ? atoi(argv[1]) : 10000;
+    int rate = argc > 2 ? atoi(argv[2]) : 50000;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < static_cast<rlim_t>(live + 64)) {
+        rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, live + 64);
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    printf("live %d, %d conn/s, %d s; latency of ADD + 2 MOD + DEL per connection in ns\n", live, rate, seconds);
+    printf("%-22s %10s %8s %8s %8s %8s %10s %6s\n", "epoll_ctl", "conn/s", "p50", "p99", "p99.9", "max", ">10us",
+           "late");
+    runOnce("syscall", live, rate, seconds);
+    g_stubEpollCtl = true;
+    runOnce("stubbed (table only)", live, rate, seconds);
+    return 0;
+}
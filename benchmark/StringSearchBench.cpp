@@ -0,0 +1,153 @@
+#include "StringSearch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/**
+ * 分隔符查找的性能对比
+ * - parse: 模拟 HttpContext 逐行解析，每行都从行首找 "\r\n"，原实现使用 std::search
+ * - header-end: 一次扫描找到 "\r\n\r\n"
+ * - char: 在长行中找单个字符
+ * 用法: string_search_bench [iterations]
+ */
+
+namespace {
+
+const char kCRLF[] = "\r\n";
+const char kCRLFCRLF[] = "\r\n\r\n";
+
+// 构造一个有 headers 行、总长约 size 字节的请求头
+std::string makeRequest(size_t size) {
+    std::string req = "GET /index.html?user=muduo&page=1 HTTP/1.1\r\n";
+    int i = 0;
+    while (req.size() + 4 < size) {
+        char line[128];
+        snprintf(line, sizeof line, "X-Header-%d: value-%d-abcdefghijklmnopqrstuvwxyz0123456789\r\n", i, i * 7);
+        req += line;
+        ++i;
+    }
+    req += "\r\n";
+    return req;
+}
+
+const char *searchCRLF(const char *b, const char *e) {
+    const char *p = std::search(b, e, kCRLF, kCRLF + 2);
+    return p == e ? NULL : p;
+}
+
+const char *searchCRLFCRLF(const char *b, const char *e) {
+    const char *p = std::search(b, e, kCRLFCRLF, kCRLFCRLF + 4);
+    return p == e ? NULL : p;
+}
+
+const char *memmemCRLF(const char *b, const char *e) {
+    return static_cast<const char *>(memmem(b, e - b, kCRLF, 2));
+}
+
+const char *memmemCRLFCRLF(const char *b, const char *e) {
+    return static_cast<const char *>(memmem(b, e - b, kCRLFCRLF, 4));
+}
+
+const char *memchrChar(const char *b, const char *e) { return static_cast<const char *>(memchr(b, '#', e - b)); }
+
+const char *kernelCRLF(const char *b, const char *e) { return StringSearch::findCRLF(b, e); }
+const char *kernelCRLFCRLF(const char *b, const char *e) { return StringSearch::findCRLFCRLF(b, e); }
+const char *kernelChar(const char *b, const char *e) { return StringSearch::findChar(b, e, '#'); }
+
+typedef const char *(*SearchFunc)(const char *, const char *);
+
+volatile size_t g_sink;
+
+// 阻止编译器把 memchr/memmem 这类纯函数的调用提到循环外
+inline void clobber(const char *&p) { asm volatile("" : "+r"(p)); }
+
+double nowNs() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 逐行解析: 每找到一行就从下一行开始继续找
+double benchParse(SearchFunc find, const std::string &req, int iterations) {
+    const char *begin = req.data();
+    const char *end = begin + req.size();
+    size_t lines = 0;
+    double start = nowNs();
+    for (int n = 0; n < iterations; ++n) {
+        clobber(begin);
+        const char *p = begin;
+        const char *crlf;
+        while ((crlf = find(p, end)) != NULL && crlf != p) {
+            ++lines;
+            p = crlf + 2;
+        }
+    }
+    double elapsed = nowNs() - start;
+    g_sink = lines;
+    return elapsed / iterations;
+}
+
+double benchOnce(SearchFunc find, const std::string &data, int iterations) {
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    size_t sum = 0;
+    double start = nowNs();
+    for (int n = 0; n < iterations; ++n) {
+        clobber(begin);
+        const char *p = find(begin, end);
+        sum += p ? p - begin : 0;
+    }
+    double elapsed = nowNs() - start;
+    g_sink = sum;
+    return elapsed / iterations;
+}
+
+void report(const char *name, size_t bytes, double ns) {
+    printf("  %-22s %10.1f ns %8.2f GB/s\n", name, ns, bytes / ns);
+}
+
+void runKernels(const char *title, SearchFunc kernel, double (*bench)(SearchFunc, const std::string &, int),
+                const std::string &data, int iterations) {
+    const StringSearch::Impl impls[] = {StringSearch::kScalar, StringSearch::kSSE2, StringSearch::kAVX2};
+    for (size_t i = 0; i < sizeof impls / sizeof impls[0]; ++i) {
+        if (!StringSearch::setImpl(impls[i])) {
+            continue;
+        }
+        std::string name = std::string(title) + StringSearch::implName(impls[i]);
+        report(name.c_str(), data.size(), bench(kernel, data, iterations));
+    }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    StringSearch::Impl best = StringSearch::impl();
+    printf("dispatch: %s\n", StringSearch::implName(best));
+
+    const size_t sizes[] = {256, 1024, 4096, 16384};
+    for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; ++i) {
+        std::string req = makeRequest(sizes[i]);
+        int iters = static_cast<int>(iterations * 1024 / std::max<size_t>(req.size(), 1024));
+        printf("\nrequest %zu bytes\n", req.size());
+
+        printf(" parse line by line\n");
+        report("std::search", req.size(), benchParse(searchCRLF, req, iters));
+        report("memmem", req.size(), benchParse(memmemCRLF, req, iters));
+        runKernels("findCRLF/", kernelCRLF, benchParse, req, iters);
+
+        printf(" find header end\n");
+        report("std::search", req.size(), benchOnce(searchCRLFCRLF, req, iters));
+        report("memmem", req.size(), benchOnce(memmemCRLFCRLF, req, iters));
+        runKernels("findCRLFCRLF/", kernelCRLFCRLF, benchOnce, req, iters);
+
+        printf(" find char (absent)\n");
+        report("memchr", req.size(), benchOnce(memchrChar, req, iters));
+        runKernels("findChar/", kernelChar, benchOnce, req, iters);
+        StringSearch::setImpl(best);
+    }
+
+    return 0;
+}
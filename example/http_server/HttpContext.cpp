@@ -1,5 +1,6 @@
 #include "HttpContext.h"
 #include "Buffer.h"
+#include "StringSearch.h"
 
 // 解析请求行
 bool HttpContext::processRequestLine(const char *begin, const char *end)
@@ -54,72 +55,50 @@ bool HttpContext::processRequestLine(const char *begin, const char *end)
 }
 
 // return false if any error
+//!NOTE: 先用 findHeaderEnd 一次扫描确认整个请求头已经收全，再在头部范围内按行切分，
+//       不再每一行都从 peek() 开始找 "\r\n"；头部没有收全时数据留在 buf 中，等下一次 onMessage
 bool HttpContext::parseRequest(Buffer* buf, Timestamp receiveTime)
 {
-    bool ok = false;
-    bool hasMore = true;
-    while (hasMore)
+    if (state_ == kGotAll)
     {
-        // 请求行状态
-        if (state_ == kExpectRequestLine)
-        {
-            // 找到 \r\n 位置
-            const char* crlf = buf->findCRLF();
-            if (crlf)
-            {
-                // 从可读区读取请求行
-                // [peek(), crlf + 2) 是一行
-                ok = processRequestLine(buf->peek(), crlf);
-                if (ok)
-                {
-                    request_.setReceiveTime(receiveTime);
-                    // readerIndex 向后移动位置直到 crlf + 2
-                    buf->retrieveUntil(crlf + 2);
-                    // 状态转移，接下来解析请求头
-                    state_ = kExpectHeaders;
-                }
-                else
-                {
-                    hasMore = false;
-                }
-            }
-            else
-            {
-                hasMore = false;
-            }
-        }
-        // 解析请求头
-        else if (state_ == kExpectHeaders)
-        {
-            const char* crlf = buf->findCRLF();
-            if (crlf)
-            {
-                // 找到 : 位置
-                const char* colon = std::find(buf->peek(), crlf, ':');
-                if (colon != crlf)
-                {
-                    // 添加状态首部
-                    request_.addHeader(buf->peek(), colon, crlf);
-                }
-                else // colon == crlf 说明没有找到 : 了，直接返回 end
-                {
-                    // empty line, end of header
-                    // FIXME:
-                    state_ = kGotAll;
-                    hasMore = false;
-                }
-                buf->retrieveUntil(crlf + 2);
-            }
-            else
-            {
-                hasMore = false;
-            }
-        }
-        // 解析请求体，可以看到这里没有做出处理，只支持GET请求
-        else if (state_ == kExpectBody)
+        return true;
+    }
+
+    const char* headerEnd = buf->findHeaderEnd();
+    if (!headerEnd)
+    {
+        return true;
+    }
+    // [peek(), end) 是请求行和所有请求头，每一行都以 "\r\n" 结尾
+    const char* end = headerEnd + 2;
+
+    // 请求行状态
+    const char* start = buf->peek();
+    const char* crlf = StringSearch::findCRLF(start, end);
+    if (!processRequestLine(start, crlf))
+    {
+        return false;
+    }
+    request_.setReceiveTime(receiveTime);
+    start = crlf + 2;
+    state_ = kExpectHeaders;
+
+    // 解析请求头
+    while (start < end)
+    {
+        crlf = StringSearch::findCRLF(start, end);
+        // 找到 : 位置，没有 : 的行直接忽略
+        const char* colon = StringSearch::findChar(start, crlf, ':');
+        if (colon)
         {
-            // FIXME:
+            request_.addHeader(start, colon, crlf);
         }
+        start = crlf + 2;
     }
-    return ok;
+
+    // readerIndex 向后移动到空行之后
+    // 请求体没有做出处理，只支持没有请求体的请求
+    buf->retrieveUntil(headerEnd + 4);
+    state_ = kGotAll;
+    return true;
 }
@@ -8,7 +8,7 @@
 class HttpRequest
 {
 public:
-    enum Method { kInvalid, kGet, kPost, kHead, kPut, kDelete };
+    enum Method { kInvalid, kGet, kPost, kHead, kPut, kDelete, kConnect };
     enum Version { kUnknown, kHTTP10, kHTTP11 };
 
     HttpRequest()
@@ -47,6 +47,10 @@ public:
         {
           method_ = kDelete;
         }
+        else if (m == "CONNECT")
+        {
+          method_ = kConnect;
+        }
         else
         {
           method_ = kInvalid;
@@ -77,6 +81,9 @@ public:
           case kDelete:
             result = "DELETE";
             break;
+          case kConnect:
+            result = "CONNECT";
+            break;
           default:
             break;
         }
@@ -3,35 +3,78 @@
 
 #include <cstdio>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-void HttpResponse::appendToBuffer(Buffer* output) const
+HttpResponse::~HttpResponse()
+{
+    if (fileFd_ >= 0)
+    {
+        ::close(fileFd_);
+    }
+}
+
+bool HttpResponse::setBodyFile(const std::string& path)
 {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    if (fileFd_ >= 0)
+    {
+        ::close(fileFd_);
+    }
+    fileFd_ = fd;
+    fileLength_ = st.st_size;
+    body_.clear();
+    return true;
+}
+
+std::string HttpResponse::headerToString() const
+{
+    std::string output;
+    output.reserve(128);
+
     // 响应行
     char buf[32];
     memset(buf, '\0', sizeof(buf));
     snprintf(buf, sizeof(buf), "HTTP/1.1 %d ", statusCode_);
-    output->append(buf);
-    output->append(statusMessage_);
-    output->append("\r\n");
+    output.append(buf);
+    output.append(statusMessage_);
+    output.append("\r\n");
 
     if (closeConnection_)
     {
-        output->append("Connection: close\r\n");
+        output.append("Connection: close\r\n");
     }
     else
     {
-        snprintf(buf, sizeof(buf), "Content-Length: %zd\r\n", body_.size());
-        output->append(buf);
-        output->append("Connection: Keep-Alive\r\n");
+        snprintf(buf, sizeof(buf), "Content-Length: %zd\r\n", hasBodyFile() ? fileLength_ : body_.size());
+        output.append(buf);
+        output.append("Connection: Keep-Alive\r\n");
     }
 
     for (const auto& header : headers_)
     {
-        output->append(header.first);
-        output->append(": ");
-        output->append(header.second);
-        output->append("\r\n");
+        output.append(header.first);
+        output.append(": ");
+        output.append(header.second);
+        output.append("\r\n");
     }
-    output->append("\r\n");
+    output.append("\r\n");
+    return output;
+}
+
+void HttpResponse::appendToBuffer(Buffer* output) const
+{
+    output->append(headerToString());
     output->append(body_); 
 }
\ No newline at end of file
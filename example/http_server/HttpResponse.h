@@ -1,9 +1,12 @@
 #pragma once
 
+#include "noncopyable.h"
+
+#include <string>
 #include <unordered_map>
 
 class Buffer;
-class HttpResponse
+class HttpResponse : noncopyable
 {
 public:
     // 响应状态码
@@ -13,15 +16,21 @@ public:
         k200Ok = 200,
         k301MovedPermanently = 301,
         k400BadRequest = 400,
+        k403Forbidden = 403,
         k404NotFound = 404,
+        k502BadGateway = 502,
     };  
 
     explicit HttpResponse(bool close)
       : statusCode_(kUnknown),
-        closeConnection_(close)
+        closeConnection_(close),
+        fileFd_(-1),
+        fileLength_(0)
     {
     }   
 
+    ~HttpResponse();
+
     void setStatusCode(HttpStatusCode code)
     { statusCode_ = code; } 
 
@@ -43,6 +52,32 @@ public:
     void setBody(const std::string& body)
     { body_ = body; }   
 
+    void setBody(std::string&& body)
+    { body_ = std::move(body); }
+
+    // 交出响应体，避免发送时再拷贝一次
+    std::string releaseBody()
+    {
+        std::string body;
+        body.swap(body_);
+        return body;
+    }
+
+    // 用文件内容作为响应体，发送时走 sendfile，不读进用户态内存，失败返回 false
+    bool setBodyFile(const std::string& path);
+
+    bool hasBodyFile() const
+    { return fileFd_ >= 0; }
+
+    int bodyFileFd() const
+    { return fileFd_; }
+
+    size_t bodyFileLength() const
+    { return fileLength_; }
+
+    // 响应行 + 响应头 + 空行
+    std::string headerToString() const;
+
     void appendToBuffer(Buffer* output) const;
 
 private:
@@ -52,4 +87,6 @@ private:
     std::string statusMessage_;
     bool closeConnection_;
     std::string body_;
+    int fileFd_;         // 文件响应体，析构时关闭
+    size_t fileLength_;
 };
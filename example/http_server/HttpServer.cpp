@@ -2,9 +2,11 @@
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "HttpContext.h"
+#include "TcpRelay.h"
 
 #include <functional>
 #include <cassert>
+#include <vector>
 
 using namespace std::placeholders;
 
@@ -60,6 +62,14 @@ void HttpServer::onConnection(const TcpConnectionPtr& conn)
     {
         LOG_INFO("Connection closed");
 
+        // CONNECT 隧道的 client 断开，关闭后端连接
+        std::shared_ptr<TcpRelay> relay = std::static_pointer_cast<TcpRelay>(conn->getContext());
+        if (relay)
+        {
+            relay->stop();
+            conn->setContext(std::shared_ptr<void>());
+        }
+
         assert(nodeMap_.count(conn->name()));
         const Node &node = nodeMap_[conn->name()];
         nodeMap_.erase(conn->name());
@@ -108,6 +118,12 @@ void HttpServer::onMessage(const TcpConnectionPtr& conn,
 
 void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
 {
+    if (req.method() == HttpRequest::kConnect)
+    {
+        onConnect(conn, req);
+        return;
+    }
+
     const std::string& connection = req.getHeader("Connection");
 
     // 判断长连接还是短连接
@@ -123,9 +139,18 @@ void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
     // 此处初始化了一些response的信息，比如响应码，回复OK
     httpCallback_(req, &response);
 
-    Buffer buf;
-    response.appendToBuffer(&buf);
-    conn->send(&buf);
+    // 响应头和响应体作为两段交给 sendv，一次 writev 发出，中间不再拼接拷贝
+    std::vector<std::string> slices;
+    slices.reserve(2);
+    slices.push_back(response.headerToString());
+    slices.push_back(response.releaseBody());
+    conn->sendv(std::move(slices));
+
+    // 文件响应体排在响应头之后，直接 sendfile 发送
+    if (response.hasBodyFile())
+    {
+        conn->sendFile(response.bodyFileFd(), 0, response.bodyFileLength());
+    }
     
     if (response.closeConnection())
     {
@@ -133,6 +158,47 @@ void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
     }
 }
 
+/**
+ * CONNECT host:port 建立隧道
+ * 连接后端期间停止读 client，成功后回复 200，之后两端的数据由 TcpRelay 经 pipe 用 splice 搬运，
+ * 请求头之后 client 已经发来的数据留在 inputBuffer 中，由 relay 先转发给后端
+ */
+void HttpServer::onConnect(const TcpConnectionPtr& conn, const HttpRequest& req)
+{
+    InetAddress backend;
+    if (!tunnelCallback_ || !tunnelCallback_(req, &backend))
+    {
+        LOG_INFO("CONNECT %s denied", req.path().c_str());
+        conn->send("HTTP/1.1 403 Forbidden\r\n\r\n");
+        conn->shutdown();
+        return;
+    }
+
+    assert(nodeMap_.count(conn->name()));
+    nodeMap_[conn->name()].tunnel = true;
+
+    conn->stopRead();
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    TcpRelay::connect(conn, backend, [weakConn](const std::shared_ptr<TcpRelay>& relay) {
+        TcpConnectionPtr client = weakConn.lock();
+        if (!client)
+        {
+            return;
+        }
+        if (relay)
+        {
+            // 200 先进入 client 的 outputQueue，relay 保证它先于隧道数据发出
+            client->send("HTTP/1.1 200 Connection Established\r\n\r\n");
+            client->setContext(relay);
+        }
+        else
+        {
+            client->send("HTTP/1.1 502 Bad Gateway\r\n\r\n");
+            client->shutdown();
+        }
+    });
+}
+
 void HttpServer::onTimer()
 {
     Timestamp now = Timestamp::now();
@@ -143,6 +209,11 @@ void HttpServer::onTimer()
         if (conn)
         {
             Node *n = &nodeMap_[conn->name()];
+            if (n->tunnel)
+            {
+                ++it;
+                continue;
+            }
             double age = timeDifference(now, n->lastReceiveTime);
             if (age > idleSeconds_)
             {
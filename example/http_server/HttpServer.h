@@ -10,11 +10,14 @@
 
 class HttpRequest;
 class HttpResponse;
+class TcpRelay;
 
 class HttpServer : noncopyable
 {
 public:
     using HttpCallback = std::function<void (const HttpRequest&, HttpResponse*)>;
+    // CONNECT 请求的回调，返回 true 并填好 backend 表示允许建立隧道，否则回复 403
+    using TunnelCallback = std::function<bool (const HttpRequest&, InetAddress* backend)>;
 
     HttpServer(EventLoop *loop,
             const InetAddress& listenAddr,
@@ -28,6 +31,12 @@ public:
     {
         httpCallback_ = cb;
     }
+
+    // 没有设置时 CONNECT 一律回复 403
+    void setTunnelCallback(const TunnelCallback& cb)
+    {
+        tunnelCallback_ = cb;
+    }
     
     void start();
 
@@ -37,9 +46,11 @@ private:
                     Buffer *buf,
                     Timestamp receiveTime);
     void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+    void onConnect(const TcpConnectionPtr&, const HttpRequest&);
 
     TcpServer server_;
     HttpCallback httpCallback_;
+    TunnelCallback tunnelCallback_;
 
     /* 定时器相关 */
     void onTimer();
@@ -50,6 +61,7 @@ private:
     struct Node {
         Timestamp lastReceiveTime;
         WeakConnectionList::iterator position;
+        bool tunnel = false;  // CONNECT 隧道不再收到 onMessage，不参与空闲超时
     };
     using NameNode = std::unordered_map<std::string, Node>; // connName --> Node
 
@@ -56,6 +56,24 @@ void onRequest(const HttpRequest& req, HttpResponse* resp)
 
 }
 
+// 只允许 CONNECT 到本机端口，比如 CONNECT 127.0.0.1:8000 HTTP/1.1
+bool onTunnel(const HttpRequest& req, InetAddress* backend)
+{
+    const std::string& target = req.path();
+    std::string::size_type colon = target.rfind(':');
+    if (colon == std::string::npos || target.substr(0, colon) != "127.0.0.1")
+    {
+        return false;
+    }
+    int port = atoi(target.c_str() + colon + 1);
+    if (port <= 0 || port > 65535)
+    {
+        return false;
+    }
+    *backend = InetAddress(static_cast<uint16_t>(port));
+    return true;
+}
+
 int main(int argc, char* argv[])
 {
     EventLoop loop;
@@ -67,6 +85,7 @@ int main(int argc, char* argv[])
 
     HttpServer server(&loop, InetAddress(8080), idleSeconds, "http-server");
     server.setHttpCallback(onRequest);
+    server.setTunnelCallback(onTunnel);
     server.start();
     loop.loop();
 }
@@ -0,0 +1,96 @@
+#include "EventLoop.h"
+#include "TcpServer.h"
+#include "TcpRelay.h"
+#include "Logger.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * TCP 端口转发: 每个 client 连接对应一条到 backend 的连接，两端数据由 TcpRelay 用 splice 搬运
+ * 用法: tcprelay listenPort backendIp backendPort [threads]
+ */
+class RelayServer
+{
+public:
+    RelayServer(EventLoop *loop, const InetAddress &addr, const InetAddress &backend, int threads)
+        : server_(loop, addr, "RelayServer")
+        , backend_(backend)
+    {
+        server_.setConnectionCallback(
+            std::bind(&RelayServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(
+            std::bind(&RelayServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        server_.setThreadNum(threads);
+    }
+
+    void start()
+    {
+        server_.start();
+    }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            LOG_INFO("Connection UP: %s", conn->peerAddress().toIpPort().c_str());
+            // 连上 backend 之前先不读 client，已经读到的数据留在 inputBuffer 里由 relay 转发
+            conn->stopRead();
+            std::weak_ptr<TcpConnection> weakConn(conn);
+            TcpRelay::connect(conn, backend_, [weakConn](const std::shared_ptr<TcpRelay> &relay) {
+                TcpConnectionPtr client = weakConn.lock();
+                if (!client)
+                {
+                    return;
+                }
+                if (relay)
+                {
+                    client->setContext(relay);
+                }
+                else
+                {
+                    client->shutdown();
+                }
+            });
+        }
+        else
+        {
+            LOG_INFO("Connection DOWN: %s", conn->peerAddress().toIpPort().c_str());
+            std::shared_ptr<TcpRelay> relay = std::static_pointer_cast<TcpRelay>(conn->getContext());
+            if (relay)
+            {
+                relay->stop();
+                conn->setContext(std::shared_ptr<void>());
+            }
+        }
+    }
+
+    // relay 接管之后不会再回调
+    void onMessage(const TcpConnectionPtr &, Buffer *, Timestamp)
+    {
+    }
+
+    TcpServer server_;
+    InetAddress backend_;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        printf("Usage: %s listenPort backendIp backendPort [threads]\n", argv[0]);
+        return 1;
+    }
+
+    LOG_INFO("pid = %d", getpid());
+    EventLoop loop;
+    InetAddress addr(static_cast<uint16_t>(atoi(argv[1])));
+    InetAddress backend(static_cast<uint16_t>(atoi(argv[3])), argv[2]);
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+    RelayServer server(&loop, addr, backend, threads);
+    server.start();
+    loop.loop();
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * HDR 风格的直方图: 小于 kSubBuckets 的值每个一个桶，之后每个 2 的幂区间等分成 kSubBuckets 个桶，
+ * 相对误差不超过 1/kSubBuckets，纳秒到秒的范围只需要几百个桶
+ * record 只能在一个线程中调用(通常是 loop 线程)，snapshot 可以在任意线程调用
+ */
+class Histogram : noncopyable {
+  public:
+    static const int kSubBucketBits = 3;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kMaxExponent = 36;  // 不小于 2^37 的值(纳秒时超过 137s)都放进最后一个桶
+    static const int kNumBuckets = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+    struct Snapshot {
+        Snapshot();
+
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[kNumBuckets];
+
+        double mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / count; }
+
+        // 第 p(0 到 100)百分位所在桶的上界，不超过 max；没有数据时返回 0
+        uint64_t percentile(double p) const;
+
+        void merge(const Snapshot &other);
+    };
+
+    Histogram();
+
+    void record(uint64_t value);
+
+    Snapshot snapshot() const;
+
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(int i);  // 桶 i 中最大的值，最后一个桶返回 UINT64_MAX
+
+  private:
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+    std::atomic<uint64_t> buckets_[kNumBuckets];
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 只能移动的 std::function 替代品，回调对象放在内部的定长存储中
+ *
+ * - 默认 kInlineFunctionCapacity 字节，足够放下 std::bind(&Class::method, shared_from_this(), 几个参数)，
+ *   或者捕获一个 shared_ptr 加几个参数的 lambda，这些情况下构造和移动都不会申请堆内存
+ * - 放不下(或者移动可能抛异常)的回调对象退化为堆上保存，行为和 std::function 一样，只是多一次分配
+ * - 不能拷贝，投递到 EventLoop 的回调只会被执行一次，不需要拷贝
+ * - 空的 std::function、空函数指针构造出来的 InlineFunction 也是空的
+ */
+static const size_t kInlineFunctionCapacity = 64;
+
+template <typename Signature, size_t Capacity = kInlineFunctionCapacity>
+class InlineFunction;
+
+template <typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity> {
+  public:
+    InlineFunction() noexcept : ops_(nullptr) {}
+    InlineFunction(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction(F &&f) : ops_(nullptr) {
+        using Target = typename std::decay<F>::type;
+        if (!isNull(f)) {
+            construct<Target>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Target>()>());
+        }
+    }
+
+    InlineFunction(InlineFunction &&rhs) noexcept : ops_(rhs.ops_) {
+        if (ops_ != nullptr) {
+            ops_->move(&storage_, &rhs.storage_);
+            rhs.ops_ = nullptr;
+        }
+    }
+
+    InlineFunction &operator=(InlineFunction &&rhs) noexcept {
+        if (this != &rhs) {
+            reset();
+            if (rhs.ops_ != nullptr) {
+                rhs.ops_->move(&storage_, &rhs.storage_);
+                ops_ = rhs.ops_;
+                rhs.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineFunction &operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction &operator=(F &&f) {
+        return *this = InlineFunction(std::forward<F>(f));
+    }
+
+    InlineFunction(const InlineFunction &) = delete;
+    InlineFunction &operator=(const InlineFunction &) = delete;
+
+    ~InlineFunction() { reset(); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    // 和 std::function 一样是 const 的，回调对象自己可以有状态
+    R operator()(Args... args) const {
+        if (ops_ == nullptr) {
+            throw std::bad_function_call();
+        }
+        return ops_->invoke(const_cast<Storage *>(&storage_), std::forward<Args>(args)...);
+    }
+
+    // 回调对象是否放在内部存储中(没有申请堆内存)
+    bool isInline() const noexcept { return ops_ != nullptr && ops_->inlined; }
+
+    template <typename F>
+    static constexpr bool fitsInline() {
+        return sizeof(F) <= Capacity && alignof(F) <= alignof(Storage) &&
+               std::is_nothrow_move_constructible<F>::value;
+    }
+
+  private:
+    using Storage = typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type;
+
+    struct Ops {
+        R (*invoke)(void *storage, Args &&...args);
+        void (*move)(void *dst, void *src);  // 移动到 dst，并析构 src
+        void (*destroy)(void *storage);
+        bool inlined;
+    };
+
+    template <typename F>
+    struct InlineOps {
+        static R invoke(void *storage, Args &&...args) {
+            return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+        }
+        static void move(void *dst, void *src) {
+            ::new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        }
+        static void destroy(void *storage) { static_cast<F *>(storage)->~F(); }
+
+        static constexpr Ops ops = {&invoke, &move, &destroy, true};
+    };
+
+    // 存储中只放一个指针
+    template <typename F>
+    struct HeapOps {
+        static F *&target(void *storage) { return *static_cast<F **>(storage); }
+
+        static R invoke(void *storage, Args &&...args) { return (*target(storage))(std::forward<Args>(args)...); }
+        static void move(void *dst, void *src) {
+            target(dst) = target(src);
+            target(src) = nullptr;
+        }
+        static void destroy(void *storage) { delete target(storage); }
+
+        static constexpr Ops ops = {&invoke, &move, &destroy, false};
+    };
+
+    template <typename F>
+    static bool isNull(const F &) {
+        return false;
+    }
+    template <typename T>
+    static bool isNull(T *const &p) {
+        return p == nullptr;
+    }
+    template <typename Sig>
+    static bool isNull(const std::function<Sig> &f) {
+        return !f;
+    }
+
+    template <typename Target, typename F>
+    void construct(F &&f, std::true_type) {
+        ::new (static_cast<void *>(&storage_)) Target(std::forward<F>(f));
+        ops_ = &InlineOps<Target>::ops;
+    }
+
+    template <typename Target, typename F>
+    void construct(F &&f, std::false_type) {
+        *reinterpret_cast<Target **>(&storage_) = new Target(std::forward<F>(f));
+        ops_ = &HeapOps<Target>::ops;
+    }
+
+    void reset() noexcept {
+        if (ops_ != nullptr) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    Storage storage_;
+    const Ops *ops_;
+};
+
+template <typename R, typename... Args, size_t Capacity>
+template <typename F>
+constexpr typename InlineFunction<R(Args...), Capacity>::Ops InlineFunction<R(Args...), Capacity>::InlineOps<F>::ops;
+
+template <typename R, typename... Args, size_t Capacity>
+template <typename F>
+constexpr typename InlineFunction<R(Args...), Capacity>::Ops InlineFunction<R(Args...), Capacity>::HeapOps<F>::ops;
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+
+// 侵入式队列的链接字段，元素继承它
+struct MpscQueueNode {
+    MpscQueueNode() : mpscNext(nullptr) {}
+
+    std::atomic<MpscQueueNode *> mpscNext;
+};
+
+/**
+ * 侵入式无锁多生产者单消费者队列(Dmitry Vyukov 的 MPSC 算法)
+ *
+ * - push: 任意线程调用，一次 exchange 加一次 store，不加锁也不重试(wait-free)
+ * - consumeAll: 只能由唯一的消费者线程调用，只取调用时已经在队列中的元素，之后加入的留给下一次
+ * - 队列不拥有元素，也不分配内存；元素在 push 之后、被 consumeAll 交给回调之前不能被修改或释放
+ *
+ * 生产者写的 head_ 和消费者写的 tail_ 放在不同的 cache line，互不干扰
+ * 生产者在 exchange 和链接 next 之间被打断时，消费者暂时看不到这个元素，consumeAll 会提前返回，
+ * 生产者 push 返回之后的唤醒保证它在下一次 consumeAll 中被取出
+ */
+template <typename T>
+class MpscQueue : noncopyable {
+  public:
+    static const size_t kCacheLineSize = 64;
+
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+
+    void push(T *node) { push(static_cast<MpscQueueNode *>(node)); }
+
+    // 消费者线程判断队列是否为空，生产者还没有链接完的元素也算作非空
+    bool empty() const {
+        return tail_ == &stub_ && stub_.mpscNext.load(std::memory_order_acquire) == nullptr &&
+               head_.load(std::memory_order_acquire) == &stub_;
+    }
+
+    /**
+     * 依次把调用时队列中的元素交给 f(T *)，返回处理的个数
+     * 交给 f 之后队列不再访问这个元素，f 可以直接释放它，也可以在 f 中 push 新的元素
+     */
+    template <typename F>
+    size_t consumeAll(F f) {
+        MpscQueueNode *last = head_.load(std::memory_order_acquire);
+        size_t count = 0;
+        for (;;) {
+            MpscQueueNode *tail = tail_;
+            MpscQueueNode *next = tail->mpscNext.load(std::memory_order_acquire);
+            if (tail == &stub_) {
+                // stub 就是开始时的最后一个元素，说明它前面的都已经取完
+                if (next == nullptr || tail == last) {
+                    return count;
+                }
+                tail_ = next;
+                tail = next;
+                next = next->mpscNext.load(std::memory_order_acquire);
+            }
+            if (next == nullptr) {
+                if (tail != head_.load(std::memory_order_acquire)) {
+                    return count;  // 生产者还在链接 tail 的下一个元素
+                }
+                // tail 是队列中唯一的元素，放回 stub 之后才能把 tail 取出来
+                push(&stub_);
+                next = tail->mpscNext.load(std::memory_order_acquire);
+                if (next == nullptr) {
+                    return count;
+                }
+            }
+            tail_ = next;
+            bool done = tail == last;
+            f(static_cast<T *>(tail));
+            ++count;
+            if (done) {
+                return count;
+            }
+        }
+    }
+
+  private:
+    void push(MpscQueueNode *node) {
+        node->mpscNext.store(nullptr, std::memory_order_relaxed);
+        MpscQueueNode *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->mpscNext.store(node, std::memory_order_release);
+    }
+
+    alignas(kCacheLineSize) std::atomic<MpscQueueNode *> head_;  // 生产者: 最后一个元素
+    alignas(kCacheLineSize) MpscQueueNode *tail_;                // 消费者: 下一个要取的元素
+    MpscQueueNode stub_;
+};
+
+template <typename T>
+const size_t MpscQueue<T>::kCacheLineSize;
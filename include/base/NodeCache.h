@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * 定长节点(回调队列节点、定时器)的空闲链表，T 需要有 T *nextFree 成员
+ *
+ * - 每个线程一个本地链表，get/put 不需要原子操作
+ * - 本地链表满了之后放进所有线程共享的无锁栈；本地链表为空时一次取走共享栈中的所有节点
+ *   节点在投递线程申请、在 loop 线程释放，经过共享栈回到投递线程，跨线程投递在稳定状态下也不申请内存
+ * - 共享栈只有 push(CAS)和整体取走(exchange)，没有单个弹出，不存在 ABA 问题
+ * - 节点数超过两个上限时直接 delete，线程退出时释放本地链表，共享栈中的节点直到进程退出都不释放
+ */
+template <typename T>
+class NodeCache {
+  public:
+    static const size_t kLocalLimit = 256;
+    static const size_t kSharedLimit = 4096;
+
+    // 没有空闲节点时返回 nullptr，由调用方 new
+    static T *get() {
+        Local &local = localCache();
+        if (local.head == nullptr) {
+            takeShared(&local);
+            if (local.head == nullptr) {
+                return nullptr;
+            }
+        }
+        T *node = local.head;
+        local.head = node->nextFree;
+        --local.size;
+        return node;
+    }
+
+    // 调用方先释放节点持有的资源(例如回调中的 shared_ptr)
+    static void put(T *node) {
+        Local &local = localCache();
+        if (local.size < kLocalLimit) {
+            node->nextFree = local.head;
+            local.head = node;
+            ++local.size;
+            return;
+        }
+        if (sharedCount().load(std::memory_order_relaxed) >= kSharedLimit) {
+            delete node;
+            return;
+        }
+        sharedCount().fetch_add(1, std::memory_order_relaxed);
+        std::atomic<T *> &shared = sharedHead();
+        T *head = shared.load(std::memory_order_relaxed);
+        do {
+            node->nextFree = head;
+        } while (!shared.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+  private:
+    struct Local {
+        Local() : head(nullptr), size(0) {}
+        ~Local() {
+            while (head != nullptr) {
+                T *next = head->nextFree;
+                delete head;
+                head = next;
+            }
+        }
+
+        T *head;
+        size_t size;
+    };
+
+    static Local &localCache() {
+        static thread_local Local local;
+        return local;
+    }
+
+    static std::atomic<T *> &sharedHead() {
+        static std::atomic<T *> head(nullptr);
+        return head;
+    }
+
+    static std::atomic<size_t> &sharedCount() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+
+    static void takeShared(Local *local) {
+        std::atomic<T *> &shared = sharedHead();
+        if (shared.load(std::memory_order_relaxed) == nullptr) {
+            return;
+        }
+        T *list = shared.exchange(nullptr, std::memory_order_acquire);
+        size_t n = 0;
+        for (T *node = list; node != nullptr; node = node->nextFree) {
+            ++n;
+        }
+        sharedCount().fetch_sub(n, std::memory_order_relaxed);
+        local->head = list;
+        local->size = n;
+    }
+};
+
+template <typename T>
+const size_t NodeCache<T>::kLocalLimit;
+template <typename T>
+const size_t NodeCache<T>::kSharedLimit;
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <atomic>
+
+/**
+ * 只有一个线程写(通常是 loop 线程)、其他线程只读的统计计数
+ * load + store 代替 fetch_add，不需要带 lock 前缀的读改写指令；多个线程同时写时会丢失更新
+ */
+template <typename T, typename U>
+inline void relaxedAdd(std::atomic<T> &counter, U n) {
+    counter.store(counter.load(std::memory_order_relaxed) + static_cast<T>(n), std::memory_order_relaxed);
+}
+
+template <typename T, typename U>
+inline void relaxedSub(std::atomic<T> &counter, U n) {
+    counter.store(counter.load(std::memory_order_relaxed) - static_cast<T>(n), std::memory_order_relaxed);
+}
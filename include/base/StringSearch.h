@@ -0,0 +1,29 @@
+#pragma once
+
+/**
+ * 分隔符查找，协议解析的热点路径
+ *
+ * 所有函数在 [begin, end) 中查找，返回第一次出现的位置，找不到返回 NULL
+ * 实现在第一次调用时按 CPU 选择: x86 上优先 AVX2，其次 SSE2，其他平台使用基于 memchr 的标量实现
+ * findChar 在所有实现中都是 memchr，glibc 已经针对 CPU 做了向量化
+ */
+namespace StringSearch {
+
+enum Impl {
+    kScalar,
+    kSSE2,
+    kAVX2,
+};
+
+const char *findChar(const char *begin, const char *end, char c);
+const char *findCRLF(const char *begin, const char *end);      // "\r\n"
+const char *findCRLFCRLF(const char *begin, const char *end);  // "\r\n\r\n"，即 HTTP 头部的结尾
+
+Impl impl();
+const char *implName(Impl impl);
+bool supported(Impl impl);
+
+// 切换实现，用于 benchmark 对比；CPU 不支持时返回 false。不是线程安全的，只应在启动时调用
+bool setImpl(Impl impl);
+
+}  // namespace StringSearch
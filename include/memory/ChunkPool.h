@@ -0,0 +1,113 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+// ChunkPool 的使用统计，stats() 可以在任意线程调用
+struct ChunkPoolStats {
+    size_t reservedBytes;     // 所有 slab 占用的内存
+    size_t inUseBytes;        // 借给 Buffer 正在使用的内存(不含堆上的大块)
+    size_t heapBytes;         // 超过最大 size class，直接走 malloc 的内存
+    size_t slabs;             // 当前 slab 数
+    size_t hugepageSlabs;     // 其中由 MAP_HUGETLB 提供的 slab 数
+    uint64_t allocations;     // allocate 次数
+    uint64_t deallocations;   // deallocate 次数(含跨线程归还)
+    uint64_t remoteDeallocations;  // 其他线程归还的次数
+    uint64_t slabReleases;    // trim 释放的 slab 数
+};
+
+/**
+ * 每个 EventLoop 一个的内存池，给 Buffer 提供 2K ~ 64K 的定长内存块
+ *
+ * - 内存按 slab 向系统申请(默认 256K，开启 hugepage 后为 2M 并尝试 MAP_HUGETLB)，
+ *   每个 slab 只切分同一种 size class，空闲块用侵入式链表串起来
+ * - 只在所属 loop 线程中分配/归还，不需要加锁；其他线程归还的内存先挂到 remote 链表，
+ *   由 loop 线程下次分配时统一回收
+ * - loop 空闲时 trimIfIdle 把完全空闲的 slab 还给系统，只保留 retainBytes 的空闲内存
+ */
+class ChunkPool : noncopyable {
+  public:
+    static const size_t kMinBlockSize = 2 * 1024;
+    static const size_t kMaxBlockSize = 64 * 1024;
+    static const size_t kDefaultSlabSize = 256 * 1024;
+    static const size_t kHugepageSize = 2 * 1024 * 1024;
+    static const size_t kDefaultRetainBytes = 1024 * 1024;
+    static const int kTrimIntervalSeconds = 10;
+
+    ChunkPool();
+    ~ChunkPool();
+
+    // 申请至少 size 字节，*capacity 返回实际可用大小
+    char *allocate(size_t size, size_t *capacity);
+    // 归还 allocate 得到的内存，capacity 必须是 allocate 返回的大小，可以在任意线程调用
+    void deallocate(char *ptr, size_t capacity);
+
+    // 只有所属线程可以从池中分配，其他线程应该直接使用堆内存
+    bool isOwnerThread() const;
+
+    // 只影响之后新申请的 slab
+    void setHugepage(bool on) { hugepage_ = on; }
+    bool hugepage() const { return hugepage_; }
+
+    void setRetainBytes(size_t bytes) { retainBytes_ = bytes; }
+
+    // 释放完全空闲的 slab，直到空闲内存不超过 retainBytes，返回释放的字节数
+    size_t trim(size_t retainBytes);
+    // 距离上次检查没有新的分配时才 trim，由 EventLoop 定时调用
+    void trimIfIdle();
+
+    ChunkPoolStats stats() const;
+
+  private:
+    struct FreeNode {
+        FreeNode *next;
+    };
+
+    struct Slab {
+        char *base;
+        size_t size;
+        int sizeClass;
+        bool huge;
+    };
+
+    static const int kNumClasses = 6;  // 2K 4K 8K 16K 32K 64K
+
+    static int sizeClassOf(size_t size);
+    static size_t classSize(int sizeClass) { return kMinBlockSize << sizeClass; }
+
+    void refill(int sizeClass);  // 给 sizeClass 申请一个新的 slab
+    void push(int sizeClass, char *ptr);
+    void drainRemoteFrees();
+
+    const pid_t ownerTid_;
+    bool hugepage_;
+    size_t retainBytes_;
+
+    FreeNode *freeLists_[kNumClasses];
+    size_t freeBytes_;
+    std::vector<Slab> slabs_;
+    size_t lastAllocations_;  // 上一次 trimIfIdle 时的 allocations_
+
+    // 其他线程归还的内存
+    std::mutex remoteMutex_;
+    std::vector<std::pair<char *, size_t>> remoteFrees_;
+    std::atomic_bool hasRemoteFrees_;
+
+    // 除 heapBytes_、deallocations_、remoteDeallocations_ 外只有 owner 线程写(relaxedAdd)，其他线程通过 stats() 读
+    std::atomic<size_t> reservedBytes_;
+    std::atomic<size_t> inUseBytes_;
+    std::atomic<size_t> heapBytes_;
+    std::atomic<size_t> numSlabs_;
+    std::atomic<size_t> numHugepageSlabs_;
+    std::atomic<size_t> allocations_;
+    std::atomic<size_t> deallocations_;
+    std::atomic<size_t> remoteDeallocations_;
+    std::atomic<size_t> slabReleases_;
+};
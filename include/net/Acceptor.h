@@ -6,6 +6,7 @@
 
 class EventLoop;
 class InetAddress;
+class IoUringPoller;
 
 class Acceptor : noncopyable {
   public:
@@ -21,6 +22,8 @@ class Acceptor : noncopyable {
 
   private:
     void handleRead();
+    void handleAccept(Completion &completion);  // 完成模式下 multishot accept 的结果
+    bool discardPending();  // fd 用完时借用预留的 fd accept 一个排队的连接并关闭，没有可以丢弃的连接时返回 false
 
     EventLoop *loop_;
     Socket acceptSocket_;
@@ -29,4 +32,6 @@ class Acceptor : noncopyable {
     // 将 accept 到的 connfd 绑定到 channel 上并注册事件，由上层 TcpServer 设置回调
     NewConnectionCallback newConnectionCallback_;
     bool listening_;
+    IoUringPoller *uring_;  // 完成模式时非空
+    int idleFd_;            // 预留的 fd(/dev/null)，fd 用完(EMFILE/ENFILE)时关掉腾出位置
 };
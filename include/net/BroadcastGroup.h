@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Callbacks.h"
+#include "noncopyable.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 一组连接的广播，比如 pub/sub 的一个频道
+ *
+ * 成员按所属 EventLoop 分片，每个分片的成员表只在自己的 loop 线程中访问；
+ * broadcast 给每个 loop 只投递一个任务，由它把同一个 PayloadPtr 交给本 loop 的所有连接，
+ * 发送队列只增加引用计数，不会按连接数拷贝消息
+ *
+ * 所有接口都可以在任意线程调用。组内只保存 weak_ptr，连接断开后不 remove 也会在下次广播时清理
+ */
+class BroadcastGroup : noncopyable {
+  public:
+    BroadcastGroup();
+    ~BroadcastGroup();
+
+    void add(const TcpConnectionPtr &conn);
+    void remove(const TcpConnectionPtr &conn);
+
+    void broadcast(const PayloadPtr &payload);
+    void broadcast(std::string &&message) { broadcast(std::make_shared<const Payload>(std::move(message))); }
+
+  private:
+    struct Shard {
+        explicit Shard(EventLoop *l) : loop(l) {}
+
+        EventLoop *loop;
+        // 只在 loop 线程中访问
+        std::unordered_map<TcpConnection *, std::weak_ptr<TcpConnection>> members;
+    };
+    using ShardPtr = std::shared_ptr<Shard>;
+
+    ShardPtr getShard(EventLoop *loop);
+
+    static void sendToShard(const ShardPtr &shard, const PayloadPtr &payload);
+
+    std::mutex mutex_;
+    std::unordered_map<EventLoop *, ShardPtr> shards_;
+};
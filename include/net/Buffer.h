@@ -1,9 +1,18 @@
 #pragma once
 
+#include "StringSearch.h"
+
 #include <algorithm>
+#include <deque>
+#include <endian.h>
+#include <memory>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
+class ChunkPool;
+struct iovec;
+
 /// A buffer class modeled after org.jboss.netty.buffer.ChannelBuffer
 ///
 /// @code
@@ -14,40 +23,127 @@
 /// |                   |                  |                  |
 /// 0      <=      readerIndex   <=   writerIndex    <=     size
 /// @endcode
+///
+/// 分段模式 (kSegmented) 下底层是一串固定大小的 chunk，每个 chunk 自带读写游标:
+/// @code
+/// [prepend | readable | free] -> [prepend | readable ...] -> ... -> [prepend | readable | writable]
+///            ^ peek()                                                                  ^ beginWrite()
+/// @endcode
+/// append/readFd 只在尾部追加 chunk，retrieve 只释放头部 chunk，数据从不搬移也不 realloc
+///
+/// 两种模式的内存都可以来自所属 EventLoop 的 ChunkPool，没有设置 pool 时使用堆内存
 
 // 网络库底层地缓冲器类型定义
 class Buffer {
   public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
+    static const size_t kChunkSize = 4096;  // 分段模式下单个 chunk 的大小(含 kCheapPrepend)
+    static const size_t kExtraBufSize = 65536;  // readFd 每个线程共享的溢出区大小
+    static const size_t kMinReadHint = 512;     // 自适应读的预留空间下限
+    static const size_t kMaxReadHint = 65536;   // 自适应读的预留空间上限
+    static const size_t kMaxRetainSize = 2 * kMaxReadHint;  // 连续存储超过这个大小时 retrieveAll 直接归还
+
+    enum Mode {
+        kContiguous,  // 单块 vector，空间不足时 resize 或搬移
+        kSegmented,   // chunk 链，空间不足时追加新 chunk
+    };
+
+    // 第一次写入时才分配，连续模式至少分配 initialSize
+    explicit Buffer(size_t initialSize = kInitialSize, Mode mode = kContiguous)
+        : pool_()
+        , mode_(mode)
+        , initialSize_(initialSize)
+        , buffer_(0, nullptr)
+        , readerIndex_(kCheapPrepend)
+        , writerIndex_(kCheapPrepend)
+        , readable_(0)
+        , adaptiveRead_(false)
+        , readSizeHint_(kInitialSize)
+        , smallReads_(0)
+        , lastReadFilled_(false) {}
 
-    explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize), readerIndex_(kCheapPrepend), writerIndex_(kCheapPrepend) {}
+    // 内存从 pool 中申请，第一次写入时才分配
+    explicit Buffer(const std::shared_ptr<ChunkPool> &pool, Mode mode = kContiguous)
+        : pool_(pool)
+        , mode_(mode)
+        , initialSize_(kInitialSize)
+        , buffer_(0, nullptr)
+        , readerIndex_(kCheapPrepend)
+        , writerIndex_(kCheapPrepend)
+        , readable_(0)
+        , adaptiveRead_(false)
+        , readSizeHint_(kInitialSize)
+        , smallReads_(0)
+        , lastReadFilled_(false) {}
 
     ~Buffer();
 
+    // 移动之后 rhs 为空，可以继续使用(使用堆内存)
+    Buffer(Buffer &&rhs);
+    Buffer &operator=(Buffer &&rhs);
+
+    Mode mode() const { return mode_; }
+
+    // 切换存储模式，只能在缓冲区为空时调用，旧模式的存储会被释放
+    void setMode(Mode mode);
+
+    // 更换内存来源，只能在缓冲区为空时调用，已有的存储会先归还
+    void setPool(const std::shared_ptr<ChunkPool> &pool);
+    const std::shared_ptr<ChunkPool> &pool() const { return pool_; }
+
     /**
      * kCheapPrepend | reader | writer |
      * writerIndex_ - readerIndex_
      */
-    size_t readableBytes() const { return writerIndex_ - readerIndex_; }
+    size_t readableBytes() const { return mode_ == kContiguous ? writerIndex_ - readerIndex_ : readable_; }
 
     /**
      * kCheapPrepend | reader | writer |
-     * buffer_.size() - writerIndex_
+     * buffer_.capacity - writerIndex_
+     * 分段模式下是尾部 chunk 中从 beginWrite() 开始的连续可写空间
      */
-    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    size_t writableBytes() const {
+        if (mode_ == kContiguous) {
+            return buffer_.data == nullptr ? 0 : buffer_.capacity - writerIndex_;  // 延迟分配时还没有存储
+        }
+        return chunks_.empty() ? 0 : chunks_.back().writable();
+    }
 
     /**
      * kCheapPrepend | reader | writer |
      * readerIndex_
      */
     size_t prependableBytes() const {  // 前面空闲的缓冲区
-        return readerIndex_;
+        if (mode_ == kContiguous) {
+            return readerIndex_;
+        }
+        return chunks_.empty() ? kCheapPrepend : chunks_.front().readIndex;
+    }
+
+    // 从 peek() 开始可以直接访问的连续字节数，连续模式下等于 readableBytes()
+    size_t contiguousBytes() const {
+        if (mode_ == kContiguous) {
+            return writerIndex_ - readerIndex_;
+        }
+        return chunks_.empty() ? 0 : chunks_.front().readable();
     }
 
     // 返回缓冲区中可读数据的起始地址
-    const char *peek() const { return begin() + readerIndex_; }
+    //!NOTE: 分段模式下只保证 [peek(), peek() + contiguousBytes()) 连续，解析器需要更长的视图时使用 pullup
+    const char *peek() const {
+        if (mode_ == kContiguous) {
+            return begin() + readerIndex_;
+        }
+        return chunks_.empty() ? kEmpty : chunks_.front().peek();
+    }
+
+    // 保证前 min(len, readableBytes()) 个字节在 peek() 处连续，返回 peek()
+    // 只拷贝这 len 个字节，之前取得的 peek() 指针会失效
+    const char *pullup(size_t len) const;
+
+    // 整个可读区域拉平成连续内存
+    const char *linearize() const { return pullup(readableBytes()); }
 
     void retrieveUntil(const char *end)
     {
@@ -57,23 +153,36 @@ class Buffer {
     //!NOTE: 相当于更新 readerIndex/writerIndex, onMessage string <-- Buffer
     void retrieve(size_t len) {
         if (len < readableBytes()) {
-            readerIndex_ += len;  // 读取一部分
+            if (mode_ == kContiguous) {
+                readerIndex_ += len;  // 读取一部分
+            } else {
+                retrieveSegmented(len);
+            }
         } else {
             retrieveAll();  // 读取全部
         }
     }
 
     // 全部读完，则直接将可读缓冲区指针移动到写缓冲区指针那
+    //!NOTE: 被突发数据撑大的连续存储在这里直接归还，不会一直占着
     void retrieveAll() {
-        readerIndex_ = kCheapPrepend;
-        writerIndex_ = kCheapPrepend;
+        if (mode_ == kContiguous) {
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = kCheapPrepend;
+            if (buffer_.capacity > kMaxRetainSize) {
+                buffer_.release();
+            }
+        } else {
+            retrieveAllSegmented();
+        }
     }
 
     // DEBUG使用，提取出 string 类型，但是不会置位
     std::string GetBufferAllAsString()
     {
         size_t len = readableBytes();
-        std::string result(peek(), len);
+        std::string result;
+        copyOut(&result, len);
         return result;
     }
 
@@ -83,11 +192,13 @@ class Buffer {
     }
 
     std::string retrieveAsString(size_t len) {
-        std::string res(peek(), len);
+        std::string res;
+        copyOut(&res, len);
         retrieve(len);  // 上一句把缓冲区可读的数据已经读取出来，这里需要复位缓冲区
         return res;
     }
 
+    // 保证 beginWrite() 开始至少有 len 字节的连续可写空间
     void ensureWritableBytes(size_t len) {
         if (writableBytes() < len) {
             makeSpace(len);
@@ -102,40 +213,259 @@ class Buffer {
 
     // 把 data 写入 writerIndex 开始的地址
     void append(const char *data, size_t len) {
+        if (mode_ == kSegmented) {
+            appendSegmented(data, len);
+            return;
+        }
         ensureWritableBytes(len);
         std::copy(data, data + len, beginWrite());
         writerIndex_ += len;  // 更新 writeIndex
     }
 
+    void append(const void *data, size_t len) { append(static_cast<const char *>(data), len); }
+
+    /* 整数读写，统一使用网络字节序 */
+
+    void appendInt64(int64_t x) {
+        int64_t be64 = htobe64(x);
+        append(&be64, sizeof be64);
+    }
+
+    void appendInt32(int32_t x) {
+        int32_t be32 = htobe32(x);
+        append(&be32, sizeof be32);
+    }
+
+    void appendInt16(int16_t x) {
+        int16_t be16 = htobe16(x);
+        append(&be16, sizeof be16);
+    }
+
+    void appendInt8(int8_t x) { append(&x, sizeof x); }
+
+    // 可读字节不够时返回 0，调用前应先检查 readableBytes()
+    int64_t peekInt64() const {
+        int64_t be64 = 0;
+        peekAt(0, &be64, sizeof be64);
+        return be64toh(be64);
+    }
+
+    int32_t peekInt32() const {
+        int32_t be32 = 0;
+        peekAt(0, &be32, sizeof be32);
+        return be32toh(be32);
+    }
+
+    int16_t peekInt16() const {
+        int16_t be16 = 0;
+        peekAt(0, &be16, sizeof be16);
+        return be16toh(be16);
+    }
+
+    int8_t peekInt8() const {
+        int8_t x = 0;
+        peekAt(0, &x, sizeof x);
+        return x;
+    }
+
+    int64_t readInt64() {
+        int64_t result = peekInt64();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int32_t readInt32() {
+        int32_t result = peekInt32();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int16_t readInt16() {
+        int16_t result = peekInt16();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int8_t readInt8() {
+        int8_t result = peekInt8();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    /**
+     * 把 data 放到可读数据之前，优先使用 peek() 前面的 prependable 空间(至少 kCheapPrepend 字节)，
+     * 比如先写消息体再补上长度头，不用为了拼接头部再拷贝一次消息体
+     */
+    void prepend(const void *data, size_t len);
+
+    void prependInt64(int64_t x) {
+        int64_t be64 = htobe64(x);
+        prepend(&be64, sizeof be64);
+    }
+
+    void prependInt32(int32_t x) {
+        int32_t be32 = htobe32(x);
+        prepend(&be32, sizeof be32);
+    }
+
+    void prependInt16(int16_t x) {
+        int16_t be16 = htobe16(x);
+        prepend(&be16, sizeof be16);
+    }
+
+    void prependInt8(int8_t x) { prepend(&x, sizeof x); }
+
+    // 把从 offset 开始的 len 个可读字节拷贝到 out，不移动读位置，可读字节不够时返回 false
+    //!NOTE: 分段模式下可以跨 chunk，不会触发 pullup
+    bool peekAt(size_t offset, void *out, size_t len) const;
+
+    // 直接往 beginWrite() 写入 len 字节之后更新写位置
+    void hasWritten(size_t len) {
+        if (mode_ == kContiguous) {
+            writerIndex_ += len;
+        } else {
+            chunks_.back().writeIndex += len;
+            readable_ += len;
+        }
+    }
+
     // 在 buffer 找到 "\r\n" 的位置并返回，如果没有就返回 NULL
+    //!NOTE: 分段模式下如果 "\r\n" 所在行跨越了 chunk，会先把这一行 pullup 到 peek() 处
     const char* findCRLF() const
     {
-        // FIXME: replace with memmem()?
-        const char* crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF+2);
-        return crlf == beginWrite() ? NULL : crlf;
+        if (mode_ == kSegmented) {
+            return findDelimiterSegmented(kCRLF, 2);
+        }
+        return StringSearch::findCRLF(peek(), beginWrite());
+    }
+
+    // 从 start 开始找 "\r\n"，start 必须在 [peek(), beginWrite()] 之内，只用于连续模式
+    const char* findCRLF(const char* start) const
+    {
+        return StringSearch::findCRLF(start, beginWrite());
+    }
+
+    /**
+     * 找到 HTTP 头部结尾 "\r\n\r\n" 的位置，没有就返回 NULL
+     * 解析器可以先一次扫描确认整个头部已经收全，再在 [peek(), 返回值 + 2) 里按行切分，不用每行都从 peek() 重新找
+     * 分段模式下找到时会把整个头部 pullup 成连续内存
+     */
+    const char* findHeaderEnd() const
+    {
+        if (mode_ == kSegmented) {
+            return findDelimiterSegmented(kCRLFCRLF, 4);
+        }
+        return StringSearch::findCRLFCRLF(peek(), beginWrite());
+    }
+
+    char *beginWrite() {
+        if (mode_ == kContiguous) {
+            return begin() + writerIndex_;
+        }
+        return chunks_.empty() ? nullptr : chunks_.back().beginWrite();
+    }
+
+    const char *beginWrite() const {
+        if (mode_ == kContiguous) {
+            return begin() + writerIndex_;
+        }
+        return chunks_.empty() ? nullptr : chunks_.back().beginWrite();
     }
 
-    char *beginWrite() { return begin() + writerIndex_; }
+    // 把从 offset 开始的 len 个可读字节描述成 iovec，最多 maxIovecs 个，返回实际填充的个数
+    int peekIovecs(size_t offset, size_t len, struct iovec *vec, int maxIovecs) const;
+
+    /**
+     * 自适应读: readFd 之前保证 Buffer 至少有 readSizeHint() 字节的可写空间，数据直接落在 Buffer 里，
+     * 不用再从溢出区拷贝；读满就把预留翻倍，连续两次读不到一半就减半，范围 [kMinReadHint, kMaxReadHint]
+     */
+    void setAdaptiveRead(bool on) { adaptiveRead_ = on; }
+    size_t readSizeHint() const { return readSizeHint_; }
+
+    // 上一次 readFd 是否填满了提供的全部空间，填满说明 socket 中很可能还有数据
+    bool lastReadFilled() const { return lastReadFilled_; }
+
+    /**
+     * 归还多余的存储: 为空时全部归还(包括分段模式预留的 chunk)，下次写入时重新申请；
+     * 不为空时把连续存储缩到可读数据 + reserve，分段模式只释放预留的 chunk
+     */
+    void shrink(size_t reserve = 0);
+
+    /**
+     * 接管一块从 pool 申请的内存，前 len 字节是数据，不拷贝，之后由 Buffer 按 capacity 归还给 pool
+     * 分段模式下追加成尾部 chunk；连续模式只在 Buffer 为空时替换底层存储；
+     * pool 不是 Buffer 的 pool 或者不能接管时返回 false，内存仍归调用者
+     */
+    bool adopt(char *data, size_t capacity, size_t len, ChunkPool *pool);
 
-    const char *beginWrite() const { return begin() + writerIndex_; }
+    // 当前占用的存储(字节)，包括已经申请但没有使用的空间
+    size_t footprint() const;
 
     ssize_t readFd(int fd, int *saveErrno);   // 从 fd 上读取数据
     ssize_t writeFd(int fd, int *saveErrno);  // 通过 fd 发送数据
 
   private:
-    char *begin() {
-        return &*buffer_.begin();  // vector 底层数组首元素的地址，也就是数组的起始地址
-    }
+    // 一块连续内存，所属线程中优先从 ChunkPool 申请，否则走堆
+    struct Block {
+        Block(size_t size, ChunkPool *pool);
+        Block(char *d, size_t cap, ChunkPool *p) : data(d), capacity(cap), pool(p) {}  // 接管已有的内存
+        Block(Block &&rhs) noexcept;
+        Block &operator=(Block &&rhs) noexcept;
+        ~Block() { release(); }
+
+        void release();
+
+        char *data;
+        size_t capacity;
+        ChunkPool *pool;  // 为空表示 data 是堆内存
+    };
 
-    const char *begin() const { return &*buffer_.begin(); }
+    // 分段模式下的一个内存块，[0, readIndex) prependable，[readIndex, writeIndex) readable
+    struct Chunk {
+        Chunk(size_t cap, ChunkPool *pool)
+            : block(cap, pool), readIndex(kCheapPrepend), writeIndex(kCheapPrepend) {}
+        Chunk(Block &&b, size_t len) : block(std::move(b)), readIndex(0), writeIndex(len) {}
+
+        size_t readable() const { return writeIndex - readIndex; }
+        size_t writable() const { return block.capacity - writeIndex; }
+        const char *peek() const { return block.data + readIndex; }
+        char *beginWrite() const { return block.data + writeIndex; }
+
+        Block block;
+        size_t readIndex;
+        size_t writeIndex;
+    };
+
+    //!NOTE: 还没有分配内存时指向 emptyStorage_，保证 peek()/beginWrite() 始终是合法指针
+    char *begin() { return buffer_.data != nullptr ? buffer_.data : emptyStorage_; }
+
+    const char *begin() const { return buffer_.data != nullptr ? buffer_.data : emptyStorage_; }
 
     void makeSpace(size_t len) {
+        if (mode_ == kSegmented) {
+            // 尾部 chunk 不够就直接追加一个新 chunk，已有数据不动
+            if (!chunks_.empty() && chunks_.back().readable() == 0) {
+                chunks_.pop_back();
+            }
+            chunks_.emplace_back(std::max(kChunkSize, len + kCheapPrepend), pool_.get());
+            return;
+        }
         /**
          *  kCheapPrepend | reader | writer |
          *  kCheapPrepend   |        len       |
          */
         if (writableBytes() + prependableBytes() < len + kCheapPrepend) { // 整个 buffer 不够用
-            buffer_.resize(writerIndex_ + len);
+            // 换一块更大的内存，只搬移可读部分
+            size_t readable = readableBytes();
+            size_t size = std::max(buffer_.capacity * 2, kCheapPrepend + readable + len);
+            if (buffer_.data == nullptr) {
+                size = std::max(size, kCheapPrepend + initialSize_);  // 延迟分配的第一块
+            }
+            Block block(size, pool_.get());
+            std::copy(begin() + readerIndex_, begin() + writerIndex_, block.data + kCheapPrepend);
+            buffer_ = std::move(block);
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = readerIndex_ + readable;
         } else { // 整个 buffer 够用，将后面移动到前面继续分配
             size_t readable = readableBytes();
             // 把已读的部分挪至前面
@@ -147,10 +477,43 @@ class Buffer {
         }
     }
 
+    // 把前 len 个可读字节追加到 out，不移动读位置
+    void copyOut(std::string *out, size_t len) const;
+
+    void appendSegmented(const char *data, size_t len);
+    void retrieveSegmented(size_t len);
+    void retrieveAllSegmented();
+    const char *findDelimiterSegmented(const char *delim, size_t len) const;
+    bool matchAt(size_t chunk, size_t offset, const char *delim, size_t len) const;
+    ssize_t readFdSegmented(int fd, int *saveErrno);
+    void adjustReadHint(size_t n);
+    ssize_t writeFdSegmented(int fd, int *saveErrno);
+
   private:
-    std::vector<char> buffer_;
+    //!NOTE: 必须声明在所有存储之前，保证析构时 pool 比 Block 活得久
+    std::shared_ptr<ChunkPool> pool_;  // 为空时使用堆内存
+
+    Mode mode_;
+    size_t initialSize_;  // 连续模式第一次分配的最小可写空间
+
+    // 连续模式
+    Block buffer_;
     size_t readerIndex_;
     size_t writerIndex_;
 
+    //!NOTE: 分段模式，pullup 不改变可读内容，所以允许在 const 方法中整理 chunk
+    mutable std::deque<Chunk> chunks_;
+    size_t readable_;         // 所有 chunk 中可读字节总数
+    std::unique_ptr<Chunk> spare_;  // readFd 预留的空闲 chunk，没读满时留给下一次使用
+
+    // 自适应读
+    bool adaptiveRead_;
+    size_t readSizeHint_;
+    int smallReads_;  // 连续读不到 readSizeHint_ 一半的次数
+    bool lastReadFilled_;
+
     static const char kCRLF[]; // "\r\n"
+    static const char kCRLFCRLF[]; // "\r\n\r\n"
+    static const char kEmpty[1];
+    static char emptyStorage_[kCheapPrepend];
 };
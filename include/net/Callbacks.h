@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 
 class Buffer;
 class TcpConnection;
@@ -9,6 +10,10 @@ class Timestamp;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 
+// 不可变的共享消息体，广播时所有连接的发送队列引用同一份数据
+using Payload = std::string;
+using PayloadPtr = std::shared_ptr<const Payload>;
+
 using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
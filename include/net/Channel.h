@@ -1,13 +1,27 @@
 #pragma once
 
+#include "InlineFunction.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
 
 #include <functional>
 #include <memory>
+#include <stddef.h>
 
 class EventLoop;  // 前置声明
 
+// 完成模式(io_uring，见 EventLoop::setCompletionMode)下一个请求的结果，由 IoUringPoller 交给 Channel
+struct Completion {
+    enum Op { kRecv, kSend, kAccept };
+
+    Op op;
+    int result;       // 和对应系统调用的返回值相同，出错时为 -errno
+    bool more;        // multishot 请求之后还会有结果
+    char *data;       // kRecv: 收到的数据，在 loop 的 buffer ring 中，没有数据时为空
+    size_t capacity;  // data 所在内存块的大小，来自 loop 的 ChunkPool
+    bool taken;       // kRecv: 回调接管了 data(之后按 capacity 归还给 ChunkPool)时置为 true，否则内存回到 buffer ring
+};
+
 /**
  * 理清楚 EventLoop、Channel、Poller 之间的关系，在 Reator 模型上对应 Demultiplex
  * Channel 理解为通道，封装了 sockfd 和其感兴趣的 event，
@@ -15,8 +29,9 @@ class EventLoop;  // 前置声明
  */
 class Channel : noncopyable {
   public:
-    using EventCallback = std::function<void()>;
-    using ReadEventCallback = std::function<void(Timestamp)>;
+    using EventCallback = InlineFunction<void()>;
+    using ReadEventCallback = InlineFunction<void(Timestamp)>;
+    using CompletionCallback = InlineFunction<void(Completion &)>;
 
     Channel(EventLoop *loop, int fd);
     ~Channel();
@@ -29,12 +44,17 @@ class Channel : noncopyable {
     void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
     void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
     void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+    void setCompletionCallback(CompletionCallback cb) { completionCallback_ = std::move(cb); }
+
+    // 完成模式下 IoUringPoller 交来的请求结果，和 handleEvent 一样受 tie 保护
+    void handleCompletion(Completion &completion);
 
     //!NOTE: 多线程中防止当 channel 被手动 remove 掉，channel 还在执行回调操作
     void tie(const std::shared_ptr<void> &);
 
     int fd() const { return fd_; }
     int events() const { return events_; }
+    int revents() const { return revents_; }
     void set_revents(int revt) { revents_ = revt; }
 
     // 设置 channel.fd 读事件
@@ -68,14 +88,21 @@ class Channel : noncopyable {
         update();
     }
 
+    /**
+     * 边缘触发(EPOLLET)模式，可以在注册前后切换
+     * - 读写事件(有写回调时)和 EPOLLRDHUP 只注册一次，enable/disable 读写只修改 events_，不再 epoll_ctl
+     * - 不关注的事件到达时直接忽略，调用者需要自己补上暂停期间错过的事件；回调必须处理到 EAGAIN
+     */
+    void setEdgeTriggered(bool on);
+    bool edgeTriggered() const { return edgeTriggered_; }
+
+    // 注册给 poller 的事件，水平触发时就是 events_
+    int pollEvents() const;
+
     // 返回 fd 当前的事件状态
     bool isNoneEvent() const { return events_ == kNoneEvent; }
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isReading() const { return events_ & kReadEvent; }
-  
-    // 返回 channel 状态
-    int index() { return index_; }
-    void set_index(int idx) { index_ = idx; }
 
     // one loop per thread
     EventLoop *ownerLoop() { return loop_; }
@@ -91,14 +118,15 @@ class Channel : noncopyable {
     static const int kNoneEvent;
     static const int kReadEvent;
     static const int kWriteEvent;
+    static const int kEdgeEvents;
 
     EventLoop *loop_;  // 事件循环
 
     const int fd_;  // fd，Poller 监听的对象
     int events_;    // 注册 fd 感兴趣的事件
     int revents_;   // poller 返回的具体发生的事件
-
-    int index_;  // channel 状态，被 Poller 调用
+    int registeredEvents_;  // 最近一次交给 poller 的 pollEvents()
+    bool edgeTriggered_;
 
     std::weak_ptr<void> tie_;
     bool tied_;
@@ -108,4 +136,5 @@ class Channel : noncopyable {
     EventCallback writeCallback_;
     EventCallback closeCallback_;
     EventCallback errorCallback_;
+    CompletionCallback completionCallback_;
 };
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "InetAddress.h"
+#include "noncopyable.h"
+
+#include <functional>
+#include <memory>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 一次性的非阻塞 connect，TcpRelay 用它连接后端
+ *
+ * start() 之后 Connector 自己保持存活，直到连接成功(newConnectionCallback 拿到 sockfd 的所有权)
+ * 或者失败(errorCallback 拿到 errno)，不做重试
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector> {
+  public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+    using ErrorCallback = std::function<void(int err)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    void setErrorCallback(const ErrorCallback &cb) { errorCallback_ = cb; }
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+    void start();  // 可以在任意线程调用
+
+  private:
+    void startInLoop();
+    void handleWrite();
+    void handleError();
+    void finish(int sockfd, int err);  // 回调并释放自己，sockfd < 0 表示失败
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::unique_ptr<Channel> channel_;
+    std::shared_ptr<Connector> self_;  // connect 完成之前保持存活
+
+    NewConnectionCallback newConnectionCallback_;
+    ErrorCallback errorCallback_;
+};
@@ -17,21 +17,27 @@ class EPollPoller : public Poller {
 
     // 重写基类 Poller 的抽象方法
     Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
-    void updateChannel(Channel *channel) override;
-    void updateChannel(Channel *channel, const std::string &buf) override; // DEBUG 使用
-    void removeChannel(Channel *channel) override;
+    Timestamp pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels) override;  // epoll_pwait2，内核不支持时退回毫秒
+    const char *name() const override { return "epoll"; }
 
   private:
     static const int kInitEventListSize = 16;
 
+    // 处理 epoll_wait/epoll_pwait2 的返回值
+    Timestamp handleEvents(int numEvents, int savedErrno, ChannelList *activeChannels);
+
     // 填写活跃的连接
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
 
-    // 更新 channel 通道
-    void update(int operation, Channel *channel);
+    void commit(ChannelSlot *s) override;
+    void unregister(ChannelSlot *s) override;
+
+    // 更新 channel 通道，并记录注册到内核的事件
+    void update(int operation, Channel *channel, ChannelSlot *s);
 
     using EventList = std::vector<epoll_event>;
 
     int epollfd_;
     EventList events_;
+    bool hasPwait2_;  // 第一次 epoll_pwait2 返回 ENOSYS 之后不再尝试
 };
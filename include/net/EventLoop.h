@@ -1,23 +1,39 @@
 #pragma once
 
 #include "CurrentThread.h"
+#include "InlineFunction.h"
+#include "LoopStats.h"
+#include "MpscQueue.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
+#include "OutputBudget.h"
+#include "ReadStats.h"
 #include "TimerQueue.h"
 
 #include <atomic>
 #include <functional>
 #include <memory>
-#include <mutex>
 #include <vector>
 
 class Channel;  // 前置声明
 class Poller;
+class ChunkPool;
+class IoUringPoller;
+
+// 低延迟 loop 的忙等选项，默认全部关闭
+struct BusyPollOptions {
+    BusyPollOptions() : spinMicroseconds(0), socketBusyPollMicroseconds(0), preferBusyPoll(false) {}
+
+    int64_t spinMicroseconds;         // 阻塞在 poll 之前先用 0 超时轮询的时长，期间有事件或回调就不再睡眠
+    int socketBusyPollMicroseconds;   // 本 loop 上新连接的 SO_BUSY_POLL，0 不设置
+    bool preferBusyPoll;              // 同时设置 SO_PREFER_BUSY_POLL
+};
 
 /* 事件循环类，主要包含两大模块 Channel + Poller（epoll 的抽象） */
 class EventLoop : noncopyable {
   public:
-    using Functor = std::function<void()>;
+    //!NOTE: 回调对象放在内部存储中，bind 一个 shared_ptr 加几个参数时不申请堆内存
+    using Functor = InlineFunction<void()>;
 
     EventLoop();
     ~EventLoop();
@@ -30,17 +46,57 @@ class EventLoop : noncopyable {
     void runInLoop(Functor cb);    // 在当前 loop 中执行 cb
     void queueInLoop(Functor cb);  // 把 cb 放入队列中，唤醒 loop 所在的线程，执行 cb
 
-    void wakeup();  // 用来唤醒 loop 所在的线程
+    void wakeup();  // 用来唤醒 loop 所在的线程，loop 没有阻塞在 poll 中或者已经被唤醒时不写 eventfd
+
+    // 唤醒统计，可以在任意线程调用
+    struct WakeupStats {
+        uint64_t wakeups;     // 实际写 eventfd 的次数
+        uint64_t suppressed;  // loop 没有睡眠或者已经有唤醒在途，省掉的写 eventfd 次数
+    };
+    WakeupStats wakeupStats() const;
+
+    /**
+     * 忙等模式，可以在任意线程调用，通常在 EventLoopThreadPool 的 ThreadInitCallback 中按 loop 设置
+     * 被唤醒的延迟(调度 + eventfd)主导 p99 时，用 CPU 换延迟：没有事件时先轮询 spinMicroseconds 再阻塞
+     */
+    void setBusyPoll(const BusyPollOptions &options);
+    const BusyPollOptions &busyPollOptions() const { return busyPoll_; }  // loop 线程中读取
+
+    // 忙等统计，可以在任意线程调用
+    struct BusyPollStats {
+        uint64_t spinHits;  // 轮询期间等到了事件或回调，没有睡眠
+        uint64_t blocks;    // 轮询超时之后阻塞在 poll 中
+        uint64_t spins;     // 0 超时 poll 的总次数
+    };
+    BusyPollStats busyPollStats() const;
 
     // EventLoop 调用 Poller 方法，实际上是 channel 想要调用
     void updateChannel(Channel *channel);
     void updateChannel(Channel *channel, const std::string &type); // DEBUG 使用，查看 Channel 具体信息
     void removeChannel(Channel *channel);
-    void hasChannel(Channel *channel);
+    bool hasChannel(Channel *channel);
 
     // 判断 EventLoop 对象是否在自己的线程里面
     bool isInLoopThread() { return threadId_ == CurrentThread::tid(); }
 
+    // 本 loop 上所有 TcpConnection 的 Buffer 共用的内存池
+    const std::shared_ptr<ChunkPool> &chunkPool() const { return chunkPool_; }
+
+    // 本 loop 上所有连接的读统计
+    ReadStats &readStats() { return readStats_; }
+    const ReadStats &readStats() const { return readStats_; }
+
+    /**
+     * 本 loop 每轮循环的耗时分布(poll、事件处理、回调队列、定时器)和系统调用次数，见 LoopStats
+     * loopStats() 只在 loop 线程中记录；loopStatsSnapshot() 可以在任意线程调用，多个 loop 的汇总见 EventLoopThreadPool::loopStats
+     */
+    LoopStats &loopStats() { return loopStats_; }
+    LoopStats::Snapshot loopStatsSnapshot() const;
+
+    // 本 loop 上所有连接发送队列的内存预算，只在 loop 线程中访问(snapshot 除外)
+    OutputBudget &outputBudget() { return outputBudget_; }
+    const OutputBudget &outputBudget() const { return outputBudget_; }
+
     /**
      * 定时器相关
      *  在 timestamp 时执行 cb
@@ -61,9 +117,56 @@ class EventLoop : noncopyable {
         timerQueue_->addTimer(std::move(cb), timestamp, interval);
     }
 
+    /**
+     * 定时器驱动方式，可以在任意线程调用
+     * - TimerQueue::kTimerfd: 默认，定时器通过 timerfd 唤醒 loop
+     * - TimerQueue::kPollTimeout: poll 超时取最早到期时间(epoll_pwait2 微秒精度)，poll 返回后处理完 IO 事件再执行到期定时器，
+     *   到期不需要 timerfd 的 epoll 事件、read 和 timerfd_settime
+     */
+    void setTimerMode(TimerQueue::Mode mode);
+
+    /**
+     * 边缘触发模式，可以在任意线程调用，对之后建立的连接和 listen 的 Acceptor 生效，wakeup/timerfd 立即切换
+     * 连接的读写事件只注册一次(EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)，开关写事件不再 epoll_ctl；
+     * poll Poller 没有边缘触发，打印日志并保持水平触发
+     */
+    void setEdgeTriggered(bool on);
+    bool edgeTriggered() const { return edgeTriggered_; }  // loop 线程中读取
+
+    /**
+     * 延迟提交 epoll_ctl，可以在任意线程调用
+     * Channel 的 enable/disable 只记录在 Poller 中，每轮 poll 之前每个 fd 最多提交一次，同一轮里的开了又关互相抵消
+     */
+    void setDeferredUpdates(bool on);
+
+    // 注册变化统计，可以在任意线程调用
+    struct UpdateStats {
+        uint64_t requests;  // Channel 注册变化(update/remove)的次数
+        uint64_t syscalls;  // 实际调用 epoll_ctl 的次数
+        uint64_t elided;    // 省掉的次数: 事件没有变化、同一轮里被抵消、还没提交就 remove
+    };
+    UpdateStats updateStats() const;
+
+    /**
+     * 完成模式，可以在任意线程调用，对之后建立的连接和 listen 的 Acceptor 生效；需要 io_uring Poller 和 6.0 以上的内核，
+     * 不满足时打印日志并保持就绪模式。连接不再等就绪之后 read/write: multishot recv 把数据收进 loop 的 buffer ring，
+     * 发送队列用链接的 IORING_OP_SEND 提交，Acceptor 使用 multishot accept，见 IoUringPoller
+     */
+    void setCompletionMode(bool on);
+    IoUringPoller *completionPoller() const { return completionPoller_; }  // 完成模式关闭时为空，loop 线程中读取
+
+    // 本 loop 使用的 IO 复用实现: "epoll"、"io_uring"、"poll"，见 Poller::setDefaultBackend
+    const char *pollerName() const;
+
   private:
     void handleRead();         // 处理 wakeup
     void doPendingFunctors();  // 执行回调
+    void handleActiveChannels(int64_t pollStart);  // 分发 activateChannels_，记录 poll 和每个事件的时间
+    bool spinPoll();           // 忙等轮询，等到事件或回调时返回 true
+
+    void setBusyPollInLoop(const BusyPollOptions &options) { busyPoll_ = options; }
+    void setEdgeTriggeredInLoop(bool on);
+    void setCompletionModeInLoop(bool on);
 
     using ChannelList = std::vector<Channel *>;
 
@@ -74,16 +177,50 @@ class EventLoop : noncopyable {
     Timestamp pollReturnTime_;  // poller 返回发生事件的 channels 的时间点
     std::unique_ptr<Poller> poller_;
     std::unique_ptr<TimerQueue> timerQueue_;
+    std::shared_ptr<ChunkPool> chunkPool_;  // Buffer 也持有，连接晚于 loop 析构时仍然有效
+    ReadStats readStats_;
+    OutputBudget outputBudget_;
+    LoopStats loopStats_;
 
     //!NOTE: 理解 eventfd()
     //!NOTE: 主要作用，当 mainLoop 获取一个新用户的 channel，通过轮询算法选择一个 subloop，通过该成员唤醒subloop 处理 channel
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_;
 
+    /**
+     * 唤醒合并: loop 在 poll 之前置 sleeping_ 再检查队列，投递方先入队再检查 sleeping_，
+     * 两边都是 seq_cst，至少有一方能看到对方，不会丢失唤醒；
+     * wakeupPending_ 保证一次睡眠只写一次 eventfd。放在单独的 cache line，不和消费者状态互相干扰
+     */
+    alignas(64) std::atomic_bool sleeping_;   // loop 正在(或者即将)阻塞在 poll 中
+    std::atomic_bool wakeupPending_;          // 本次睡眠已经写过 eventfd
+    std::atomic<uint64_t> wakeups_;
+    std::atomic<uint64_t> suppressedWakeups_;
+
+    BusyPollOptions busyPoll_;
+    bool edgeTriggered_;
+    IoUringPoller *completionPoller_;
+    std::atomic<uint64_t> spinHits_;
+    std::atomic<uint64_t> spinBlocks_;
+    std::atomic<uint64_t> spinPolls_;
+
     ChannelList activateChannels_;
     // Channel *currentActivateChannels_; // assert
 
+    // 其他线程投递的回调，每个回调一个节点，由 loop 线程执行之后释放
+    struct PendingFunctor : MpscQueueNode {
+        explicit PendingFunctor(Functor &&cb) : functor(std::move(cb)), nextFree(nullptr) {}
+
+        Functor functor;
+        PendingFunctor *nextFree;  // 在 NodeCache 的空闲链表中时的链接
+    };
+
+    //!NOTE: 执行完的节点放回 NodeCache，loop 线程自己投递的回调(写完成、定时器、连接关闭等)直接复用；
+    // 其他线程投递的节点经过 NodeCache 的共享栈回到投递线程，稳定状态下跨线程投递也不申请内存
+    static PendingFunctor *newPendingFunctor(Functor &&cb);
+    static void recyclePendingFunctor(PendingFunctor *task);
+
     std::atomic_bool callingPendingFunctors_;  // 表示当前 loop 是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_;     // 存储 loop 需要执行的所有回调操作
-    std::mutex mutex_;                         // 互斥锁，用来保护上面 vector 容器的线程安全操作
+    //!NOTE: 无锁的多生产者单消费者队列，投递回调不再争抢互斥锁
+    MpscQueue<PendingFunctor> pendingFunctors_;  // 存储 loop 需要执行的所有回调操作
 };
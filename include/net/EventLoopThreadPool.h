@@ -1,5 +1,6 @@
 #pragma once
 
+#include "LoopStats.h"
 #include "noncopyable.h"
 
 #include <functional>
@@ -26,6 +27,9 @@ class EventLoopThreadPool {
 
     std::vector<EventLoop *> getAllLoops();
 
+    // getAllLoops() 中所有 loop 的 LoopStats 汇总，可以在任意线程调用(start 之后)
+    LoopStats::Snapshot loopStats();
+
     bool started() const { return started_; }
     const std::string name() const { return name_; }
 
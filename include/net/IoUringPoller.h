@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Channel.h"
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+struct iovec;
+class ChunkPool;
+
+/**
+ * io_uring 的 IORING_OP_POLL_ADD 实现的 Poller，不依赖 liburing，直接使用 io_uring_setup/io_uring_enter
+ *
+ * - updateChannel/removeChannel 只往提交队列中写 POLL_ADD/POLL_REMOVE，不进入内核；
+ *   poll() 中一次 io_uring_enter 提交所有变化并等待完成事件，代替 epoll_ctl + epoll_wait
+ * - 边缘触发的 channel(pollEvents 带 EPOLLET)使用 multishot poll，一次注册持续产生事件，和 EPOLLET 一样只在状态变化时通知
+ * - 水平触发的 channel 使用 one-shot poll，每次完成之后在下一轮 flushUpdates 中重新提交，
+ *   提交时已经就绪会立即完成，所以和 epoll 的水平触发一样，没处理完的事件下一轮还会报告
+ * - 每次提交 POLL_ADD 分配一个新的序号，和 fd 一起放在 user_data 中，取消或者修改之后旧请求的完成事件按序号丢弃
+ *
+ * 完成模式(enableCompletions 之后，见 EventLoop::setCompletionMode)，channel 可以直接提交 IO 请求，结果交给 Channel::handleCompletion:
+ * - startRecv: multishot recv，数据由内核直接写进本 loop 的 provided buffer ring(kRecvBuffers 个 kRecvBufferSize 的 ChunkPool 内存块)，
+ *   回调可以接管内存块(Completion::taken)，空出来的位置从 ChunkPool 补上；buffer ring 用完时内核终止 recv，归还内存块之后自动重新提交
+ * - startAccept: multishot accept，每个新连接一个结果
+ * - send: 每段数据一个 IORING_OP_SEND，用 IOSQE_IO_LINK 串成一条链按顺序发送，一段出错之后的都以 -ECANCELED 结束
+ * - 这一轮收割到的结果通过内部的 channel 放进 activeChannels，和就绪事件一起在 EventLoop::loop 中分发
+ */
+class IoUringPoller : public Poller {
+  public:
+    // 内核不支持(io_uring_setup 失败、被禁用或者版本低于 5.13，没有 multishot poll)时返回 nullptr
+    static IoUringPoller *create(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    Timestamp pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels) override;  // 用 IORING_ENTER_EXT_ARG 的超时，纳秒精度
+    void removeChannel(Channel *channel) override;  // 之后还要取消完成模式的请求并立即提交
+    const char *name() const override { return "io_uring"; }
+
+    static const unsigned kRecvBuffers = 128;            // buffer ring 的内存块个数，2 的幂
+    static const size_t kRecvBufferSize = 16 * 1024;
+    static const int kMaxLinkedSends = 16;               // send 一条链最多的 IORING_OP_SEND 个数
+
+    // 注册 buffer ring，内核低于 6.0(没有 multishot recv)时返回 false，只能在 loop 线程中调用
+    bool enableCompletions(const std::shared_ptr<ChunkPool> &pool);
+    bool completionsEnabled() const { return bufRing_ != nullptr; }
+
+    // 以下只能在 enableCompletions 成功之后、在 loop 线程中调用；channel 最后要 removeChannel，取消所有还没完成的请求
+    void startRecv(Channel *channel);
+    void stopRecv(Channel *channel);  // 取消之前已经完成的 recv 仍然会交给 channel
+    void startAccept(Channel *channel);
+    // 按顺序发送 count(<= kMaxLinkedSends) 段数据，每段一个结果；全部完成之前数据不能修改或者释放
+    void send(Channel *channel, const struct iovec *slices, int count);
+
+  private:
+    static const unsigned kRingEntries = 256;
+    static const unsigned kCompletionEntries = 4096;
+    static const uint32_t kTokenMask = 0xffffff;  // user_data 中序号占 24 位
+
+    IoUringPoller(EventLoop *loop, int ringFd, const void *params);
+    bool mapRings(const void *params);
+
+    void commit(ChannelSlot *s) override;
+    void unregister(ChannelSlot *s) override;
+
+    // 提交队列中取一个 sqe，队列满时先提交已有的
+    io_uring_sqe *getSqe();
+    void arm(int fd, ChannelSlot *s, uint32_t events);
+    void cancel(ChannelSlot *s);
+    uint32_t newToken();
+
+    // 完成模式下每个 fd 的请求状态，序号用来丢弃 channel 移除之后才到达的结果
+    struct CompletionSlot {
+        CompletionSlot() : channel(nullptr), token(0), recvGen(0), recvWanted(false), recvArmed(false), acceptArmed(false) {}
+
+        Channel *channel;
+        uint32_t token;
+        unsigned recvGen;  // 每次提交 recv 加一，区分被取消的旧 recv 的结束事件
+        bool recvWanted;
+        bool recvArmed;    // 内核中有一个 multishot recv
+        bool acceptArmed;
+    };
+
+    // 收割到的一个结果，分发时再检查一次 channel 是否还在(之前的回调可能已经 remove 了它)
+    struct PendingCompletion {
+        Channel *channel;
+        int fd;
+        uint32_t token;
+        bool deliver;  // 交给 channel；buffer ring 用完时的 -ENOBUFS 只需要重新提交
+        bool rearm;    // multishot 请求被内核终止，分发之后重新提交
+        bool hasBuffer;
+        uint16_t bid;
+        Completion completion;
+    };
+
+    CompletionSlot *completionSlot(Channel *channel);  // 不存在或者属于其他 channel 时重新分配
+    CompletionSlot *findCompletionSlot(int fd, Channel *channel);
+    void armRecv(int fd, CompletionSlot *cs);
+    void armAccept(int fd, CompletionSlot *cs);
+    void queueCompletion(const io_uring_cqe &cqe);
+    void dispatchCompletions();
+    void provideBuffer(uint16_t bid);  // 内存块放回 buffer ring
+
+    // 提交 pending_ 个 sqe；timeoutNs < 0 表示一直等待，waitForEvents 为 false 时不等待完成事件
+    int enter(bool waitForEvents, int64_t timeoutNs);
+    Timestamp wait(int64_t timeoutNs, ChannelList *activeChannels);
+    void reapCompletions(ChannelList *activeChannels);
+
+    int ringFd_;
+    bool extArg_;  // IORING_FEAT_EXT_ARG，io_uring_enter 可以带超时
+
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;  // IORING_FEAT_SINGLE_MMAP 时和 sqRing_ 相同
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqFlags_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned *sqArray_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+
+    unsigned pending_;    // 已经写入提交队列、还没有提交的 sqe 个数
+    uint32_t nextToken_;  // POLL_ADD 的序号，0 不使用
+
+    // 同一批完成事件中一个 channel 可能有多个(multishot)，合并成一次 handleEvent
+    uint64_t batch_;
+    std::vector<uint64_t> activeBatch_;  // 按 fd 下标
+
+    // 完成模式
+    std::shared_ptr<ChunkPool> pool_;
+    io_uring_buf *bufRing_;  // 和内核共享，bufs[0] 的 resv 字段是 tail
+    uint16_t bufTail_;
+    size_t bufferCapacity_;
+    std::vector<char *> buffers_;  // 按 bid 下标
+    std::vector<CompletionSlot> completionSlots_;  // 按 fd 下标
+    std::vector<PendingCompletion> completed_;
+    std::unique_ptr<Channel> completionChannel_;  // 不注册到内核，有结果时放进 activeChannels
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Callbacks.h"
+#include "Timestamp.h"
+#include "noncopyable.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * 4 字节长度头(网络字节序，不含头部本身) + 消息体的分帧编解码
+ *
+ * 解码: onMessage 一次取出 inputBuffer 中所有完整的帧，作为一批交给 FrameCallback，
+ *       帧只是指向 Buffer 内部的视图，不为每一帧分配 string，回调返回之后统一 retrieve
+ * 编码: 消息体先写进 Buffer，再把长度头写到它前面的 prepend 空间，不拼接新的缓冲区
+ *
+ * 一个 codec 可以被 TcpServer 的所有 IO 线程共享
+ */
+class LengthHeaderCodec : noncopyable {
+  public:
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameLength = 64 * 1024 * 1024;
+
+    // 一帧消息体，只在 FrameCallback 执行期间有效
+    struct Frame {
+        const char *data;
+        size_t length;
+
+        std::string toString() const { return std::string(data, length); }
+    };
+
+    using FrameCallback = std::function<void(const TcpConnectionPtr &, const std::vector<Frame> &, Timestamp)>;
+    // 长度头非法(负数或者超过上限)时回调，默认记录日志并 shutdown 连接
+    using ErrorCallback = std::function<void(const TcpConnectionPtr &, int32_t length)>;
+
+    explicit LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameLength = kDefaultMaxFrameLength);
+
+    void setErrorCallback(const ErrorCallback &cb) { errorCallback_ = cb; }
+
+    // 作为 TcpServer/TcpConnection 的 MessageCallback
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 在 payload 的可读数据前面写入长度头，之后 payload 就是一个完整的帧
+    static void encode(Buffer *payload);
+
+    // encode 之后发送，payload 会被清空
+    void send(const TcpConnectionPtr &conn, Buffer *payload) const;
+    void send(const TcpConnectionPtr &conn, const void *data, size_t len) const;
+    void send(const TcpConnectionPtr &conn, const std::string &message) const {
+        send(conn, message.data(), message.size());
+    }
+
+  private:
+    FrameCallback frameCallback_;
+    ErrorCallback errorCallback_;
+    size_t maxFrameLength_;
+};
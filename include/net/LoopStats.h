@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Histogram.h"
+#include "RelaxedCounter.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 一个 EventLoop 每轮循环的耗时分布和系统调用次数，只在 loop 线程中更新，snapshot() 可以在任意线程调用
+ *
+ * 时间都是纳秒(CLOCK_MONOTONIC)，loop 中相邻的阶段共用时间戳，每个事件只多读一次时钟
+ * timerfd 模式下定时器回调在 timerfd 的读事件中执行，同时计入 eventTime[kReadEvent] 和 timerTime
+ */
+class LoopStats : noncopyable {
+  public:
+    // 按 poller 返回的 revents 分类
+    enum EventType {
+        kReadEvent,       // EPOLLIN/EPOLLPRI/EPOLLRDHUP，包括 wakeup、timerfd 和完成模式的结果
+        kWriteEvent,      // EPOLLOUT
+        kReadWriteEvent,  // 同时可读可写
+        kErrorEvent,      // EPOLLERR，或者 EPOLLHUP 而且不可读
+        kNumEventTypes
+    };
+
+    enum Syscall {
+        kRead,      // 连接上的 read/readv
+        kWrite,     // 连接上的 write/writev/sendfile/sendmsg
+        kEpollCtl,  // Poller 注册变化的系统调用: epoll 是 epoll_ctl，io_uring 是单独提交的 io_uring_enter，poll 没有
+        kEventfd,   // wakeup eventfd 的 read 和 write
+        kNumSyscalls
+    };
+
+    struct Snapshot {
+        Snapshot();
+
+        uint64_t iterations;                           // poll 返回的次数
+        Histogram::Snapshot pollTime;                  // 阻塞在 poll 中(包括忙等轮询)的时间
+        Histogram::Snapshot activeChannels;            // 每次 poll 返回的活跃 channel 数
+        Histogram::Snapshot eventTime[kNumEventTypes];  // 一次 Channel::handleEvent 的时间
+        Histogram::Snapshot functorTime;               // 一次 doPendingFunctors 的时间，队列为空时不记录
+        Histogram::Snapshot functorDepth;              // 一次 doPendingFunctors 执行的回调个数，队列为空时不记录
+        Histogram::Snapshot timerTime;                 // 一个定时器回调的时间
+        uint64_t syscalls[kNumSyscalls];
+
+        void merge(const Snapshot &other);
+    };
+
+    LoopStats();
+
+    static int64_t nowNanos();
+    static EventType eventType(int revents);
+    static const char *eventTypeName(EventType type);
+    static const char *syscallName(Syscall call);
+
+    void recordPoll(int64_t nanos, size_t activeChannels);
+    void recordEvent(EventType type, int64_t nanos) { eventTime_[type].record(nanos); }
+    void recordFunctors(int64_t nanos, size_t depth);
+    void recordTimer(int64_t nanos) { timerTime_.record(nanos); }
+    void countSyscall(Syscall call) { relaxedAdd(syscalls_[call], 1); }
+
+    // kEpollCtl 和 eventfd 的 write 不在这里计数(其他线程也会 wakeup)，由 EventLoop::loopStatsSnapshot 补上
+    Snapshot snapshot() const;
+
+  private:
+    std::atomic<uint64_t> iterations_;
+    Histogram pollTime_;
+    Histogram activeChannels_;
+    Histogram eventTime_[kNumEventTypes];
+    Histogram functorTime_;
+    Histogram functorDepth_;
+    Histogram timerTime_;
+    std::atomic<uint64_t> syscalls_[kNumSyscalls];
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "RelaxedCounter.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// 发送队列的预算，0 表示不限制；low mark 为 0 时取对应 high mark 的一半
+struct OutputBudgetOptions {
+    enum Eviction {
+        kNoEviction,  // 超过预算只暂停读，不断开
+        kEvictSlow,   // 超过连接预算 evictSeconds 秒后仍然没有降到 connectionLowMark 以下就强制断开
+    };
+
+    OutputBudgetOptions()
+        : connectionHighMark(0)
+        , connectionLowMark(0)
+        , loopHighMark(0)
+        , loopLowMark(0)
+        , hardLimit(0)
+        , eviction(kNoEviction)
+        , evictSeconds(30.0) {}
+
+    size_t connectionHighMark;  // 单个连接排队字节数超过它时暂停该连接和它的 feeders 的读
+    size_t connectionLowMark;   // 降到它以下时恢复
+    size_t loopHighMark;        // loop 上所有连接排队字节数之和超过它时，有数据排队的连接暂停读
+    size_t loopLowMark;         // 降到它以下时全部恢复
+    size_t hardLimit;           // 单个连接排队字节数超过它时立即强制断开
+    Eviction eviction;
+    double evictSeconds;
+};
+
+/**
+ * 一个 EventLoop 上所有 TcpConnection 发送队列的内存预算
+ *
+ * 连接在自己的 outputQueue 变化时把差值计入 add/remove，是否暂停读由连接根据 options 判断；
+ * loop 超过预算时连接通过 waitForDrain 登记恢复回调，总量降到 loopLowMark 以下时一起回调
+ *
+ * 除 snapshot 外只在 loop 线程中调用；setOptions 通过 TcpServer::setOutputBudget 在 loop 线程中设置
+ */
+class OutputBudget : noncopyable {
+  public:
+    struct Snapshot {
+        uint64_t queuedBytes;  // 当前所有连接排队的字节数
+        uint64_t peakBytes;    // 历史最大值
+        uint64_t pauses;       // 因为超过预算而暂停读的次数
+        uint64_t evictions;    // 因为超过预算而断开的连接数
+    };
+
+    OutputBudget();
+
+    void setOptions(const OutputBudgetOptions &options) { options_ = options; }
+    const OutputBudgetOptions &options() const { return options_; }
+
+    void add(size_t n);
+    void remove(size_t n);  // 降到 loopLowMark 以下时执行 waitForDrain 登记的回调
+
+    size_t queuedBytes() const { return queued_; }
+    bool overLoopLimit() const { return options_.loopHighMark > 0 && queued_ > options_.loopHighMark; }
+
+    using DrainCallback = std::function<void()>;
+    void waitForDrain(const DrainCallback &cb) { waiters_.push_back(cb); }
+
+    size_t connectionLowMark() const {
+        return options_.connectionLowMark > 0 ? options_.connectionLowMark : options_.connectionHighMark / 2;
+    }
+    size_t loopLowMark() const { return options_.loopLowMark > 0 ? options_.loopLowMark : options_.loopHighMark / 2; }
+
+    void recordPause() { relaxedAdd(pauses_, 1); }
+    void recordEviction() { relaxedAdd(evictions_, 1); }
+
+    Snapshot snapshot() const;
+
+  private:
+    OutputBudgetOptions options_;
+    size_t queued_;
+    std::vector<DrainCallback> waiters_;
+
+    // 供 snapshot 在其他线程读取
+    std::atomic<uint64_t> queuedBytes_;
+    std::atomic<uint64_t> peakBytes_;
+    std::atomic<uint64_t> pauses_;
+    std::atomic<uint64_t> evictions_;
+};
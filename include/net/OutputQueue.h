@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Callbacks.h"
+#include "noncopyable.h"
+
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+
+class ChunkPool;
+
+/**
+ * TcpConnection 的发送队列，按调用顺序保存还没有写到内核的数据
+ *
+ * - 零散的小数据拷贝进内部的 Buffer (kBuffered)，连续的 kBuffered 合并成一项
+ * - sendv 传进来的 std::string 直接接管所有权 (kOwned)，不做任何拷贝
+ * - 共享的 PayloadPtr (kShared) 只持有引用计数，广播时 N 个连接共用同一份数据
+ * - sendFile 的文件区间 (kFile) 只记录 fd 和偏移，轮到它时用 sendfile 直接从 page cache 发送
+ * - writeFd 把队头的若干项拼成 iovec，一次 writev 写出去，队头是文件时改为一次 sendfile，调用者随后 retrieve(n)
+ * - 开启 zerocopy 后，不小于阈值的 kOwned/kShared 单独用 sendmsg(MSG_ZEROCOPY) 发送，
+ *   发送完成后数据先移到 pinned_，等 error queue 上的完成通知到达才释放
+ */
+class OutputQueue : noncopyable {
+  public:
+    static const int kMaxIovecs = 64;  // 一次 writev 最多携带的 iovec 数
+    //!NOTE: 小数据 pin 页面和处理完成通知的开销比拷贝还大，而且 std::string 的 SSO 在移动时会换地址
+    static const size_t kMinZeroCopyThreshold = 16 * 1024;
+
+    explicit OutputQueue(const std::shared_ptr<ChunkPool> &pool);
+    ~OutputQueue();
+
+    size_t readableBytes() const { return readable_; }
+    bool empty() const { return readable_ == 0; }
+    // 占用内存的待发送字节数，不含文件区间
+    size_t memoryBytes() const { return readable_ - fileBytes_; }
+
+    // 拷贝 data 到队尾
+    void append(const char *data, size_t len);
+    // 接管 slice，从 slice 的 offset 处开始发送
+    void append(std::string &&slice, size_t offset = 0);
+    // 持有 payload 的引用，从 offset 处开始发送
+    void append(const PayloadPtr &payload, size_t offset = 0);
+    // 接管 fd，发送 [offset, offset + length) 之后或者队列析构时关闭
+    void appendFile(int fd, off_t offset, size_t length);
+
+    ssize_t writeFd(int fd, int *saveErrno);
+    // 把队头的内存数据(到文件区间或者 zerocopy 数据为止)描述成 iovec，最多 maxIovecs 个，返回填充的个数
+    int peekIovecs(struct iovec *vec, int maxIovecs) const;
+    // 上一次 writeFd 没有写完交给内核的数据(包括出错)，说明 socket 发送缓冲区已满；边缘触发时据此判断是否继续写
+    bool lastWriteShort() const { return lastWriteShort_; }
+    void retrieve(size_t len);
+
+    // 只能在队列为空时调用
+    void setBufferMode(Buffer::Mode mode) { buffer_.setMode(mode); }
+
+    // 归还内部 Buffer 多余的存储，见 Buffer::shrink
+    void shrink() { buffer_.shrink(); }
+
+    // 队列占用的内存: 内部 Buffer 的存储 + 接管的 string(含等待 zerocopy 完成的)，共享的 payload 不计入
+    size_t footprint() const;
+
+    // 不小于 threshold 字节的 kOwned/kShared 使用 MSG_ZEROCOPY 发送，0 表示关闭，socket 需要先开启 SO_ZEROCOPY
+    // 阈值最小为 kMinZeroCopyThreshold
+    void setZeroCopyThreshold(size_t threshold);
+    size_t zeroCopyThreshold() const { return zeroCopyThreshold_; }
+
+    // 读取 fd 的 error queue 中的 zerocopy 完成通知，释放已经完成的数据，返回处理的通知数
+    int handleZeroCopyCompletions(int fd);
+
+    // 已经交给内核、还在等待完成通知的字节数
+    size_t pinnedBytes() const { return pinnedBytes_; }
+    // 内核因为无法 pin 住页面而退化成拷贝的次数
+    uint64_t zeroCopyFallbacks() const { return zeroCopyFallbacks_; }
+
+  private:
+    struct Entry {
+        enum Type {
+            kBuffered,  // 数据在 buffer_ 中
+            kOwned,     // 数据在 data 中
+            kShared,    // 数据在 shared 中，多个队列共享
+            kFile,      // 数据在文件 fd 中
+        };
+
+        Entry(Type t, size_t len)
+            : type(t), length(len), offset(0), fd(-1), fileOffset(0), zeroCopy(false), lastSeq(0) {}
+
+        // kOwned/kShared: 下一个待发送的字节
+        const char *peek() const { return (type == kShared ? shared->data() : data.data()) + offset; }
+
+        Type type;
+        size_t length;  // 剩余待发送的字节数
+        std::string data;
+        PayloadPtr shared;
+        size_t offset;  // kOwned/kShared: 下一个待发送字节在数据中的位置
+        int fd;         // kFile: 文件描述符，由队列负责关闭
+        off_t fileOffset;  // kFile: 下一个待发送字节在文件中的位置
+        bool zeroCopy;     // kOwned/kShared: 是否有数据以 MSG_ZEROCOPY 交给了内核
+        uint32_t lastSeq;  // kOwned/kShared: 最后一次 MSG_ZEROCOPY 发送的序号
+    };
+
+    // 等待 zerocopy 完成通知的数据
+    struct Pinned {
+        uint32_t seq;
+        std::string data;
+        PayloadPtr shared;
+        size_t bytes;
+    };
+
+    bool useZeroCopy(const Entry &entry) const {
+        return zeroCopyThreshold_ > 0 && (entry.type == Entry::kOwned || entry.type == Entry::kShared) &&
+               entry.length >= zeroCopyThreshold_;
+    }
+
+    ssize_t sendFile(Entry &entry, int fd, int *saveErrno);
+    ssize_t sendZeroCopy(Entry &entry, int fd, int *saveErrno);
+    void popFront();
+
+    Buffer buffer_;
+    std::deque<Entry> entries_;
+    size_t readable_;  // 所有 entry 的 length 之和
+    size_t fileBytes_;  // kFile entry 的 length 之和
+
+    size_t zeroCopyThreshold_;
+    uint32_t nextSeq_;  // 内核给每次成功的 MSG_ZEROCOPY 发送分配的序号，从 0 开始递增
+    std::deque<Pinned> pinned_;  // 按序号递增
+    size_t pinnedBytes_;
+    bool lastWriteShort_;
+    uint64_t zeroCopyFallbacks_;
+};
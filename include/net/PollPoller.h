@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <poll.h>
+#include <vector>
+
+/**
+ * poll(2) 实现的 Poller，fd 很少(十几个)的进程上一次 poll 扫描整个数组比 epoll 的内核数据结构更便宜
+ *
+ * - pollfds_ 只保存关注事件的 fd，连续存放，每次 poll 整个数组交给内核
+ * - slot 的 token 记录 fd 在 pollfds_ 中的下标，修改事件 O(1)；不再关注或者 remove 时和最后一个交换再删掉，也是 O(1)
+ * - 注册变化只修改用户态的数组，没有系统调用
+ * - 没有边缘触发，EventLoop::setEdgeTriggered 在这个实现上不生效
+ */
+class PollPoller : public Poller {
+  public:
+    PollPoller(EventLoop *loop);
+    ~PollPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    Timestamp pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels) override;  // ppoll，纳秒精度
+    const char *name() const override { return "poll"; }
+    bool supportsEdgeTriggered() const override { return false; }
+
+  private:
+    // 处理 poll/ppoll 的返回值
+    Timestamp handleEvents(int numEvents, int savedErrno, ChannelList *activeChannels);
+
+    // 填写活跃的连接
+    void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
+
+    void commit(ChannelSlot *s) override;
+    void unregister(ChannelSlot *s) override;
+
+    // 把 s 对应的 pollfd 和最后一个交换之后删掉，更新被换过来的 fd 的下标
+    void erase(ChannelSlot *s);
+
+    using PollFdList = std::vector<struct pollfd>;
+
+    PollFdList pollfds_;
+};
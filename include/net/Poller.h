@@ -3,7 +3,9 @@
 #include "Timestamp.h"
 #include "noncopyable.h"
 
-#include <unordered_map>
+#include <atomic>
+#include <stdint.h>
+#include <string>
 #include <vector>
 
 class Channel;
@@ -14,27 +16,103 @@ class Poller : noncopyable {
   public:
     using ChannelList = std::vector<Channel *>;
 
+    // 新建 EventLoop 时使用的 IO 复用实现
+    enum Backend {
+        kEpoll,
+        kIoUring,  // 内核不支持时退回 epoll
+        kPoll,     // poll(2)，fd 很少时使用
+    };
+
     Poller(EventLoop *loop);
     virtual ~Poller();
 
     // 给所有的 IO 复用保留统一的接口
     virtual Timestamp poll(int timeoutMs, ChannelList *activeChannels) = 0;
-    virtual void updateChannel(Channel *channel) = 0;
-    virtual void updateChannel(Channel *channel, const std::string &type) = 0;
-    virtual void removeChannel(Channel *channel) = 0;
 
-    // 判断参数 channel 是否在当前的 Poller 当中
+    // 微秒精度的超时，定时器直接驱动 poll 超时时使用；默认向上取整到毫秒调用 poll，不会提前返回
+    virtual Timestamp pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels);
+
+    // 按 channel 当前关注的事件更新注册，延迟模式下留到 flushUpdates 再提交
+    void updateChannel(Channel *channel);
+    // 从 Poller 中删除 channel，总是立即生效；IoUringPoller 还要取消完成模式的请求
+    virtual void removeChannel(Channel *channel);
+
+    // DEBUG 使用，打印 type 之后调用 updateChannel(channel)
+    void updateChannel(Channel *channel, const std::string &type);
+
+    virtual const char *name() const = 0;
+
+    // 是否支持边缘触发(EPOLLET)，不支持时 EventLoop::setEdgeTriggered 不生效
+    virtual bool supportsEdgeTriggered() const { return true; }
+
+    // 判断参数 channel 是否在当前的 Poller 当中，直接按 fd 下标查找
     bool hasChannel(Channel *channel) const;
 
+    /**
+     * 延迟提交注册变化: updateChannel 只标记 fd，flushUpdates 时按 channel 最终关注的事件和内核中已注册的事件比较，
+     * 每个 fd 最多一次系统调用，同一轮里的开了又关互相抵消；removeChannel 总是立即生效(之后 fd 可能被关闭)
+     */
+    void setDeferredUpdates(bool on);  // 关闭时立即提交还没提交的变化
+    bool deferredUpdates() const { return deferredUpdates_; }
+    void flushUpdates();  // EventLoop 每轮 poll 之前调用
+
+    // 可以在任意线程调用
+    uint64_t updateRequests() const { return updateRequests_.load(std::memory_order_relaxed); }  // updateChannel/removeChannel 次数
+    uint64_t updateSyscalls() const { return updateSyscalls_.load(std::memory_order_relaxed); }  // 实际的系统调用次数
+
     // EventLoop 可以通过该接口获取默认的 IO 复用的具体实现
     //!NOTE: 这里最好不要在 Poller.cpp 中实现，因为这个需要 include EPollPoller，基类包含派生类头文件不太好
     static Poller *newDefaultPoller(EventLoop *loop);
 
+    /**
+     * 设置之后创建的 EventLoop 使用的实现，需要在创建 EventLoop(包括 TcpServer 线程池中的)之前调用
+     * 没有调用时由环境变量决定: MUDUO_USE_IO_URING 选择 io_uring，MUDUO_USE_POLL 选择 poll，否则使用 epoll
+     */
+    static void setDefaultBackend(Backend backend);
+    static Backend defaultBackend();
+
   protected:
-    //!NOTE: int 是 sockfd，Channel* 是 sockfd 所属的通道
-    using ChannelMap = std::unordered_map<int, Channel *>;
-    ChannelMap channels_;
+    // channel 在 Poller 中的状态
+    static const int kNew = -1;     // 未添加到 poller 中
+    static const int kAdded = 1;    // 已添加到 poller 中
+    static const int kDeleted = 2;  // 不再关注任何事件，已从内核中删除，但是还在 slots_ 中
+
+    // 每个 fd 一个槽，保存 fd 所属的 channel、状态和最近一次注册到内核的事件
+    struct ChannelSlot {
+        Channel *channel;
+        int state;
+        uint32_t events;
+        bool dirty;      // 有还没提交的变化
+        uint32_t token;  // 具体的 Poller 使用，IoUringPoller 中是当前 poll 请求的序号
+    };
+
+    //!NOTE: 内核总是分配最小的可用 fd，fd 是稠密的，直接用 fd 做下标，不需要哈希
+    ChannelSlot *slot(int fd);                  // 不够时扩容
+    const ChannelSlot *findSlot(int fd) const;  // 超出范围返回 nullptr
+    void resetSlot(int fd);
+
+    // 把 channel 当前关注的事件同步到内核，具体的 Poller 实现
+    virtual void commit(ChannelSlot *s) = 0;
+
+    // removeChannel 中调用，s 处于 kAdded 状态: 删除内核中的注册，之后 s 会被重置
+    virtual void unregister(ChannelSlot *s) = 0;
+
+    // updateChannel 中调用: 延迟模式下记录 fd 并返回 true，否则返回 false，由调用方立即 commit
+    bool defer(int fd, ChannelSlot *s);
+
+    // 不论是否延迟模式，下一次 flushUpdates 时 commit 这个 slot
+    void markDirty(int fd, ChannelSlot *s);
+
+    EventLoop *ownerLoop() const { return ownerLoop_; }
+
+    std::atomic<uint64_t> updateRequests_;
+    std::atomic<uint64_t> updateSyscalls_;
 
   private:
+    static const size_t kInitSlots = 256;
+
+    std::vector<ChannelSlot> slots_;
+    bool deferredUpdates_;
+    std::vector<int> dirtyFds_;  // 可能重复，提交时以 slot 的 dirty 为准
     EventLoop *ownerLoop_;  // 定义 Poller 所属的事件循环 EventLoop
 };
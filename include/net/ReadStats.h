@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Histogram.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 一个 EventLoop 上所有连接的读统计，只在 loop 线程中更新，snapshot() 可以在任意线程调用
+ *
+ * 单次 read 的大小记录在 Histogram 中(和 LoopStats 相同的分桶)，次数和总字节数就是直方图的 count 和 sum
+ */
+class ReadStats : noncopyable {
+  public:
+    struct Snapshot {
+        uint64_t reads;           // readv 次数(不含出错)
+        uint64_t bytes;           // 读到的总字节数
+        uint64_t events;          // 读事件次数
+        uint64_t budgetExhausted; // drain 模式下因为用完预算而提前结束的读事件
+        Histogram::Snapshot sizes;
+    };
+
+    ReadStats();
+
+    void recordRead(size_t n) { sizes_.record(n); }
+    void recordEvent(bool budgetExhausted);
+
+    Snapshot snapshot() const;
+
+  private:
+    Histogram sizes_;
+    std::atomic<uint64_t> events_;
+    std::atomic<uint64_t> budgetExhausted_;
+};
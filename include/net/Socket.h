@@ -23,6 +23,8 @@ class Socket : noncopyable {
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    bool setZeroCopy(bool on);  // SO_ZEROCOPY，内核不支持时返回 false
+    bool setBusyPoll(int usec, bool prefer);  // SO_BUSY_POLL/SO_PREFER_BUSY_POLL，权限不足或内核不支持时返回 false
 
   private:
     const int sockfd_;
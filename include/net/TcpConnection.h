@@ -3,16 +3,32 @@
 #include "Buffer.h"
 #include "Callbacks.h"
 #include "InetAddress.h"
+#include "OutputQueue.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 class Channel;
 class EventLoop;
+class IoUringPoller;
 class Socket;
+struct Completion;
+
+// 读事件的处理策略
+struct ReadOptions {
+    static const size_t kDefaultBudget = 256 * 1024;
+
+    ReadOptions() : adaptive(true), drain(false), budget(kDefaultBudget) {}
+
+    bool adaptive;  // 根据连接最近的读大小调整 inputBuffer 的预留空间，见 Buffer::setAdaptiveRead
+    bool drain;     // 一次读事件中一直读到 socket 读空(EAGAIN)，减少大块上传时的 epoll 往返
+    size_t budget;  // drain 时一次读事件最多读取的字节数，避免一个连接饿死同一 loop 上的其他连接
+};
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过 accept 函数那道 connfd
@@ -33,15 +49,71 @@ class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnec
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
+    bool disconnected() const { return state_ == kDisconnected; }
+
+    int fd() const;
+    Buffer *inputBuffer() { return &inputBuffer_; }
+    bool hasPendingOutput() const { return !outputQueue_.empty(); }
+    size_t outputBytes() const { return outputQueue_.readableBytes(); }  // 发送队列中排队的字节数，含 sendFile 的文件区间
+
+    // 连接占用的内存: 对象本身 + 输入输出缓冲区的存储，用来估算大量空闲连接的开销
+    size_t memoryFootprint() const;
+    // 归还输入输出缓冲区中空闲的存储，只能在 loop 线程中调用
+    void shrinkBuffers();
+
+    // 用户自定义的上下文，比如 HttpServer 保存 CONNECT 隧道的状态
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
 
     void send(const std::string &buf);  // 发送数据
     void send(Buffer *buf);  // 发送数据
 
+    /**
+     * 接管数据发送，不拷贝。在其他线程调用时数据先放进连接的待发送队列，
+     * 队列由空变为非空时才向 loop 投递一次 flush，flush 把积累的数据合成一次 sendv
+     */
+    void send(std::string &&message);
+    void send(Buffer &&buf);
+
+    // 按顺序发送多段数据，接管 slices 中字符串的所有权，尽量一次 writev 写完且不做拷贝
+    void sendv(std::vector<std::string> &&slices);
+
+    // 发送共享的不可变数据，发送队列只持有引用，没写完的部分记录偏移，适合同一消息发给大量连接
+    void send(const PayloadPtr &payload);
+
+    // 用 sendfile 发送文件 fd 的 [offset, offset + length)，和 send/sendv 保持顺序
+    // 内部会 dup 一份 fd，调用者返回后就可以关闭自己的 fd
+    void sendFile(int fd, off_t offset, size_t length);
+
     void shutdown();  // 关闭连接
 
     void forceClose();  // 强制关闭连接
     void forceCloseWithDelay(double seconds);
 
+    // 开始/停止关注读事件，用来做反压，可以在任意线程调用
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    /**
+     * 发送队列超过 loop 的 OutputBudget 时自动暂停本连接的读，并暂停所有 feeder(给本连接生产数据的连接，
+     * 比如转发的上游)的读，降到 low mark 以下时恢复。可以在任意线程调用，feeder 可以属于其他 loop
+     */
+    void addFeeder(const TcpConnectionPtr &peer);
+    void removeFeeder(const TcpConnectionPtr &peer);
+    bool isThrottled() const { return readHolds_ > 0; }  // 是否因为反压暂停了读
+
+    /**
+     * 旁路模式，供 TcpRelay 这类直接操作 fd 的组件在 loop 线程中使用:
+     * 设置 rawReadCallback 之后 handleRead 不再读 inputBuffer，而是回调它；
+     * outputQueue 为空时的写事件交给 rawWriteCallback，setWriteInterest 控制是否关注写事件；
+     * 旁路的读不保证读到 EAGAIN，设置 rawReadCallback 之后连接退回水平触发(完成模式的连接退回就绪模式)
+     */
+    using RawEventCallback = std::function<void()>;
+    void setRawReadCallback(const RawEventCallback &cb);
+    void setRawWriteCallback(const RawEventCallback &cb) { rawWriteCallback_ = cb; }
+    void setWriteInterest(bool on);
+
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
 
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
@@ -55,6 +127,25 @@ class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnec
 
     void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
 
+    // 不小于 threshold 字节的 sendv 数据使用 MSG_ZEROCOPY 发送，0 表示关闭
+    // 内核不支持 SO_ZEROCOPY 时保持关闭，需要在 connectEstablished 之前调用
+    void setZeroCopyThreshold(size_t threshold);
+
+    // 需要在 connectEstablished 之前调用
+    void setReadOptions(const ReadOptions &options) {
+        readOptions_ = options;
+        inputBuffer_.setAdaptiveRead(options.adaptive);
+    }
+
+    // 缓冲区为空且连接空闲 seconds 秒之后归还缓冲区的存储，0 表示不归还，需要在 connectEstablished 之前调用
+    void setBufferIdleTimeout(double seconds) { bufferIdleTimeout_ = seconds; }
+
+    // 设置输入输出缓冲区的存储模式，需要在 connectEstablished 之前调用
+    void setBufferMode(Buffer::Mode mode) {
+        inputBuffer_.setMode(mode);
+        outputQueue_.setBufferMode(mode);
+    }
+
     void connectEstablished();  // 连接建立
     void connectDestroyed();    // 连接销毁
 
@@ -66,16 +157,58 @@ class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnec
     void handleClose();
     void handleError();
 
+    // 完成模式(见 EventLoop::setCompletionMode)
+    void handleCompletion(Completion &completion);
+    void handleRecvCompletion(Completion &completion);
+    void handleSendCompletion(const Completion &completion);
+    void submitSends();          // 没有在途的 send 时把 outputQueue_ 队头的数据交给内核
+    void deliverPendingInput();  // 恢复读之后回调暂停期间收到的数据
+    void leaveCompletionMode();  // 退回就绪模式，旁路模式需要自己读写 fd
+
     void setState(StateE s) { state_ = s; }
     
     void sendInLoop(const void *message, size_t len); // 被 send 调用
+    void sendvInLoop(std::vector<std::string> &slices);  // 被 sendv 调用
+    void sendPayloadInLoop(const PayloadPtr &payload);   // 被 send(PayloadPtr) 调用
+    void sendBufferInLoop(Buffer *buf);  // 逐段发送并清空 buf
+    void flushPendingSends();            // 按顺序发送其他线程放进 pendingSends_ 的数据
+    void sendFileInLoop(int fd, off_t offset, size_t length);  // 被 sendFile 调用，负责关闭 fd
+    // 剩余数据入队之后检查高水位并关注写事件，socketFull 表示刚才直接写时写满了 socket(边缘触发时一定会有写事件)
+    void queueOutput(size_t oldLen, size_t remaining, bool socketFull);
+    void queueWriteComplete();  // 投递 writeCompleteCallback_
+    void runWriteComplete();
+    void runHighWaterMark(size_t queued);
     void shutdownInLoop();    // 被 shutdown 调用
     void forceCloseInLoop();  // 被 forceClose 调用
+    void startReadInLoop();
+    void stopReadInLoop();
+
+    // 边缘触发时补上错过的读写事件: 恢复读之后 socket 中可能已经有数据，入队时 socket 可能本来就可写
+    void resumeRead();
+    void resumeWrite();
+
+    // 反压相关，都在 loop 线程中执行
+    void updateReading();          // 按 reading_ 和 readHolds_ 开关读事件
+    void holdRead();               // readHolds_ 加一，可以在任意线程调用
+    void releaseRead();            // readHolds_ 减一，可以在任意线程调用
+    void holdReadInLoop();
+    void releaseReadInLoop();
+    void updateOutputBudget();     // outputQueue_ 变化之后更新 loop 的预算并判断是否需要暂停/恢复
+    void releaseOutputBudget();    // 连接关闭时归还预算并恢复 feeders
+    void setThrottling(bool on);
+    void onLoopBudgetDrained();
+    void evictIfOverBudget(uint64_t episode);
+    void addFeederInLoop(const std::weak_ptr<TcpConnection> &peer);
+    void removeFeederInLoop(const std::weak_ptr<TcpConnection> &peer);
+
+    void scheduleBufferRelease();  // 缓冲区空了之后启动空闲定时器
+    void onBufferIdleTimer();
 
     EventLoop *loop_;  // 这里绝对不是 baseLoop，因为 TcpConnection 都是在 subLoop 里面管理的
     const std::string name_;
     std::atomic_int state_;
-    bool reading_;
+    bool reading_;   // 用户是否希望读，见 startRead/stopRead
+    int readHolds_;  // 反压暂停读的引用计数，自己或者下游超过预算时加一，大于 0 时不关注读事件
 
     // 和 Acceptor 类似: Acceptor => mainLoop | TcpConnection => subLoop
     std::unique_ptr<Socket> socket_;
@@ -90,9 +223,62 @@ class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnec
     WriteCompleteCallback writeCompleteCallback_;  // 消息发送完成之后的回调
     HighWaterMarkCallback highWaterMarkCallback_;
     CloseCallback closeCallback_;
+    RawEventCallback rawReadCallback_;
+    RawEventCallback rawWriteCallback_;
 
     size_t highWaterMark_;
+    ReadOptions readOptions_;
 
     Buffer inputBuffer_;
-    Buffer outputBuffer_;
+    OutputQueue outputQueue_;  // 待发送数据，保持 send/sendv 的调用顺序
+
+    // 其他线程的 send/sendv/sendFile，按调用顺序放进 pendingSends_，由 flushPendingSends 依次发送
+    struct PendingSend {
+        enum Kind { kString, kBuffer, kSlices, kPayload, kFile };
+
+        explicit PendingSend(std::string &&message)
+            : kind(kString), data(std::move(message)), fileFd(-1), fileOffset(0), fileLength(0) {}
+        explicit PendingSend(Buffer &&buf)
+            : kind(kBuffer), buffer(new Buffer(std::move(buf))), fileFd(-1), fileOffset(0), fileLength(0) {}
+        explicit PendingSend(std::vector<std::string> &&s)
+            : kind(kSlices), slices(std::move(s)), fileFd(-1), fileOffset(0), fileLength(0) {}
+        explicit PendingSend(const PayloadPtr &p)
+            : kind(kPayload), payload(p), fileFd(-1), fileOffset(0), fileLength(0) {}
+        PendingSend(int fd, off_t offset, size_t length)
+            : kind(kFile), fileFd(fd), fileOffset(offset), fileLength(length) {}
+
+        Kind kind;
+        std::string data;                 // kString
+        std::unique_ptr<Buffer> buffer;   // kBuffer
+        std::vector<std::string> slices;  // kSlices
+        PayloadPtr payload;               // kPayload
+        int fileFd;                       // kFile，dup 出来的 fd，由 sendFileInLoop 或放弃发送时关闭
+        off_t fileOffset;
+        size_t fileLength;
+    };
+    void queuePendingSend(PendingSend &&item);  // 队列由空变为非空时投递一次 flushPendingSends
+    std::mutex pendingMutex_;
+    std::vector<PendingSend> pendingSends_;  // 受 pendingMutex_ 保护
+
+    std::shared_ptr<void> context_;
+
+    // 反压状态，只在 loop 线程中访问
+    size_t budgetedBytes_;     // 已经计入 loop 预算的字节数
+    bool overBudget_;          // 超过了连接的预算
+    bool waitingLoopBudget_;   // 因为 loop 超过预算在等待恢复
+    bool throttling_;          // overBudget_ || waitingLoopBudget_，已经暂停了自己和 feeders_ 的读
+    uint64_t budgetEpisode_;   // 每次进入/离开超预算状态加一，eviction 定时器据此判断是不是同一次超限
+    std::vector<std::weak_ptr<TcpConnection>> feeders_;
+
+    // 空闲时归还缓冲区，只在 loop 线程中访问
+    double bufferIdleTimeout_;
+    Timestamp lastActive_;        // 最近一次读写的时间
+    bool bufferTimerPending_;     // 同一时间只有一个空闲定时器
+
+    // 完成模式，只在 loop 线程中访问
+    IoUringPoller *uring_;  // 为空表示就绪模式
+    bool recving_;          // 已经提交了 multishot recv
+    bool inputPending_;     // 暂停读之后才收割到的数据已经在 inputBuffer_ 中，还没有回调
+    int sendsInFlight_;     // 已经提交、还没有结果的 IORING_OP_SEND
+    bool sendFailed_;       // 在途的这条链中有 send 出错
 };
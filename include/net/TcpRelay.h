@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "noncopyable.h"
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * 把同一个 loop 上的两个 TcpConnection 对接起来，数据经过内核 pipe 用 splice(2) 搬运，不进入用户态
+ *
+ * 每个方向一个 pipe: socket --splice--> pipe --splice--> socket
+ * - pipe 里还有数据发不出去时停止读来源连接(反压)，关注目标连接的写事件，写完再恢复读
+ * - 来源连接读到 EOF 且 pipe 排空之后 shutdown 目标连接的写端，两个方向都结束后关闭两个连接
+ * - 任一连接出错或者断开，stop() 关闭另一个连接
+ *
+ * 建立 relay 之前两个连接 inputBuffer 中已经读到的数据会先用 send 转发，
+ * 目标连接 outputQueue 中还没发完的数据(比如 CONNECT 的 200 响应)也会先于 pipe 中的数据发送
+ */
+class TcpRelay : noncopyable, public std::enable_shared_from_this<TcpRelay> {
+  public:
+    static const int kDefaultPipeSize = 256 * 1024;
+
+    // relay 建立成功时参数为 relay，连接后端失败时为空指针
+    using RelayCallback = std::function<void(const std::shared_ptr<TcpRelay> &)>;
+
+    // a 和 b 必须属于同一个 EventLoop
+    TcpRelay(const TcpConnectionPtr &a, const TcpConnectionPtr &b);
+    ~TcpRelay();
+
+    /**
+     * 在 client 所在的 loop 中连接 backend，连接成功后创建后端 TcpConnection 和 relay，回调 cb 之后开始转发
+     * 后端连接由 relay 管理，后端断开时 relay 会关闭 client；client 断开时调用者需要调用 relay 的 stop()
+     * 调用前应当先 client->stopRead()，避免连接后端期间继续读 client 的数据
+     */
+    static void connect(const TcpConnectionPtr &client, const InetAddress &backend, const RelayCallback &cb);
+
+    void start();  // 可以在任意线程调用
+    void stop();   // 关闭两个连接，可以重复调用
+
+    const TcpConnectionPtr &first() const { return dirs_[0].from; }
+    const TcpConnectionPtr &second() const { return dirs_[1].from; }
+
+    // 各方向已经转发的字节数，只在 loop 线程中读取
+    uint64_t bytesForwarded() const { return dirs_[0].bytes; }
+    uint64_t bytesBackward() const { return dirs_[1].bytes; }
+
+  private:
+    // 一个方向: from 的数据经过 pipe 写到 to
+    struct Direction {
+        Direction() : pipeSize(0), pending(0), eof(false), done(false), bytes(0) {
+            pipefd[0] = -1;
+            pipefd[1] = -1;
+        }
+
+        TcpConnectionPtr from;
+        TcpConnectionPtr to;
+        int pipefd[2];
+        size_t pipeSize;
+        size_t pending;  // pipe 中还没有写到 to 的字节数
+        bool eof;        // from 已经读到 EOF
+        bool done;       // EOF 已经转发(to 已经 shutdown)
+        uint64_t bytes;
+    };
+
+    void startInLoop();
+    void handleReadable(Direction *dir);
+    void flush(Direction *dir);
+    void stopInLoop();
+
+    Direction dirs_[2];  // [0]: a -> b, [1]: b -> a
+    bool started_;
+    bool stopped_;
+};
@@ -34,6 +34,36 @@ class TcpServer : noncopyable {
 
     void setThreadNum(int numThreads);  // 设置底层 subLoop 的个数
 
+    // 新连接的 Buffer 存储模式，大请求体或慢客户端较多时使用 Buffer::kSegmented
+    void setBufferMode(Buffer::Mode mode) { bufferMode_ = mode; }
+
+    // 新连接的读策略
+    void setReadOptions(const ReadOptions &options) { readOptions_ = options; }
+
+    // 新连接大于等于 threshold 字节的 sendv 数据使用 MSG_ZEROCOPY，0 表示关闭
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+
+    // 新连接的缓冲区空闲 seconds 秒之后归还存储，0 表示不归还
+    void setBufferIdleTimeout(double seconds) { bufferIdleTimeout_ = seconds; }
+
+    // 所有 IO loop 的发送队列预算，需要在 start 之前调用
+    void setOutputBudget(const OutputBudgetOptions &options) {
+        outputBudget_ = options;
+        hasOutputBudget_ = true;
+    }
+
+    // 所有 loop(包括 baseLoop)的定时器驱动方式，见 EventLoop::setTimerMode，在 start 之前设置
+    void setTimerMode(TimerQueue::Mode mode) { timerMode_ = mode; }
+
+    // 所有 loop(包括 baseLoop)使用边缘触发，见 EventLoop::setEdgeTriggered，在 start 之前设置
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+    // 所有 loop 延迟提交 epoll_ctl，见 EventLoop::setDeferredUpdates，在 start 之前设置
+    void setDeferredUpdates(bool on) { deferredUpdates_ = on; }
+
+    // 所有 loop 使用 io_uring 的完成模式，见 EventLoop::setCompletionMode，在 start 之前设置
+    void setCompletionMode(bool on) { completionMode_ = on; }
+
     void start();  // 开启服务器监听
 
     EventLoop* getLoop() const { return loop_; }
@@ -42,6 +72,9 @@ class TcpServer : noncopyable {
 
     const std::string ipPort() { return ipPort_; }
 
+    // start 之后可以用 threadPool()->loopStats() 取所有 IO loop 的 LoopStats 汇总
+    std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
+
   private:
     void newConnection(int sockfd, const InetAddress &peerAddr);
     void removeConnection(const TcpConnectionPtr &conn);
@@ -65,6 +98,17 @@ class TcpServer : noncopyable {
     ThreadInitCallback threadInitCallback_;  // loop 线程初始化的回调
     std::atomic_int started_;
 
+    Buffer::Mode bufferMode_;  // 新连接的 Buffer 存储模式
+    size_t zeroCopyThreshold_;  // 新连接的 MSG_ZEROCOPY 阈值
+    ReadOptions readOptions_;   // 新连接的读策略
+    double bufferIdleTimeout_;  // 新连接的缓冲区空闲归还时间
+    OutputBudgetOptions outputBudget_;
+    bool hasOutputBudget_;
+    TimerQueue::Mode timerMode_;
+    bool edgeTriggered_;
+    bool deferredUpdates_;
+    bool completionMode_;
+
     int nextConnId_;
     ConnectionMap connections_;  // 保存所有连接
 };
@@ -1,9 +1,11 @@
 #pragma once
 
+#include "InlineFunction.h"
 #include "noncopyable.h"
 #include "Timestamp.h"
 
-#include <functional>
+template <typename T>
+class NodeCache;
 
 /**
  * Timer用于描述一个定时器
@@ -12,16 +14,22 @@
 class Timer : noncopyable
 {
 public:
-    using TimerCallback = std::function<void()>;
+    using TimerCallback = InlineFunction<void()>;
 
     Timer(TimerCallback cb, Timestamp when, double interval)
-        : callback_(move(cb)),
+        : callback_(std::move(cb)),
           expiration_(when),
           interval_(interval),
-          repeat_(interval > 0.0) // 一次性定时器设置为0
+          repeat_(interval > 0.0), // 一次性定时器设置为0
+          nextFree(nullptr)
     {
     }
 
+    //!NOTE: 优先复用 NodeCache 中的空闲 Timer，稳定状态下添加定时器不申请内存；可以在任意线程调用
+    static Timer *create(TimerCallback cb, Timestamp when, double interval);
+    // 释放回调(可能持有连接的 shared_ptr)之后放回 NodeCache
+    static void destroy(Timer *timer);
+
     void run() const 
     { 
         callback_(); 
@@ -34,8 +42,11 @@ public:
     void restart(Timestamp now);
 
 private:
-    const TimerCallback callback_;  // 定时器回调函数
+    friend class NodeCache<Timer>;
+
+    TimerCallback callback_;        // 定时器回调函数
     Timestamp expiration_;          // 下一次的超时时刻
-    const double interval_;         // 超时时间间隔，如果是一次性定时器，该值为0
-    const bool repeat_;             // 是否重复(false 表示是一次性定时器)
+    double interval_;               // 超时时间间隔，如果是一次性定时器，该值为0
+    bool repeat_;                   // 是否重复(false 表示是一次性定时器)
+    Timer *nextFree;                // 在 NodeCache 的空闲链表中时的链接
 };
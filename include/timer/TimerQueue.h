@@ -4,7 +4,6 @@
 #include "Channel.h"
 
 #include <vector>
-#include <set>
 
 class EventLoop;
 class Timer;
@@ -12,7 +11,13 @@ class Timer;
 class TimerQueue
 {
 public:
-    using TimerCallback = std::function<void()>;
+    using TimerCallback = InlineFunction<void()>;
+
+    // 定时器的驱动方式
+    enum Mode {
+        kTimerfd,      // 最早到期时间变化时 timerfd_settime，到期后 timerfd 可读，作为普通 channel 处理
+        kPollTimeout,  // 不用 timerfd，EventLoop 按最早到期时间计算 poll 超时，poll 返回后调用 runExpired
+    };
 
     explicit TimerQueue(EventLoop* loop);
     ~TimerQueue();
@@ -21,10 +26,23 @@ public:
     void addTimer(TimerCallback cb,
                   Timestamp when,
                   double interval);
+
+    // 切换驱动方式，只能在 loop 线程中调用
+    void setMode(Mode mode);
+    Mode mode() const { return mode_; }
+
+    // timerfd channel 的触发方式，一次 read 就读空 timerfd，两种方式都可以
+    void setEdgeTriggered(bool on) { timerfdChannel_.setEdgeTriggered(on); }
+
+    // kPollTimeout: 距离最早到期还有多少微秒，已经到期返回 0，没有定时器或者超过 maxUs 返回 maxUs
+    int64_t nextTimeoutUs(Timestamp now, int64_t maxUs) const;
+
+    // kPollTimeout: 执行所有已经到期的定时器，没有到期的定时器时不读时钟
+    void runExpired();
     
 private:
-    using Entry = std::pair<Timestamp, Timer*>; // 以时间戳作为键值获取定时器
-    using TimerList = std::set<Entry>;          // 底层使用红黑树管理，自动按照时间戳进行排序
+    //!NOTE: 按到期时间排列的最小堆，vector 的容量一直复用，添加、删除定时器不再申请 set 节点
+    using TimerList = std::vector<Timer*>;
 
     // 在本loop中添加定时器
     // 线程安全
@@ -37,10 +55,16 @@ private:
     void resetTimerfd(int timerfd_, Timestamp expiration);
     
     // 移除所有已到期的定时器
-    // 1.获取到期的定时器
+    // 1.获取到期的定时器，放进 expired_
     // 2.重置这些定时器（销毁或者重复定时任务）
-    std::vector<Entry> getExpired(Timestamp now);
-    void reset(const std::vector<Entry>& expired, Timestamp now);
+    void getExpired(Timestamp now);
+    void reset(Timestamp now);
+
+    // 最早到期的定时器，timers_ 不能为空
+    Timestamp earliest() const;
+
+    // 取出、执行并重置 now 之前到期的定时器，两种模式共用
+    void processExpired(Timestamp now);
 
     // 插入定时器的内部方法
     bool insert(Timer* timer);
@@ -49,7 +73,9 @@ private:
     const int timerfd_;         // timerfd是Linux提供的定时器接口
     Channel timerfdChannel_;    // 封装timerfd_文件描述符
     // Timer list sorted by expiration
-    TimerList timers_;          // 定时器队列（内部实现是红黑树）
+    TimerList timers_;          // 定时器队列（最小堆）
+    TimerList expired_;         // 本次到期的定时器，容量复用
 
     bool callingExpiredTimers_; // 标明正在获取超时定时器
+    Mode mode_;
 };
@@ -0,0 +1,94 @@
+#include "Histogram.h"
+
+#include "RelaxedCounter.h"
+
+#include <string.h>
+
+const int Histogram::kSubBucketBits;
+const int Histogram::kSubBuckets;
+const int Histogram::kMaxExponent;
+const int Histogram::kNumBuckets;
+
+Histogram::Snapshot::Snapshot() : count(0), sum(0), max(0) { memset(buckets, 0, sizeof(buckets)); }
+
+uint64_t Histogram::Snapshot::percentile(double p) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t bound = bucketUpperBound(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+void Histogram::Snapshot::merge(const Snapshot &other) {
+    count += other.count;
+    sum += other.sum;
+    if (other.max > max) {
+        max = other.max;
+    }
+    for (int i = 0; i < kNumBuckets; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+Histogram::Histogram() : count_(0), sum_(0), max_(0) {
+    for (int i = 0; i < kNumBuckets; ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::record(uint64_t value) {
+    relaxedAdd(count_, 1);
+    relaxedAdd(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed)) {
+        max_.store(value, std::memory_order_relaxed);
+    }
+    relaxedAdd(buckets_[bucketIndex(value)], 1);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot s;
+    s.count = count_.load(std::memory_order_relaxed);
+    s.sum = sum_.load(std::memory_order_relaxed);
+    s.max = max_.load(std::memory_order_relaxed);
+    for (int i = 0; i < kNumBuckets; ++i) {
+        s.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+// 最高位的位置决定区间，紧跟着的 kSubBucketBits 位决定区间内的桶
+int Histogram::bucketIndex(uint64_t value) {
+    if (value < static_cast<uint64_t>(kSubBuckets)) {
+        return static_cast<int>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > kMaxExponent) {
+        return kNumBuckets - 1;
+    }
+    int sub = static_cast<int>((value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1));
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t Histogram::bucketUpperBound(int i) {
+    if (i < kSubBuckets) {
+        return static_cast<uint64_t>(i);
+    }
+    if (i >= kNumBuckets - 1) {
+        return UINT64_MAX;
+    }
+    int exponent = i / kSubBuckets + kSubBucketBits - 1;
+    uint64_t sub = static_cast<uint64_t>(i % kSubBuckets);
+    uint64_t width = static_cast<uint64_t>(1) << (exponent - kSubBucketBits);
+    return (static_cast<uint64_t>(kSubBuckets) + sub + 1) * width - 1;
+}
@@ -0,0 +1,225 @@
+#include "StringSearch.h"
+
+#include <atomic>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRING_SEARCH_X86 1
+#endif
+
+namespace {
+
+struct Kernels {
+    StringSearch::Impl impl;
+    const char *(*findCRLF)(const char *, const char *);
+    const char *(*findCRLFCRLF)(const char *, const char *);
+};
+
+/**
+ * 标量实现: 用 memchr 找 '\r'，再比较后面的字节
+ * glibc 的 memchr 本身已经按 CPU 选择了向量化实现，单字符查找所有实现都直接用它
+ */
+
+const char *findCharScalar(const char *begin, const char *end, char c) {
+    if (begin >= end) {
+        return NULL;
+    }
+    return static_cast<const char *>(memchr(begin, c, end - begin));
+}
+
+const char *findCRLFScalar(const char *begin, const char *end) {
+    const char *p = begin;
+    while (end - p >= 2) {
+        // '\r' 只可能出现在 [p, end - 1)
+        p = static_cast<const char *>(memchr(p, '\r', end - p - 1));
+        if (p == NULL) {
+            return NULL;
+        }
+        if (p[1] == '\n') {
+            return p;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
+const char *findCRLFCRLFScalar(const char *begin, const char *end) {
+    const char *p = begin;
+    while (end - p >= 4) {
+        p = static_cast<const char *>(memchr(p, '\r', end - p - 3));
+        if (p == NULL) {
+            return NULL;
+        }
+        if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+            return p;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
+const Kernels kScalarKernels = {StringSearch::kScalar, findCRLFScalar, findCRLFCRLFScalar};
+
+#ifdef STRING_SEARCH_X86
+
+/**
+ * SIMD 实现: 一次比较 16/32 个起点，movemask 得到命中的位图
+ * - CRLF: p 处等于 '\r' 且 p + 1 处等于 '\n'，两次不对齐加载，结果精确
+ * - CRLFCRLF: 先用首字节 '\r' 和末字节 '\n' 过滤候选位置，再逐个核对中间两个字节，
+ *   正常的头部里候选很少，大部分窗口只需要两次比较
+ * 剩余不足一个向量的尾部交给标量实现
+ */
+
+const char *findCRLFSSE2(const char *begin, const char *end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    while (end - p >= 17) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(y, lf)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findCRLFScalar(p, end);
+}
+
+const char *findCRLFCRLFSSE2(const char *begin, const char *end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    while (end - p >= 19) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 3));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, cr), _mm_cmpeq_epi8(last, lf)));
+        while (mask != 0) {
+            const char *q = p + __builtin_ctz(mask);
+            if (q[1] == '\n' && q[2] == '\r') {
+                return q;
+            }
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+    return findCRLFCRLFScalar(p, end);
+}
+
+const Kernels kSSE2Kernels = {StringSearch::kSSE2, findCRLFSSE2, findCRLFCRLFSSE2};
+
+__attribute__((target("avx2"))) const char *findCRLFAVX2(const char *begin, const char *end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    while (end - p >= 33) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        unsigned mask =
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(x, cr), _mm256_cmpeq_epi8(y, lf)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findCRLFSSE2(p, end);
+}
+
+__attribute__((target("avx2"))) const char *findCRLFCRLFAVX2(const char *begin, const char *end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    while (end - p >= 35) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i last = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 3));
+        unsigned mask =
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, cr), _mm256_cmpeq_epi8(last, lf)));
+        while (mask != 0) {
+            const char *q = p + __builtin_ctz(mask);
+            if (q[1] == '\n' && q[2] == '\r') {
+                return q;
+            }
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+    return findCRLFCRLFSSE2(p, end);
+}
+
+const Kernels kAVX2Kernels = {StringSearch::kAVX2, findCRLFAVX2, findCRLFCRLFAVX2};
+
+#endif  // STRING_SEARCH_X86
+
+const Kernels *kernelsFor(StringSearch::Impl impl) {
+    switch (impl) {
+#ifdef STRING_SEARCH_X86
+        case StringSearch::kAVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &kAVX2Kernels : NULL;
+        case StringSearch::kSSE2:
+            return &kSSE2Kernels;  // x86-64 的基线指令集
+#endif
+        case StringSearch::kScalar:
+            return &kScalarKernels;
+        default:
+            return NULL;
+    }
+}
+
+const Kernels *selectKernels() {
+    const Kernels *k = kernelsFor(StringSearch::kAVX2);
+    if (k == NULL) {
+        k = kernelsFor(StringSearch::kSSE2);
+    }
+    return k != NULL ? k : &kScalarKernels;
+}
+
+//!NOTE: 指针是常量初始化的，不依赖静态初始化顺序，其他全局对象的构造函数里也可以调用
+std::atomic<const Kernels *> g_kernels(NULL);
+
+inline const Kernels *kernels() {
+    const Kernels *k = g_kernels.load(std::memory_order_relaxed);
+    if (k == NULL) {
+        k = selectKernels();
+        g_kernels.store(k, std::memory_order_relaxed);
+    }
+    return k;
+}
+
+}  // namespace
+
+namespace StringSearch {
+
+const char *findChar(const char *begin, const char *end, char c) { return findCharScalar(begin, end, c); }
+
+const char *findCRLF(const char *begin, const char *end) { return kernels()->findCRLF(begin, end); }
+
+const char *findCRLFCRLF(const char *begin, const char *end) { return kernels()->findCRLFCRLF(begin, end); }
+
+Impl impl() { return kernels()->impl; }
+
+const char *implName(Impl impl) {
+    switch (impl) {
+        case kScalar:
+            return "scalar";
+        case kSSE2:
+            return "sse2";
+        case kAVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+bool supported(Impl impl) { return kernelsFor(impl) != NULL; }
+
+bool setImpl(Impl impl) {
+    const Kernels *k = kernelsFor(impl);
+    if (k == NULL) {
+        return false;
+    }
+    g_kernels.store(k, std::memory_order_relaxed);
+    return true;
+}
+
+}  // namespace StringSearch
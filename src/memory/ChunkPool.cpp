@@ -0,0 +1,286 @@
+#include "ChunkPool.h"
+
+#include "CurrentThread.h"
+#include "Logger.h"
+#include "RelaxedCounter.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <map>
+
+const size_t ChunkPool::kMinBlockSize;
+const size_t ChunkPool::kMaxBlockSize;
+const size_t ChunkPool::kDefaultSlabSize;
+const size_t ChunkPool::kHugepageSize;
+const size_t ChunkPool::kDefaultRetainBytes;
+const int ChunkPool::kTrimIntervalSeconds;
+
+// 申请一块按 size 对齐的匿名内存，2M 对齐的 slab 才能被透明大页完整覆盖
+static char *mapAligned(size_t size) {
+    void *p = ::mmap(nullptr, size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+    uintptr_t aligned = (addr + size - 1) & ~(static_cast<uintptr_t>(size) - 1);
+    if (aligned > addr) {
+        ::munmap(p, aligned - addr);
+    }
+    size_t tail = addr + size * 2 - (aligned + size);
+    if (tail > 0) {
+        ::munmap(reinterpret_cast<char *>(aligned + size), tail);
+    }
+    return reinterpret_cast<char *>(aligned);
+}
+
+ChunkPool::ChunkPool()
+    : ownerTid_(CurrentThread::tid())
+    , hugepage_(false)
+    , retainBytes_(kDefaultRetainBytes)
+    , freeBytes_(0)
+    , lastAllocations_(0)
+    , hasRemoteFrees_(false)
+    , reservedBytes_(0)
+    , inUseBytes_(0)
+    , heapBytes_(0)
+    , numSlabs_(0)
+    , numHugepageSlabs_(0)
+    , allocations_(0)
+    , deallocations_(0)
+    , remoteDeallocations_(0)
+    , slabReleases_(0)
+{
+    for (int i = 0; i < kNumClasses; ++i) {
+        freeLists_[i] = nullptr;
+    }
+}
+
+ChunkPool::~ChunkPool() {
+    for (const Slab &slab : slabs_) {
+        ::munmap(slab.base, slab.size);
+    }
+}
+
+bool ChunkPool::isOwnerThread() const { return CurrentThread::tid() == ownerTid_; }
+
+int ChunkPool::sizeClassOf(size_t size) {
+    int sizeClass = 0;
+    while (classSize(sizeClass) < size) {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
+char *ChunkPool::allocate(size_t size, size_t *capacity) {
+    relaxedAdd(allocations_, 1);
+
+    if (size > kMaxBlockSize) {  // 大块直接走堆
+        char *p = static_cast<char *>(::malloc(size));
+        if (p == nullptr) {
+            LOG_FATAL("ChunkPool::allocate - malloc %lu bytes error: %d", size, errno);
+        }
+        heapBytes_.fetch_add(size, std::memory_order_relaxed);
+        *capacity = size;
+        return p;
+    }
+
+    if (hasRemoteFrees_.load(std::memory_order_acquire)) {
+        drainRemoteFrees();
+    }
+
+    int sizeClass = sizeClassOf(size);
+    if (freeLists_[sizeClass] == nullptr) {
+        refill(sizeClass);
+    }
+
+    FreeNode *node = freeLists_[sizeClass];
+    freeLists_[sizeClass] = node->next;
+    *capacity = classSize(sizeClass);
+    freeBytes_ -= *capacity;
+    relaxedAdd(inUseBytes_, *capacity);
+    return reinterpret_cast<char *>(node);
+}
+
+void ChunkPool::deallocate(char *ptr, size_t capacity) {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (capacity > kMaxBlockSize) {  // 大块是堆上的内存
+        ::free(ptr);
+        heapBytes_.fetch_sub(capacity, std::memory_order_relaxed);
+        deallocations_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (!isOwnerThread()) {
+        {
+            std::unique_lock<std::mutex> lock(remoteMutex_);
+            remoteFrees_.push_back(std::make_pair(ptr, capacity));
+        }
+        hasRemoteFrees_.store(true, std::memory_order_release);
+        remoteDeallocations_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    push(sizeClassOf(capacity), ptr);
+    relaxedSub(inUseBytes_, capacity);
+    deallocations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ChunkPool::push(int sizeClass, char *ptr) {
+    FreeNode *node = reinterpret_cast<FreeNode *>(ptr);
+    node->next = freeLists_[sizeClass];
+    freeLists_[sizeClass] = node;
+    freeBytes_ += classSize(sizeClass);
+}
+
+void ChunkPool::drainRemoteFrees() {
+    std::vector<std::pair<char *, size_t>> frees;
+    {
+        std::unique_lock<std::mutex> lock(remoteMutex_);
+        frees.swap(remoteFrees_);
+        hasRemoteFrees_.store(false, std::memory_order_relaxed);
+    }
+    for (const auto &item : frees) {
+        push(sizeClassOf(item.second), item.first);
+        relaxedSub(inUseBytes_, item.second);
+    }
+    deallocations_.fetch_add(frees.size(), std::memory_order_relaxed);
+}
+
+void ChunkPool::refill(int sizeClass) {
+    Slab slab;
+    slab.size = hugepage_ ? kHugepageSize : kDefaultSlabSize;
+    slab.sizeClass = sizeClass;
+    slab.huge = false;
+    slab.base = nullptr;
+
+    if (hugepage_) {
+        // 优先使用预留的大页，没有预留时退化为普通内存 + 透明大页
+        void *p = ::mmap(nullptr, slab.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            slab.base = static_cast<char *>(p);
+            slab.huge = true;
+        }
+    }
+    if (slab.base == nullptr) {
+        slab.base = mapAligned(slab.size);
+        if (slab.base == nullptr) {
+            LOG_FATAL("ChunkPool::refill - mmap %lu bytes error: %d", slab.size, errno);
+        }
+        if (hugepage_) {
+            ::madvise(slab.base, slab.size, MADV_HUGEPAGE);
+        }
+    }
+
+    // 倒序入链表，这样分配出去的地址是递增的
+    const size_t blockSize = classSize(sizeClass);
+    for (size_t off = slab.size; off >= blockSize; off -= blockSize) {
+        push(sizeClass, slab.base + off - blockSize);
+    }
+
+    slabs_.push_back(slab);
+    relaxedAdd(reservedBytes_, slab.size);
+    relaxedAdd(numSlabs_, 1);
+    if (slab.huge) {
+        relaxedAdd(numHugepageSlabs_, 1);
+    }
+}
+
+size_t ChunkPool::trim(size_t retainBytes) {
+    if (hasRemoteFrees_.load(std::memory_order_acquire)) {
+        drainRemoteFrees();
+    }
+    if (freeBytes_ <= retainBytes) {
+        return 0;
+    }
+
+    // slab 起始地址 -> 下标，用来从空闲块地址找到所属 slab
+    std::map<char *, size_t> bases;
+    for (size_t i = 0; i < slabs_.size(); ++i) {
+        bases[slabs_[i].base] = i;
+    }
+    auto slabOf = [&bases](char *p) -> size_t {
+        auto it = bases.upper_bound(p);
+        return (--it)->second;
+    };
+
+    // 统计每个 slab 的空闲块数，全部空闲的 slab 才能释放
+    std::vector<size_t> freeBlocks(slabs_.size(), 0);
+    for (int i = 0; i < kNumClasses; ++i) {
+        for (FreeNode *node = freeLists_[i]; node != nullptr; node = node->next) {
+            ++freeBlocks[slabOf(reinterpret_cast<char *>(node))];
+        }
+    }
+
+    size_t released = 0;
+    std::vector<bool> victim(slabs_.size(), false);
+    std::vector<Slab> kept;
+    size_t numVictims = 0;
+    for (size_t i = 0; i < slabs_.size(); ++i) {
+        const Slab &slab = slabs_[i];
+        if (freeBytes_ - released > retainBytes && freeBlocks[i] == slab.size / classSize(slab.sizeClass)) {
+            victim[i] = true;
+            released += slab.size;
+            ++numVictims;
+        } else {
+            kept.push_back(slab);
+        }
+    }
+    if (numVictims == 0) {
+        return 0;
+    }
+
+    // 把属于被释放 slab 的空闲块从链表中摘掉
+    for (int i = 0; i < kNumClasses; ++i) {
+        FreeNode **link = &freeLists_[i];
+        while (*link != nullptr) {
+            if (victim[slabOf(reinterpret_cast<char *>(*link))]) {
+                *link = (*link)->next;
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < slabs_.size(); ++i) {
+        if (victim[i]) {
+            ::munmap(slabs_[i].base, slabs_[i].size);
+            if (slabs_[i].huge) {
+                relaxedSub(numHugepageSlabs_, 1);
+            }
+        }
+    }
+
+    slabs_.swap(kept);
+    freeBytes_ -= released;
+    relaxedSub(reservedBytes_, released);
+    relaxedSub(numSlabs_, numVictims);
+    relaxedAdd(slabReleases_, numVictims);
+
+    LOG_DEBUG("ChunkPool::trim - released %lu bytes, %lu slabs left", released, slabs_.size());
+    return released;
+}
+
+void ChunkPool::trimIfIdle() {
+    size_t allocations = allocations_.load(std::memory_order_relaxed);
+    if (allocations == lastAllocations_) {
+        trim(retainBytes_);
+    }
+    lastAllocations_ = allocations;
+}
+
+ChunkPoolStats ChunkPool::stats() const {
+    ChunkPoolStats s;
+    s.reservedBytes = reservedBytes_.load(std::memory_order_relaxed);
+    s.inUseBytes = inUseBytes_.load(std::memory_order_relaxed);
+    s.heapBytes = heapBytes_.load(std::memory_order_relaxed);
+    s.slabs = numSlabs_.load(std::memory_order_relaxed);
+    s.hugepageSlabs = numHugepageSlabs_.load(std::memory_order_relaxed);
+    s.allocations = allocations_.load(std::memory_order_relaxed);
+    s.deallocations = deallocations_.load(std::memory_order_relaxed);
+    s.remoteDeallocations = remoteDeallocations_.load(std::memory_order_relaxed);
+    s.slabReleases = slabReleases_.load(std::memory_order_relaxed);
+    return s;
+}
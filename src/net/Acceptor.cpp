@@ -1,9 +1,13 @@
 #include "Acceptor.h"
 
+#include "EventLoop.h"
 #include "InetAddress.h"
+#include "IoUringPoller.h"
 #include "Logger.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -20,7 +24,9 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
     : loop_(loop)
     , acceptSocket_(createNonblocking())  // socket
     , acceptChannel_(loop, acceptSocket_.fd())
-    , listening_(false) 
+    , listening_(false)
+    , uring_(nullptr)
+    , idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
     acceptSocket_.setReuseAddr(true);
     acceptSocket_.setReusePort(reuseport);
@@ -34,11 +40,21 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
 Acceptor::~Acceptor() {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (idleFd_ >= 0) {
+        ::close(idleFd_);
+    }
 }
 
 void Acceptor::listen() {
     listening_ = true;
     acceptSocket_.listen();         // listen
+    uring_ = loop_->completionPoller();
+    if (uring_ != nullptr) {
+        acceptChannel_.setCompletionCallback(std::bind(&Acceptor::handleAccept, this, std::placeholders::_1));
+        uring_->startAccept(&acceptChannel_);
+        return;
+    }
+    acceptChannel_.setEdgeTriggered(loop_->edgeTriggered());
 #ifdef CHANNELTYPE
     acceptChannel_.enableReading("acceptChannel"); // acceptChannel_ => Poller
 #else
@@ -47,19 +63,86 @@ void Acceptor::listen() {
 }
 
 // listenfd 有事件发生了，就是有新用户连接了
+//!NOTE: 边缘触发时一直 accept 到 EAGAIN，否则同一次事件里排队的其他连接要等到下一个新连接才会被处理
 void Acceptor::handleRead() {
-    InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
+    for (;;) {
+        InetAddress peerAddr;
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0) {
+            if (newConnectionCallback_) {  // 轮询找到 subLoop，唤醒分发当前的新客户端的 Channel
+                newConnectionCallback_(connfd, peerAddr);
+            } else {
+                ::close(connfd);
+            }
+        } else if ((errno == ECONNABORTED || errno == EINTR) && acceptChannel_.edgeTriggered()) {
+            continue;  // 对端在 accept 之前就断开了，队列里可能还有其他连接
+        } else if (errno == EMFILE || errno == ENFILE) {
+            LOG_ERROR("Acceptor::handleRead() sockfd reached limit! errno: %d", errno);
+            if (!discardPending()) {
+                return;
+            }
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("Acceptor::handleRead() accept error: %d", errno);
+            }
+            return;
+        }
+        if (!acceptChannel_.edgeTriggered()) {
+            return;
+        }
+    }
+}
+
+//!NOTE: multishot accept 不返回对端地址(多个结果共用一个 sockaddr 不安全)，用 getpeername 补上；
+// 出错终止之后立即重新提交，和水平触发的 listen fd 一样下一轮继续尝试；fd 用完时先丢弃一个排队的连接，否则会一直失败
+void Acceptor::handleAccept(Completion &completion) {
+    int connfd = completion.result;
     if (connfd >= 0) {
-        if (newConnectionCallback_) {  // 轮询找到 subLoop，唤醒分发当前的新客户端的 Channel
-            newConnectionCallback_(connfd, peerAddr);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        if (::getpeername(connfd, reinterpret_cast<sockaddr *>(&addr), &len) < 0) {
+            LOG_ERROR("Acceptor::handleAccept() getpeername error: %d", errno);
+        }
+        if (newConnectionCallback_) {
+            newConnectionCallback_(connfd, InetAddress(addr));
         } else {
             ::close(connfd);
         }
-    } else {
-        LOG_ERROR("Acceptor::handleRead() accept error: %d", errno);
-        if (errno == EMFILE) {
-            LOG_ERROR("Acceptor::handleRead() sockfd reached limit!");
+        return;
+    }
+    if (connfd == -ECANCELED) {
+        return;
+    }
+    LOG_ERROR("Acceptor::handleAccept() accept error: %d", -connfd);
+    if (connfd == -EMFILE || connfd == -ENFILE) {
+        LOG_ERROR("Acceptor::handleAccept() sockfd reached limit!");
+        discardPending();
+    }
+    if (!completion.more) {
+        uring_->startAccept(&acceptChannel_);
+    }
+}
+
+/**
+ * fd 用完时 accept 一直失败，连接留在队列里: 水平触发时 listen fd 一直可读，loop 空转；边缘触发时不会再有新的边沿，
+ * 排队的客户端一直挂起。先关掉预留的 fd 腾出一个位置，accept 之后立即关闭(客户端收到 FIN 而不是一直等待)，再重新预留
+ */
+bool Acceptor::discardPending() {
+    if (idleFd_ < 0) {  // 上一次没有重新预留成功
+        idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (idleFd_ < 0) {
+            return false;
         }
     }
+    ::close(idleFd_);
+    int connfd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if (connfd >= 0) {
+        ::close(connfd);
+    }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (idleFd_ < 0) {
+        LOG_ERROR("Acceptor::discardPending() reopen idle fd error: %d", errno);
+    }
+    return connfd >= 0;
 }
@@ -0,0 +1,68 @@
+#include "BroadcastGroup.h"
+
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+BroadcastGroup::BroadcastGroup() {}
+
+BroadcastGroup::~BroadcastGroup() {}
+
+BroadcastGroup::ShardPtr BroadcastGroup::getShard(EventLoop *loop) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ShardPtr &shard = shards_[loop];
+    if (!shard) {
+        shard = std::make_shared<Shard>(loop);
+    }
+    return shard;
+}
+
+void BroadcastGroup::add(const TcpConnectionPtr &conn) {
+    ShardPtr shard = getShard(conn->getLoop());
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    TcpConnection *key = conn.get();
+    shard->loop->runInLoop([shard, key, weakConn]() { shard->members[key] = weakConn; });
+}
+
+void BroadcastGroup::remove(const TcpConnectionPtr &conn) {
+    ShardPtr shard = getShard(conn->getLoop());
+    TcpConnection *key = conn.get();
+    shard->loop->runInLoop([shard, key]() { shard->members.erase(key); });
+}
+
+//!NOTE: 分片表只在加锁时复制出来，投递任务和发送都在锁外进行
+void BroadcastGroup::broadcast(const PayloadPtr &payload) {
+    if (!payload || payload->empty()) {
+        return;
+    }
+
+    std::vector<ShardPtr> shards;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        shards.reserve(shards_.size());
+        for (const auto &entry : shards_) {
+            shards.push_back(entry.second);
+        }
+    }
+
+    for (const ShardPtr &shard : shards) {
+        if (shard->loop->isInLoopThread()) {
+            sendToShard(shard, payload);
+        } else {
+            shard->loop->queueInLoop(std::bind(&BroadcastGroup::sendToShard, shard, payload));
+        }
+    }
+}
+
+void BroadcastGroup::sendToShard(const ShardPtr &shard, const PayloadPtr &payload) {
+    for (auto it = shard->members.begin(); it != shard->members.end();) {
+        TcpConnectionPtr conn = it->second.lock();
+        if (!conn) {
+            it = shard->members.erase(it);
+            continue;
+        }
+        if (conn->connected()) {
+            conn->send(payload);
+        }
+        ++it;
+    }
+}
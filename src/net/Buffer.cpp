@@ -1,10 +1,30 @@
 #include "Buffer.h"
 
+#include "ChunkPool.h"
+
 #include <errno.h>
+#include <string.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+const size_t Buffer::kChunkSize;
+const size_t Buffer::kExtraBufSize;
+const size_t Buffer::kMinReadHint;
+const size_t Buffer::kMaxReadHint;
+const size_t Buffer::kMaxRetainSize;
+
 const char Buffer::kCRLF[] = "\r\n";
+const char Buffer::kCRLFCRLF[] = "\r\n\r\n";
+const char Buffer::kEmpty[1] = {'\0'};
+char Buffer::emptyStorage_[Buffer::kCheapPrepend];
+
+// 一次 writev 最多携带的 chunk 数
+static const int kMaxWriteIovecs = 64;
+
+//!NOTE: readFd 的溢出区，每个 IO 线程一份，从不清零；readv 之后马上 append 进 Buffer，不会被重入
+static __thread char t_extrabuf[Buffer::kExtraBufSize];
 
 /**
  * !NOTE: 从 fd 读数据，相当于读到 buffer 的写缓冲区
@@ -12,7 +32,14 @@ const char Buffer::kCRLF[] = "\r\n";
  * Buffer 缓冲区是有大小的，但是从 fd 上读取数据的时候却不知道 tcp 数据最终的大小
  */
 ssize_t Buffer::readFd(int fd, int *saveErrno) {
-    char extrabuf[65536] = {0};  // 栈上分配的内存空间 64K
+    if (adaptiveRead_ && writableBytes() < readSizeHint_) {
+        ensureWritableBytes(readSizeHint_);
+    }
+    if (mode_ == kSegmented) {
+        return readFdSegmented(fd, saveErrno);
+    }
+
+    char *extrabuf = t_extrabuf;  // 线程共享的溢出区 64K
 
     struct iovec vec[2];  // iovec 结构体包含起始地址以及对应长度
 
@@ -21,30 +48,535 @@ ssize_t Buffer::readFd(int fd, int *saveErrno) {
     vec[0].iov_len = writable;
 
     vec[1].iov_base = extrabuf;
-    vec[2].iov_len = sizeof(extrabuf);
+    vec[1].iov_len = kExtraBufSize;
 
     // 相当于一次最多读 64K 的数据
-    const int iovcnt = (writable < sizeof(extrabuf)) ? 2 : 1;
-    const size_t n = ::readv(fd, vec, iovcnt);
+    const int iovcnt = (writable < kExtraBufSize) ? 2 : 1;
+    const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0) {
         *saveErrno = errno;
-    } else if (n <= writable) {  // buffer 可写缓冲区够存放
+        lastReadFilled_ = false;
+        return n;
+    }
+
+    const size_t offered = writable + (iovcnt == 2 ? kExtraBufSize : 0);
+    lastReadFilled_ = static_cast<size_t>(n) == offered;
+    if (static_cast<size_t>(n) <= writable) {  // buffer 可写缓冲区够存放
         writerIndex_ += n;
     } else {
         // buffer 可写缓冲区不够存放，extrabuf 写入了数据
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;
         append(extrabuf, n - writable);  // 从 writerIndex_ 开始写剩余的数据
     }
+    adjustReadHint(n);
     return n;
 }
 
+void Buffer::adjustReadHint(size_t n) {
+    if (!adaptiveRead_) {
+        return;
+    }
+    if (n >= readSizeHint_) {
+        readSizeHint_ = std::min(readSizeHint_ * 2, kMaxReadHint);
+        smallReads_ = 0;
+    } else if (n < readSizeHint_ / 2) {
+        if (++smallReads_ >= 2) {
+            readSizeHint_ = std::max(readSizeHint_ / 2, kMinReadHint);
+            smallReads_ = 0;
+        }
+    } else {
+        smallReads_ = 0;
+    }
+}
+
 Buffer::~Buffer() {}
 
+Buffer::Buffer(Buffer &&rhs)
+    : pool_()
+    , mode_(rhs.mode_)
+    , initialSize_(rhs.initialSize_)
+    , buffer_(0, nullptr)
+    , readerIndex_(kCheapPrepend)
+    , writerIndex_(kCheapPrepend)
+    , readable_(0)
+    , adaptiveRead_(false)
+    , readSizeHint_(kInitialSize)
+    , smallReads_(0)
+    , lastReadFilled_(false) {
+    *this = std::move(rhs);
+}
+
+// 先把自己的存储还给旧 pool，再接管 rhs 的 pool 和存储
+Buffer &Buffer::operator=(Buffer &&rhs) {
+    if (this != &rhs) {
+        buffer_.release();
+        chunks_.clear();
+        spare_.reset();
+        buffer_ = std::move(rhs.buffer_);
+        chunks_ = std::move(rhs.chunks_);
+        spare_ = std::move(rhs.spare_);
+        pool_ = std::move(rhs.pool_);
+        mode_ = rhs.mode_;
+        initialSize_ = rhs.initialSize_;
+        readerIndex_ = rhs.readerIndex_;
+        writerIndex_ = rhs.writerIndex_;
+        readable_ = rhs.readable_;
+        adaptiveRead_ = rhs.adaptiveRead_;
+        readSizeHint_ = rhs.readSizeHint_;
+        smallReads_ = rhs.smallReads_;
+        lastReadFilled_ = rhs.lastReadFilled_;
+        rhs.chunks_.clear();
+        rhs.readerIndex_ = kCheapPrepend;
+        rhs.writerIndex_ = kCheapPrepend;
+        rhs.readable_ = 0;
+    }
+    return *this;
+}
+
+Buffer::Block::Block(size_t size, ChunkPool *p) : data(nullptr), capacity(0), pool(nullptr) {
+    if (size == 0) {
+        return;
+    }
+    if (p != nullptr && p->isOwnerThread()) {
+        data = p->allocate(size, &capacity);
+        pool = p;
+    } else {
+        data = new char[size];
+        capacity = size;
+    }
+}
+
+Buffer::Block::Block(Block &&rhs) noexcept : data(rhs.data), capacity(rhs.capacity), pool(rhs.pool) {
+    rhs.data = nullptr;
+    rhs.capacity = 0;
+    rhs.pool = nullptr;
+}
+
+Buffer::Block &Buffer::Block::operator=(Block &&rhs) noexcept {
+    if (this != &rhs) {
+        release();
+        data = rhs.data;
+        capacity = rhs.capacity;
+        pool = rhs.pool;
+        rhs.data = nullptr;
+        rhs.capacity = 0;
+        rhs.pool = nullptr;
+    }
+    return *this;
+}
+
+// 归还给申请时的 pool，跨线程归还由 ChunkPool 自己处理
+void Buffer::Block::release() {
+    if (data == nullptr) {
+        return;
+    }
+    if (pool != nullptr) {
+        pool->deallocate(data, capacity);
+    } else {
+        delete[] data;
+    }
+    data = nullptr;
+    capacity = 0;
+    pool = nullptr;
+}
+
 //!NOTE: 向 fd 写数据，相当于就是从 buffer 读缓存区拿数据
 ssize_t Buffer::writeFd(int fd, int *saveErrno) {
+    if (mode_ == kSegmented) {
+        return writeFdSegmented(fd, saveErrno);
+    }
+
     ssize_t n = ::write(fd, peek(), readableBytes());
     if (n < 0) {
         *saveErrno = errno;
     }
     return n;
 }
+
+void Buffer::setMode(Mode mode) {
+    if (mode == mode_ || readableBytes() != 0) {
+        return;
+    }
+    if (mode == kSegmented) {
+        buffer_.release();
+    } else {
+        chunks_.clear();
+        spare_.reset();
+    }
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = kCheapPrepend;
+    readable_ = 0;
+    mode_ = mode;
+}
+
+void Buffer::setPool(const std::shared_ptr<ChunkPool> &pool) {
+    if (pool == pool_ || readableBytes() != 0) {
+        return;
+    }
+    buffer_.release();
+    chunks_.clear();
+    spare_.reset();
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = kCheapPrepend;
+    readable_ = 0;
+    pool_ = pool;
+}
+
+void Buffer::shrink(size_t reserve) {
+    spare_.reset();
+    if (readableBytes() == 0) {
+        buffer_.release();
+        chunks_.clear();
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend;
+        readable_ = 0;
+        readSizeHint_ = kInitialSize;  // 重新开始自适应，空闲之后的第一次读不需要大块空间
+        smallReads_ = 0;
+        return;
+    }
+    if (mode_ == kContiguous) {
+        size_t readable = readableBytes();
+        if (buffer_.capacity > kCheapPrepend + readable + reserve) {
+            Block block(kCheapPrepend + readable + reserve, pool_.get());
+            std::copy(begin() + readerIndex_, begin() + writerIndex_, block.data + kCheapPrepend);
+            buffer_ = std::move(block);
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = readerIndex_ + readable;
+        }
+    }
+}
+
+//!NOTE: 接管的内存前面没有预留 kCheapPrepend，prepend 时会按原来的方式腾出空间
+bool Buffer::adopt(char *data, size_t capacity, size_t len, ChunkPool *pool) {
+    if (pool == nullptr || pool != pool_.get()) {
+        return false;
+    }
+    if (mode_ == kContiguous) {
+        if (readableBytes() != 0) {
+            return false;
+        }
+        buffer_ = Block(data, capacity, pool);
+        readerIndex_ = 0;
+        writerIndex_ = len;
+        return true;
+    }
+    if (!chunks_.empty() && chunks_.back().readable() == 0) {
+        chunks_.pop_back();
+    }
+    chunks_.emplace_back(Block(data, capacity, pool), len);
+    readable_ += len;
+    return true;
+}
+
+size_t Buffer::footprint() const {
+    size_t bytes = buffer_.capacity;
+    for (const Chunk &chunk : chunks_) {
+        bytes += chunk.block.capacity;
+    }
+    if (spare_) {
+        bytes += spare_->block.capacity;
+    }
+    return bytes;
+}
+
+const char *Buffer::pullup(size_t len) const {
+    len = std::min(len, readableBytes());
+    if (mode_ == kContiguous || len <= contiguousBytes()) {
+        return peek();
+    }
+
+    // 新建一个能容纳 len 字节的 chunk 放到最前面，把前 len 个字节搬过去，后面的数据保持原位
+    Chunk head(std::max(kChunkSize, len + kCheapPrepend), pool_.get());
+    size_t left = len;
+    while (left > 0) {
+        Chunk &front = chunks_.front();
+        size_t n = std::min(left, front.readable());
+        memcpy(head.beginWrite(), front.peek(), n);
+        head.writeIndex += n;
+        front.readIndex += n;
+        left -= n;
+        if (front.readable() == 0) {
+            chunks_.pop_front();
+        }
+    }
+    chunks_.push_front(std::move(head));
+    return peek();
+}
+
+void Buffer::prepend(const void *data, size_t len) {
+    if (mode_ == kContiguous) {
+        if (buffer_.data == nullptr) {
+            makeSpace(kInitialSize);  // 延迟分配时 begin() 指向共享的 emptyStorage_，不能写
+        }
+        if (len > readerIndex_) {
+            // prepend 空间不够，把可读数据整体后移
+            ensureWritableBytes(len);
+            size_t shift = len - std::min(len, readerIndex_);
+            memmove(begin() + readerIndex_ + shift, begin() + readerIndex_, readableBytes());
+            readerIndex_ += shift;
+            writerIndex_ += shift;
+        }
+        readerIndex_ -= len;
+        memcpy(begin() + readerIndex_, data, len);
+        return;
+    }
+
+    if (!chunks_.empty() && len <= chunks_.front().readIndex) {
+        Chunk &front = chunks_.front();
+        front.readIndex -= len;
+        memcpy(front.block.data + front.readIndex, data, len);
+    } else {
+        // 头部 chunk 前面放不下，在最前面插入一个新 chunk
+        Chunk head(std::max(kChunkSize, len + kCheapPrepend), pool_.get());
+        memcpy(head.beginWrite(), data, len);
+        head.writeIndex += len;
+        chunks_.push_front(std::move(head));
+    }
+    readable_ += len;
+}
+
+bool Buffer::peekAt(size_t offset, void *out, size_t len) const {
+    if (offset > readableBytes() || len > readableBytes() - offset) {
+        return false;
+    }
+    char *dst = static_cast<char *>(out);
+    if (mode_ == kContiguous) {
+        memcpy(dst, peek() + offset, len);
+        return true;
+    }
+    for (const Chunk &chunk : chunks_) {
+        if (len == 0) {
+            break;
+        }
+        size_t readable = chunk.readable();
+        if (offset >= readable) {
+            offset -= readable;
+            continue;
+        }
+        size_t n = std::min(len, readable - offset);
+        memcpy(dst, chunk.peek() + offset, n);
+        dst += n;
+        len -= n;
+        offset = 0;
+    }
+    return true;
+}
+
+void Buffer::copyOut(std::string *out, size_t len) const {
+    len = std::min(len, readableBytes());
+    out->reserve(out->size() + len);
+    if (mode_ == kContiguous) {
+        out->append(peek(), len);
+        return;
+    }
+    for (const Chunk &chunk : chunks_) {
+        if (len == 0) {
+            break;
+        }
+        size_t n = std::min(len, chunk.readable());
+        out->append(chunk.peek(), n);
+        len -= n;
+    }
+}
+
+void Buffer::appendSegmented(const char *data, size_t len) {
+    while (len > 0) {
+        if (chunks_.empty() || chunks_.back().writable() == 0) {
+            chunks_.emplace_back(kChunkSize, pool_.get());
+        }
+        Chunk &tail = chunks_.back();
+        size_t n = std::min(len, tail.writable());
+        memcpy(tail.beginWrite(), data, n);
+        tail.writeIndex += n;
+        readable_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void Buffer::retrieveSegmented(size_t len) {
+    readable_ -= len;
+    while (len > 0) {
+        Chunk &front = chunks_.front();
+        if (len < front.readable()) {
+            front.readIndex += len;
+            break;
+        }
+        len -= front.readable();
+        chunks_.pop_front();
+    }
+}
+
+void Buffer::retrieveAllSegmented() {
+    // 保留尾部 chunk 以便下一次写入复用，其余全部释放
+    while (chunks_.size() > 1) {
+        chunks_.pop_front();
+    }
+    if (!chunks_.empty()) {
+        chunks_.front().readIndex = kCheapPrepend;
+        chunks_.front().writeIndex = kCheapPrepend;
+    }
+    readable_ = 0;
+}
+
+// 在 chunk 链中查找 "\r\n"(len = 2) 或 "\r\n\r\n"(len = 4)，找到后把 [0, pos + len) pullup 到 peek() 处
+const char *Buffer::findDelimiterSegmented(const char *delim, size_t len) const {
+    size_t offset = 0;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        const Chunk &chunk = chunks_[i];
+        const char *begin = chunk.peek();
+        const char *end = begin + chunk.readable();
+        const char *p = len == 2 ? StringSearch::findCRLF(begin, end) : StringSearch::findCRLFCRLF(begin, end);
+        if (p == NULL) {
+            // 分隔符可能正好被 chunk 边界拆开，检查最后 len - 1 个起点
+            size_t tail = std::min(chunk.readable(), len - 1);
+            for (const char *q = end - tail; q < end; ++q) {
+                if (*q == '\r' && matchAt(i, q - begin, delim, len)) {
+                    p = q;
+                    break;
+                }
+            }
+        }
+        if (p != NULL) {
+            size_t pos = offset + (p - begin);
+            return pullup(pos + len) + pos;
+        }
+        offset += chunk.readable();
+    }
+    return NULL;
+}
+
+// chunks_[chunk] 的第 offset 个可读字节开始，跨 chunk 比较 len 个字节，数据不够时返回 false
+bool Buffer::matchAt(size_t chunk, size_t offset, const char *delim, size_t len) const {
+    size_t matched = 0;
+    while (matched < len && chunk < chunks_.size()) {
+        const Chunk &c = chunks_[chunk];
+        while (matched < len && offset < c.readable()) {
+            if (c.peek()[offset] != delim[matched]) {
+                return false;
+            }
+            ++offset;
+            ++matched;
+        }
+        ++chunk;
+        offset = 0;
+    }
+    return matched == len;
+}
+
+/**
+ * 分段模式: 直接 readv 到尾部 chunk 的空闲区和一个预留的 chunk，
+ * 剩余部分才落到栈上的 extrabuf，再以追加 chunk 的方式保存
+ */
+ssize_t Buffer::readFdSegmented(int fd, int *saveErrno) {
+    char *extrabuf = t_extrabuf;
+
+    if (!chunks_.empty() && chunks_.back().readable() == 0) {
+        chunks_.back().readIndex = kCheapPrepend;  // 空的尾部 chunk 直接复位
+        chunks_.back().writeIndex = kCheapPrepend;
+    }
+    if (!spare_) {
+        spare_.reset(new Chunk(kChunkSize, pool_.get()));
+    }
+
+    struct iovec vec[3];
+    int iovcnt = 0;
+    const size_t writable = writableBytes();
+    if (writable > 0) {
+        vec[iovcnt].iov_base = chunks_.back().beginWrite();
+        vec[iovcnt].iov_len = writable;
+        ++iovcnt;
+    }
+    const size_t spareLen = spare_->writable();
+    vec[iovcnt].iov_base = spare_->beginWrite();
+    vec[iovcnt].iov_len = spareLen;
+    ++iovcnt;
+    vec[iovcnt].iov_base = extrabuf;
+    vec[iovcnt].iov_len = kExtraBufSize;
+    ++iovcnt;
+
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0) {
+        *saveErrno = errno;
+        lastReadFilled_ = false;
+        return n;
+    }
+    lastReadFilled_ = static_cast<size_t>(n) == writable + spareLen + kExtraBufSize;
+
+    size_t left = static_cast<size_t>(n);
+    size_t m = std::min(left, writable);
+    if (m > 0) {
+        chunks_.back().writeIndex += m;
+        readable_ += m;
+        left -= m;
+    }
+    if (left > 0) {
+        m = std::min(left, spareLen);
+        spare_->writeIndex += m;
+        readable_ += m;
+        left -= m;
+        if (!chunks_.empty() && chunks_.back().readable() == 0) {
+            chunks_.pop_back();  // 不让空 chunk 挡在 peek() 前面
+        }
+        chunks_.push_back(std::move(*spare_));
+        spare_.reset();
+    }
+    if (left > 0) {
+        appendSegmented(extrabuf, left);
+    }
+    adjustReadHint(n);
+    return n;
+}
+
+int Buffer::peekIovecs(size_t offset, size_t len, struct iovec *vec, int maxIovecs) const {
+    if (maxIovecs <= 0 || offset >= readableBytes()) {
+        return 0;
+    }
+    len = std::min(len, readableBytes() - offset);
+    if (mode_ == kContiguous) {
+        vec[0].iov_base = const_cast<char *>(peek() + offset);
+        vec[0].iov_len = len;
+        return 1;
+    }
+
+    int iovcnt = 0;
+    for (const Chunk &chunk : chunks_) {
+        if (len == 0 || iovcnt == maxIovecs) {
+            break;
+        }
+        if (offset >= chunk.readable()) {
+            offset -= chunk.readable();
+            continue;
+        }
+        size_t n = std::min(len, chunk.readable() - offset);
+        vec[iovcnt].iov_base = const_cast<char *>(chunk.peek() + offset);
+        vec[iovcnt].iov_len = n;
+        ++iovcnt;
+        offset = 0;
+        len -= n;
+    }
+    return iovcnt;
+}
+
+// 分段模式: 一次 writev 把多个 chunk 写出去，调用者随后 retrieve(n)
+ssize_t Buffer::writeFdSegmented(int fd, int *saveErrno) {
+    struct iovec vec[kMaxWriteIovecs];
+    int iovcnt = 0;
+    for (const Chunk &chunk : chunks_) {
+        if (iovcnt == kMaxWriteIovecs) {
+            break;
+        }
+        if (chunk.readable() == 0) {
+            continue;
+        }
+        vec[iovcnt].iov_base = const_cast<char *>(chunk.peek());
+        vec[iovcnt].iov_len = chunk.readable();
+        ++iovcnt;
+    }
+
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0) {
+        *saveErrno = errno;
+    }
+    return n;
+}
@@ -8,6 +8,7 @@
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI; // EPOLLPRI receive these urgent data
 const int Channel::kWriteEvent = EPOLLOUT;
+const int Channel::kEdgeEvents = EPOLLET | EPOLLRDHUP;
 
 // 指定 loop 和 fd 初始化 channel
 Channel::Channel(EventLoop *loop, int fd) 
@@ -15,7 +16,8 @@ Channel::Channel(EventLoop *loop, int fd)
     , fd_(fd)
     , events_(0)
     , revents_(0)
-    , index_(-1)
+    , registeredEvents_(kNoneEvent)
+    , edgeTriggered_(false)
     , tied_(false) {}
 
 Channel::~Channel() {
@@ -34,19 +36,49 @@ void Channel::tie(const std::shared_ptr<void> &obj) {
  * 当改变 channel 所表示 fd 的 events 事件之后，update 负责在 poller 里面更改 fd 相应的事件 epoll_ctl
  * EventLoop ==> ChannelList + Poller
  */
+//!NOTE: 边缘触发时读写开关不改变 pollEvents()，这里直接返回，不调用 epoll_ctl
 void Channel::update() {
+    if (edgeTriggered_ && pollEvents() == registeredEvents_) {
+        return;
+    }
+    registeredEvents_ = pollEvents();
     // 通过 channel 所属的 EventLoop，调用 poller 的相应方法，注册 fd 的 events 事件
     loop_->updateChannel(this);
 }
 
 // DEBUG 使用，查看 channel 具体类型信息
 void Channel::update(const std::string &type) {
+    if (edgeTriggered_ && pollEvents() == registeredEvents_) {
+        return;
+    }
+    registeredEvents_ = pollEvents();
     // 通过 channel 所属的 EventLoop，调用 poller 的相应方法，注册 fd 的 events 事件
     loop_->updateChannel(this, type);
 }
 
 // 在 channel 所属的 EventLoop 中把当前的 channel 删除掉
-void Channel::remove() { loop_->removeChannel(this); }
+void Channel::remove() {
+    registeredEvents_ = kNoneEvent;
+    loop_->removeChannel(this);
+}
+
+void Channel::setEdgeTriggered(bool on) {
+    if (edgeTriggered_ == on) {
+        return;
+    }
+    edgeTriggered_ = on;
+    if (registeredEvents_ != kNoneEvent) {
+        update();  // 已经注册过，EPOLL_CTL_MOD 换成新的触发方式
+    }
+}
+
+// 边缘触发: 只要还关注任何事件，就注册读、写(有写回调时)和对端关闭，开关读写不需要 epoll_ctl
+int Channel::pollEvents() const {
+    if (!edgeTriggered_ || events_ == kNoneEvent) {
+        return events_;
+    }
+    return kReadEvent | kEdgeEvents | (writeCallback_ ? kWriteEvent : kNoneEvent);
+}
 
 // fd 得到 poller 通知之后处理事件
 void Channel::handleEvent(Timestamp receiveTime) {
@@ -61,9 +93,33 @@ void Channel::handleEvent(Timestamp receiveTime) {
     }
 }
 
+void Channel::handleCompletion(Completion &completion) {
+    if (!completionCallback_) {
+        return;
+    }
+    if (tied_) {
+        std::shared_ptr<void> guard = tie_.lock();
+        if (guard) {
+            completionCallback_(completion);
+        }
+    } else {
+        completionCallback_(completion);
+    }
+}
+
 // 根据 poller 通知的 channel 发生的具体事件，由 channel 负责调用具体的回调操作
 void Channel::handleEventWithGuard(Timestamp receiveTime) {
-    LOG_INFO("Channel::handleEventWithGuard - channel handleEvent revents: %d", revents_);
+    LOG_DEBUG("Channel::handleEventWithGuard - channel handleEvent revents: %d", revents_);
+
+    //!NOTE: 边缘触发时读写事件一直注册着，按 events_ 过滤掉暂时不关注的
+    if (edgeTriggered_) {
+        if (!isReading()) {
+            revents_ &= ~(kReadEvent | EPOLLRDHUP);
+        }
+        if (!isWriting()) {
+            revents_ &= ~kWriteEvent;
+        }
+    }
 
     // 异常
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) {
@@ -72,15 +128,15 @@ void Channel::handleEventWithGuard(Timestamp receiveTime) {
         }
     }
 
-    // 错误
+    // 错误，也包括 error queue 上的 MSG_ZEROCOPY 完成通知，由 errorCallback_ 读取并区分
     if (revents_ & EPOLLERR) {
         if (errorCallback_) {
             errorCallback_();
         }
     }
 
-    // 读事件
-    if (revents_ & (EPOLLIN | EPOLLPRI)) {
+    // 读事件，对端关闭(EPOLLRDHUP)也交给读回调，读到 0 时关闭
+    if (revents_ & (EPOLLIN | EPOLLPRI | EPOLLRDHUP)) {
         if (readCallback_) {
             readCallback_(receiveTime);
         }
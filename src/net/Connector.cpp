@@ -0,0 +1,89 @@
+#include "Connector.h"
+
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr) : loop_(loop), serverAddr_(serverAddr) {}
+
+Connector::~Connector() {}
+
+void Connector::start() {
+    self_ = shared_from_this();
+    loop_->runInLoop(std::bind(&Connector::startInLoop, this));
+}
+
+void Connector::startInLoop() {
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        LOG_ERROR("Connector::startInLoop - socket error: %d", errno);
+        finish(-1, errno);
+        return;
+    }
+
+    int ret = ::connect(sockfd, (const sockaddr *)serverAddr_.getSockAddr(), sizeof(sockaddr_in));
+    int savedErrno = (ret == 0) ? 0 : errno;
+    if (savedErrno == 0) {
+        finish(sockfd, 0);
+    } else if (savedErrno == EINPROGRESS || savedErrno == EINTR) {
+        // 连接建立之后 socket 变为可写，由 handleWrite 检查结果
+        channel_.reset(new Channel(loop_, sockfd));
+        channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+        channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+        channel_->tie(shared_from_this());
+        channel_->enableWriting();
+    } else {
+        LOG_ERROR("Connector::startInLoop - connect %s error: %d", serverAddr_.toIpPort().c_str(), savedErrno);
+        ::close(sockfd);
+        finish(-1, savedErrno);
+    }
+}
+
+void Connector::handleWrite() {
+    if (channel_->isNoneEvent()) {  // 同一次事件中 EPOLLERR 已经处理过
+        return;
+    }
+    int sockfd = channel_->fd();
+    channel_->disableAll();
+    channel_->remove();
+
+    int optval = 0;
+    socklen_t optlen = sizeof(optval);
+    int err = 0;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
+        err = errno;
+    } else {
+        err = optval;
+    }
+
+    if (err != 0) {
+        LOG_ERROR("Connector::handleWrite - connect %s SO_ERROR = %d", serverAddr_.toIpPort().c_str(), err);
+        ::close(sockfd);
+        finish(-1, err);
+    } else {
+        finish(sockfd, 0);
+    }
+}
+
+void Connector::handleError() { handleWrite(); }
+
+void Connector::finish(int sockfd, int err) {
+    if (sockfd >= 0) {
+        if (newConnectionCallback_) {
+            newConnectionCallback_(sockfd);
+        } else {
+            ::close(sockfd);
+        }
+    } else if (errorCallback_) {
+        errorCallback_(err);
+    }
+
+    //!NOTE: 可能正处在 channel_ 的事件回调中，不能立刻析构，交给 loop 在本轮事件处理完之后释放
+    std::shared_ptr<Connector> self;
+    self.swap(self_);
+    loop_->queueInLoop([self]() {});
+}
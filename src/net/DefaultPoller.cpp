@@ -1,11 +1,41 @@
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "PollPoller.h"
 #include "Poller.h"
 
+#include <atomic>
 #include <stdlib.h>
 
+namespace {
+const int kBackendFromEnv = -1;
+std::atomic<int> g_defaultBackend(kBackendFromEnv);
+}  // namespace
+
+void Poller::setDefaultBackend(Backend backend) { g_defaultBackend.store(backend); }
+
+Poller::Backend Poller::defaultBackend() {
+    int backend = g_defaultBackend.load();
+    if (backend == kBackendFromEnv) {
+        if (::getenv("MUDUO_USE_IO_URING")) {
+            return kIoUring;
+        }
+        return ::getenv("MUDUO_USE_POLL") ? kPoll : kEpoll;
+    }
+    return static_cast<Backend>(backend);
+}
+
 Poller *Poller::newDefaultPoller(EventLoop *loop) {
-    if (::getenv("MUDUO_USE_POLL")) {
-        return nullptr;  // 生成 poller 实例，这里先不考虑 poll
+    Backend backend = defaultBackend();
+    if (backend == kIoUring) {
+        Poller *poller = IoUringPoller::create(loop);
+        if (poller != nullptr) {
+            return poller;
+        }
+        LOG_INFO("Poller::newDefaultPoller - io_uring not available, fall back to epoll");
+    }
+    if (backend == kPoll) {
+        return new PollPoller(loop);  // 生成 poller 实例
     } else {
         return new EPollPoller(loop);  // 生成 epoller 实例
     }
@@ -5,16 +5,18 @@
 
 #include <errno.h>
 #include <strings.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
-const int kNew = -1;     // channel 未添加到 poller 中，channel 的成员 index = -1
-const int kAdded = 1;    // channel 已添加到 poller 中
-const int kDeleted = 2;  // channel 被 poller 删除
-
 EPollPoller::EPollPoller(EventLoop *loop)
     : Poller(loop)
     , epollfd_(::epoll_create1(EPOLL_CLOEXEC))  //!NOTE: EPOLL_CLOEXEC 表示子进程不会继承父进程的 fd
     , events_(kInitEventListSize)               // vector<epoll_event>
+#ifdef SYS_epoll_pwait2
+    , hasPwait2_(true)
+#else
+    , hasPwait2_(false)
+#endif
 {
     if (epollfd_ < 0) {
         LOG_FATAL("EPollPoller::EPollPoller - epoll_create1 error: %d", errno);
@@ -29,18 +31,40 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
     LOG_DEBUG("EPollPoller::poll - fd total count: %lu", activeChannels->size());
 
     int numEvents = ::epoll_wait(epollfd_, &(*events_.begin()), static_cast<int>(events_.size()), timeoutMs);
-    int savedErrno = errno;  // 防止多线程改变 errno
+    return handleEvents(numEvents, errno, activeChannels);  //!NOTE: 立即保存 errno，防止后面的调用改变它
+}
+
+//!NOTE: 直接走系统调用，不依赖 glibc 是否提供 epoll_pwait2 包装(glibc 2.35+，内核 5.11+)
+Timestamp EPollPoller::pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels) {
+#ifdef SYS_epoll_pwait2
+    if (hasPwait2_) {
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(timeoutUs / Timestamp::kMicroSecondsPerSecond);
+        ts.tv_nsec = static_cast<long>((timeoutUs % Timestamp::kMicroSecondsPerSecond) * 1000);
+        int numEvents = static_cast<int>(::syscall(SYS_epoll_pwait2, epollfd_, &(*events_.begin()),
+                                                   static_cast<int>(events_.size()), &ts, nullptr, 0));
+        if (numEvents >= 0 || errno != ENOSYS) {
+            return handleEvents(numEvents, errno, activeChannels);
+        }
+        LOG_INFO("EPollPoller::pollMicroseconds - epoll_pwait2 not supported, fall back to epoll_wait");
+        hasPwait2_ = false;
+    }
+#endif
+    return Poller::pollMicroseconds(timeoutUs, activeChannels);
+}
+
+Timestamp EPollPoller::handleEvents(int numEvents, int savedErrno, ChannelList *activeChannels) {
     Timestamp now(Timestamp::now());
 
     if (numEvents > 0) {  // 监听到事件
-        LOG_INFO("EPollPoller::poll - %d events happened", numEvents);
+        LOG_DEBUG("EPollPoller::poll - %d events happened", numEvents);
         fillActiveChannels(numEvents, activeChannels);
 
         if (numEvents == events_.size()) {  // vector EventList 所有，需要扩容
             events_.resize(events_.size() * 2);
         }
     } else if (numEvents == 0) {  // 超时
-        LOG_DEBUG("EPollPoller::poll - %dms timeout!", timeoutMs);
+        LOG_DEBUG("EPollPoller::poll - timeout!");
     } else {  // 错误
         if (savedErrno != EINTR) { // 外部中断还需要继续处理
             errno = savedErrno;
@@ -61,89 +85,36 @@ void EPollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels)
     }
 }
 
-/**
- * 调用关系
- * [Channel] update/remove -> [EventLoop] updateChannel/removeChannel -> [EPollPoller] updateChannel/removeChannel
- *
- *           EventLoop
- *  ChannelList     Poller
- *                  ChannelMap <fd, channel*>
- */
-void EPollPoller::updateChannel(Channel *channel) {
-    const int index = channel->index();
-    LOG_INFO("EPollPoller::updateChannel - fd = %d, events = %d, index = %d", channel->fd(), channel->events(), index);
-
-    // 理解 kNew, kAdded, kDeleted 之间的逻辑
-    if (index == kNew || index == kDeleted) {
-        if (index == kNew) {
-            int fd = channel->fd();
-            channels_[fd] = channel;
-        }
-
-        channel->set_index(kAdded);
-        update(EPOLL_CTL_ADD, channel);
-    } else {  // channel 已经在 poller 上注册过了
-        int fd = channel->fd();
-        if (channel->isNoneEvent()) {  // 注册过但是不关心了需要删除
-            update(EPOLL_CTL_DEL, channel);
-            channel->set_index(kDeleted);
-        } else {  // 已经注册并需要修改的情况
-            update(EPOLL_CTL_MOD, channel);
-        }
-    }
-}
-
-// DEBUG 使用，查看具体的 Channel 信息
-void EPollPoller::updateChannel(Channel *channel, const std::string &type) {
-    const int index = channel->index();
-    LOG_INFO("EPollPoller::updateChannel - fd = %d, events = %d, index = %d for %s", channel->fd(), channel->events(), index, type.c_str());
-
-    // 理解 kNew, kAdded, kDeleted 之间的逻辑
-    if (index == kNew || index == kDeleted) {
-        if (index == kNew) {
-            int fd = channel->fd();
-            channels_[fd] = channel;
-        }
-
-        channel->set_index(kAdded);
-        update(EPOLL_CTL_ADD, channel);
-    } else {  // channel 已经在 poller 上注册过了
-        int fd = channel->fd();
-        if (channel->isNoneEvent()) {  // 注册过但是不关心了需要删除
-            update(EPOLL_CTL_DEL, channel);
-            channel->set_index(kDeleted);
-        } else {  // 已经注册并需要修改的情况
-            update(EPOLL_CTL_MOD, channel);
+// 理解 kNew, kAdded, kDeleted 之间的逻辑: 按 channel 当前关注的事件和内核中已注册的事件决定 ADD/MOD/DEL，或者什么都不做
+void EPollPoller::commit(ChannelSlot *s) {
+    Channel *channel = s->channel;
+    if (s->state != kAdded) {
+        if (!channel->isNoneEvent()) {
+            s->state = kAdded;
+            update(EPOLL_CTL_ADD, channel, s);
         }
+    } else if (channel->isNoneEvent()) {  // 注册过但是不关心了需要删除
+        update(EPOLL_CTL_DEL, channel, s);
+        s->state = kDeleted;
+    } else if (static_cast<uint32_t>(channel->pollEvents()) != s->events) {  // 已经注册并需要修改的情况，事件没变时不调用 epoll_ctl
+        update(EPOLL_CTL_MOD, channel, s);
     }
 }
 
-// 从 Poller 中删除 channel
-void EPollPoller::removeChannel(Channel *channel) {
-    int fd = channel->fd();
-    channels_.erase(fd);
-
-    LOG_INFO("EPollPoller::removeChannel - fd = %d", fd);
-
-    int index = channel->index(); // 获取 channel 的状态
-    if (index == kAdded) {
-        update(EPOLL_CTL_DEL, channel);
-    }
-
-    channel->set_index(kNew);
-}
+void EPollPoller::unregister(ChannelSlot *s) { update(EPOLL_CTL_DEL, s->channel, s); }
 
 // 更新 channel 通道 epoll_ctl add/mod/del
-void EPollPoller::update(int operation, Channel *channel) {
+void EPollPoller::update(int operation, Channel *channel, ChannelSlot *s) {
     int fd = channel->fd();
 
     epoll_event event;
     bzero(&event, sizeof(event));
 
-    event.events = channel->events();
+    event.events = channel->pollEvents();
     event.data.fd = fd;
     event.data.ptr = channel;  // event.data 是联合体，注意这里 ptr 是 void* 类型，之间通常使用的是 fd
 
+    updateSyscalls_.fetch_add(1, std::memory_order_relaxed);
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0) {
         if (operation == EPOLL_CTL_DEL) {
             LOG_ERROR("EPollPoller::update - epoll_ctl del error: %d", errno);
@@ -151,4 +122,5 @@ void EPollPoller::update(int operation, Channel *channel) {
             LOG_FATAL("EPollPoller::update - epoll_ctl add/mod error: %d", errno); // add/mod 失败是不能接受的
         }
     }
+    s->events = operation == EPOLL_CTL_DEL ? 0 : event.events;
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "EventLoop.h"
 
 #include "Channel.h"
+#include "ChunkPool.h"
+#include "IoUringPoller.h"
 #include "Logger.h"
+#include "NodeCache.h"
 #include "Poller.h"
 
 #include <errno.h>
@@ -13,6 +16,8 @@ __thread EventLoop *t_loopInThisThread = nullptr;
 // 定义默认的 Poller IO 复用接口的超时时间 10s
 const int kPollTimeMs = 10000;
 
+const size_t kInitActiveChannels = 16;
+
 // 创建 wakeupfd，用来 notify 唤醒 subReactor 处理新来的 channel
 int createEventfd() {
     int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -29,8 +34,18 @@ EventLoop::EventLoop()
     , threadId_(CurrentThread::tid())
     , poller_(Poller::newDefaultPoller(this))
     , timerQueue_(new TimerQueue(this))
+    , chunkPool_(std::make_shared<ChunkPool>())
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , sleeping_(false)
+    , wakeupPending_(false)
+    , wakeups_(0)
+    , suppressedWakeups_(0)
+    , edgeTriggered_(false)
+    , completionPoller_(nullptr)
+    , spinHits_(0)
+    , spinBlocks_(0)
+    , spinPolls_(0)
 // , currentActivateChannels_(nullptr)
 {
     LOG_DEBUG("EventLoop::EventLoop() - created %p in thread %d", this, threadId_);
@@ -40,6 +55,9 @@ EventLoop::EventLoop()
         t_loopInThisThread = this;
     }
 
+    // 活跃 channel 列表每轮 clear 复用容量，预留一些，避免 loop 运行中第一次有多个活跃 channel 时扩容
+    activateChannels_.reserve(kInitActiveChannels);
+
     // 设置 wakeupfd 的事件类型以及发生事件之后的回调操作
     //!NOTE: 注意 bind 和 callback 的使用
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
@@ -50,9 +68,21 @@ EventLoop::EventLoop()
 #else
     wakeupChannel_->enableReading();
 #endif
+
+    // 定期把长时间空闲的 slab 还给系统
+    std::weak_ptr<ChunkPool> weakPool(chunkPool_);
+    runEvery(ChunkPool::kTrimIntervalSeconds, [weakPool]() {
+        std::shared_ptr<ChunkPool> pool(weakPool.lock());
+        if (pool) {
+            pool->trimIfIdle();
+        }
+    });
 }
 
 EventLoop::~EventLoop() {
+    // 没来得及执行的回调直接释放
+    while (pendingFunctors_.consumeAll([](PendingFunctor *task) { delete task; }) > 0) {
+    }
     wakeupChannel_->disableAll();
     wakeupChannel_->remove();
     ::close(wakeupFd_);
@@ -70,12 +100,43 @@ void EventLoop::loop() {
         // 首先清空 channels
         activateChannels_.clear();
 
+        // 上一轮积累的注册变化在 poll 之前一次提交(只在延迟模式下有)
+        poller_->flushUpdates();
+
+        // 忙等期间不置 sleeping_，投递方不会写 eventfd，每次轮询自己检查队列
+        int64_t pollStart = LoopStats::nowNanos();
+        if (busyPoll_.spinMicroseconds > 0 && spinPoll()) {
+            handleActiveChannels(pollStart);
+            if (timerQueue_->mode() == TimerQueue::kPollTimeout) {
+                timerQueue_->runExpired();
+            }
+            doPendingFunctors();
+            continue;
+        }
+
+        //!NOTE: 先声明要睡眠再检查队列和 quit_，和 wakeup() 的 "先入队再检查 sleeping_" 配对；
+        // 已经有回调(包括 loop 自己在回调中投递的)时不阻塞，投递方也就不需要写 eventfd
+        sleeping_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool busy = quit_ || !pendingFunctors_.empty();
+
         // 监听两类 fd，一种是 client 的 fd，一种是 wakeupfd
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activateChannels_);
+        if (timerQueue_->mode() == TimerQueue::kPollTimeout) {
+            // 在 loop 线程中添加的定时器此时已经在 timers_ 中，其他线程添加的定时器通过回调队列唤醒 loop 之后重新计算
+            int64_t timeoutUs = busy ? 0 : timerQueue_->nextTimeoutUs(Timestamp::now(), kPollTimeMs * 1000LL);
+            pollReturnTime_ = poller_->pollMicroseconds(timeoutUs, &activateChannels_);
+        } else {
+            pollReturnTime_ = poller_->poll(busy ? 0 : kPollTimeMs, &activateChannels_);
+        }
+        sleeping_.store(false);
+        wakeupPending_.store(false);
 
-        for (Channel *channel : activateChannels_) {
-            // poller 监听哪些 channel 发生事件了，然后上报给 EventLoop，通知 channel 处理相应的事件
-            channel->handleEvent(pollReturnTime_);
+        // poller 监听哪些 channel 发生事件了，然后上报给 EventLoop，通知 channel 处理相应的事件
+        handleActiveChannels(pollStart);
+
+        //!NOTE: 和 timerfd 模式一样，到期定时器在 IO 事件之后、回调队列之前执行
+        if (timerQueue_->mode() == TimerQueue::kPollTimeout) {
+            timerQueue_->runExpired();
         }
 
         // 执行当前 EventLoop 事件循环需要处理的回调操作
@@ -115,26 +176,31 @@ void EventLoop::runInLoop(Functor cb) {
     if (isInLoopThread()) {  // 在当前的 loop 线程中执行 cb
         cb();
     } else {  // 在非当前 loop 线程中执行 cb，就需要唤醒 loop 所在线程，执行 cb
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 
 // 把 cb 放入队列中，唤醒 loop 所在的线程，执行 cb
 void EventLoop::queueInLoop(Functor cb) {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    pendingFunctors_.push(newPendingFunctor(std::move(cb)));
 
     // 唤醒相应的，需要执行上面回调操作的 loop 的线程了
-    //!NOTE: callingPendingFunctors_ 当前 loop 正在执行回调，但是 loop 又有了新的回调，因此还需要唤醒 poller 以便再次执行
-    if (!isInLoopThread() || callingPendingFunctors_) {
+    //!NOTE: loop 线程自己投递时不需要唤醒，下一次 poll 之前会检查队列，不会阻塞
+    if (!isInLoopThread()) {
         wakeup();  // 唤醒 loop 就在线程
     }
 }
 
 // 用来唤醒 loop 所在的线程，向 wakeupFd_ 写一个数据，wakeupChannel 就发生读事件，当前 loop 线程就会被唤醒
+//!NOTE: 只有 loop 阻塞(或者即将阻塞)在 poll 中、而且本次睡眠还没有人写过时才写 eventfd
 void EventLoop::wakeup() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);  // 入队或者 quit_ 先于读取 sleeping_
+    if (!sleeping_.load() || wakeupPending_.exchange(true)) {
+        suppressedWakeups_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+
     uint64_t one = 1;
     ssize_t n = write(wakeupFd_, &one, sizeof(one));
     if (n != sizeof(one)) {
@@ -142,6 +208,131 @@ void EventLoop::wakeup() {
     }
 }
 
+EventLoop::PendingFunctor *EventLoop::newPendingFunctor(Functor &&cb) {
+    PendingFunctor *task = NodeCache<PendingFunctor>::get();
+    if (task == nullptr) {
+        return new PendingFunctor(std::move(cb));
+    }
+    task->functor = std::move(cb);
+    return task;
+}
+
+// 先释放回调对象(可能持有连接的 shared_ptr)，再缓存节点
+void EventLoop::recyclePendingFunctor(PendingFunctor *task) {
+    task->functor = nullptr;
+    NodeCache<PendingFunctor>::put(task);
+}
+
+/**
+ * 用 0 超时 poll 轮询到 spinMicroseconds 用完为止：
+ * - 有就绪的 channel、回调队列非空、quit 或者定时器(kPollTimeout 模式)到期时返回 true，调用方直接处理
+ * - 超时返回 false，调用方按原来的方式阻塞；kPollTimeout 模式下轮询不会越过最早的定时器
+ */
+bool EventLoop::spinPoll() {
+    if (quit_ || !pendingFunctors_.empty()) {
+        return false;  // 不需要轮询，走原来的路径(超时为 0)
+    }
+    Timestamp start(Timestamp::now());
+    int64_t budget = busyPoll_.spinMicroseconds;
+    if (timerQueue_->mode() == TimerQueue::kPollTimeout) {
+        budget = timerQueue_->nextTimeoutUs(start, budget);
+    }
+    bool timerDue = budget < busyPoll_.spinMicroseconds;  // 轮询结束时定时器到期，也算等到了
+    Timestamp deadline(start.microSecondsSinceEpoch() + budget);
+
+    for (;;) {
+        pollReturnTime_ = poller_->poll(0, &activateChannels_);
+        spinPolls_.fetch_add(1, std::memory_order_relaxed);
+        bool expired = !(pollReturnTime_ < deadline);
+        if (!activateChannels_.empty() || quit_ || !pendingFunctors_.empty() || (expired && timerDue)) {
+            spinHits_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (expired) {
+            spinBlocks_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+}
+
+void EventLoop::setBusyPoll(const BusyPollOptions &options) {
+    runInLoop(std::bind(&EventLoop::setBusyPollInLoop, this, options));
+}
+
+EventLoop::BusyPollStats EventLoop::busyPollStats() const {
+    BusyPollStats stats;
+    stats.spinHits = spinHits_.load(std::memory_order_relaxed);
+    stats.blocks = spinBlocks_.load(std::memory_order_relaxed);
+    stats.spins = spinPolls_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void EventLoop::setEdgeTriggered(bool on) {
+    runInLoop(std::bind(&EventLoop::setEdgeTriggeredInLoop, this, on));
+}
+
+//!NOTE: eventfd 和 timerfd 的一次 read 就会清空计数，不需要改动 handleRead 也满足边缘触发的要求
+void EventLoop::setEdgeTriggeredInLoop(bool on) {
+    if (on && !poller_->supportsEdgeTriggered()) {
+        LOG_INFO("EventLoop::setEdgeTriggered - %s poller has no edge-triggered mode", poller_->name());
+        return;
+    }
+    edgeTriggered_ = on;
+    wakeupChannel_->setEdgeTriggered(on);
+    timerQueue_->setEdgeTriggered(on);
+}
+
+void EventLoop::setCompletionMode(bool on) {
+    runInLoop(std::bind(&EventLoop::setCompletionModeInLoop, this, on));
+}
+
+void EventLoop::setCompletionModeInLoop(bool on) {
+    if (!on) {
+        completionPoller_ = nullptr;
+        return;
+    }
+    IoUringPoller *poller = dynamic_cast<IoUringPoller *>(poller_.get());
+    if (poller == nullptr) {
+        LOG_INFO("EventLoop::setCompletionMode - %s poller has no completion mode", poller_->name());
+        return;
+    }
+    if (poller->enableCompletions(chunkPool_)) {
+        completionPoller_ = poller;
+    }
+}
+
+void EventLoop::setDeferredUpdates(bool on) {
+    runInLoop(std::bind(&Poller::setDeferredUpdates, poller_.get(), on));
+}
+
+EventLoop::UpdateStats EventLoop::updateStats() const {
+    UpdateStats stats;
+    stats.requests = poller_->updateRequests();
+    stats.syscalls = poller_->updateSyscalls();
+    stats.elided = stats.requests > stats.syscalls ? stats.requests - stats.syscalls : 0;
+    return stats;
+}
+
+const char *EventLoop::pollerName() const { return poller_->name(); }
+
+LoopStats::Snapshot EventLoop::loopStatsSnapshot() const {
+    LoopStats::Snapshot s = loopStats_.snapshot();
+    s.syscalls[LoopStats::kEpollCtl] = poller_->updateSyscalls();
+    s.syscalls[LoopStats::kEventfd] += wakeups_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void EventLoop::setTimerMode(TimerQueue::Mode mode) {
+    runInLoop(std::bind(&TimerQueue::setMode, timerQueue_.get(), mode));
+}
+
+EventLoop::WakeupStats EventLoop::wakeupStats() const {
+    WakeupStats stats;
+    stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+    stats.suppressed = suppressedWakeups_.load(std::memory_order_relaxed);
+    return stats;
+}
+
 // 调用 poller->updateChannel
 void EventLoop::updateChannel(Channel *channel) { poller_->updateChannel(channel); }
 
@@ -152,10 +343,24 @@ void EventLoop::updateChannel(Channel *channel, const std::string &type) { polle
 void EventLoop::removeChannel(Channel *channel) { poller_->removeChannel(channel); }
 
 // 调用 poller->hasChannel
-void EventLoop::hasChannel(Channel *channel) { poller_->hasChannel(channel); }
+bool EventLoop::hasChannel(Channel *channel) { return poller_->hasChannel(channel); }
+
+//!NOTE: 忙等轮询超时之后的阻塞 poll 也算在同一次 poll 时间里；相邻的事件共用时间戳，每个事件只读一次时钟
+void EventLoop::handleActiveChannels(int64_t pollStart) {
+    int64_t now = LoopStats::nowNanos();
+    loopStats_.recordPoll(now - pollStart, activateChannels_.size());
+    for (Channel *channel : activateChannels_) {
+        LoopStats::EventType type = LoopStats::eventType(channel->revents());
+        channel->handleEvent(pollReturnTime_);
+        int64_t end = LoopStats::nowNanos();
+        loopStats_.recordEvent(type, end - now);
+        now = end;
+    }
+}
 
 void EventLoop::handleRead() {
     uint64_t one = 1;
+    loopStats_.countSyscall(LoopStats::kEventfd);
     ssize_t n = read(wakeupFd_, &one, sizeof one);
     if (n != sizeof(one)) {
         LOG_ERROR("EventLoop::handleRead() - reads %ld bytes instead of 8", n);
@@ -163,17 +368,17 @@ void EventLoop::handleRead() {
 }
 
 // 执行回调
+//!NOTE: 只执行进入时已经在队列中的回调，回调中再投递的留到下一轮，和原来交换 vector 的语义一致
 void EventLoop::doPendingFunctors() {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);  // 解放 pendingFunctors_，减少时延
-    }
-
-    for (const Functor &functor : functors) {
-        functor();  // 执行当前
+    int64_t start = LoopStats::nowNanos();
+    size_t depth = pendingFunctors_.consumeAll([](PendingFunctor *task) {
+        task->functor();  // 执行当前
+        recyclePendingFunctor(task);
+    });
+    if (depth > 0) {
+        loopStats_.recordFunctors(LoopStats::nowNanos() - start, depth);
     }
 
     callingPendingFunctors_ = false;
@@ -1,4 +1,5 @@
 #include "EventLoopThreadPool.h"
+#include "EventLoop.h"
 #include "EventLoopThread.h"
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
@@ -54,4 +55,12 @@ std::vector<EventLoop *> EventLoopThreadPool::getAllLoops() {
     } else {
         return loops_;
     }
-}
\ No newline at end of file
+}
+
+LoopStats::Snapshot EventLoopThreadPool::loopStats() {
+    LoopStats::Snapshot total;
+    for (EventLoop *loop : getAllLoops()) {
+        total.merge(loop->loopStatsSnapshot());
+    }
+    return total;
+}
@@ -0,0 +1,683 @@
+#include "IoUringPoller.h"
+
+#include "ChunkPool.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <functional>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define MUDUO_HAVE_IO_URING 1
+#endif
+#endif
+
+#if defined(MUDUO_HAVE_IO_URING) && defined(__NR_io_uring_setup) && defined(IORING_POLL_ADD_MULTI) && \
+    defined(IORING_FEAT_RSRC_TAGS)
+
+#include <signal.h>
+
+// 完成模式需要 6.0 的头文件: multishot recv、按 fd 取消
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ASYNC_CANCEL_FD)
+#define MUDUO_HAVE_IO_URING_COMPLETIONS 1
+#endif
+
+namespace {
+
+const uint16_t kBufferGroup = 0;  // buffer ring 的组号，每个 ring 只有一组
+
+// 提交和完成队列的 head/tail 和内核共享
+inline unsigned loadAcquire(const unsigned *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline void storeRelease(unsigned *p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+// user_data: [63, 62] 请求类型 | [61, 56] recv 的代次 | [55, 32] 序号 | [31, 0] fd，0 留给不关心结果的 sqe
+enum OpKind { kPollOp = 0, kRecvOp = 1, kSendOp = 2, kAcceptOp = 3 };
+
+inline uint64_t makeUserData(int fd, uint32_t token, unsigned kind = kPollOp, unsigned gen = 0) {
+    return (static_cast<uint64_t>(kind) << 62) | (static_cast<uint64_t>(gen & 0x3f) << 56) |
+           (static_cast<uint64_t>(token) << 32) | static_cast<uint32_t>(fd);
+}
+
+inline int userDataFd(uint64_t data) { return static_cast<int>(static_cast<uint32_t>(data)); }
+inline uint32_t userDataToken(uint64_t data) { return static_cast<uint32_t>(data >> 32) & 0xffffff; }
+inline unsigned userDataKind(uint64_t data) { return static_cast<unsigned>(data >> 62); }
+inline unsigned userDataGen(uint64_t data) { return static_cast<unsigned>(data >> 56) & 0x3f; }
+
+// epoll 的 EPOLLIN/EPOLLOUT/EPOLLRDHUP 等和 poll 的同名常量取值相同，去掉 EPOLLET 即可；
+//!NOTE: 和 epoll 不同，io_uring 只报告请求了的事件，EPOLLERR(包括 zerocopy 完成通知)和 EPOLLHUP 要显式加上
+inline uint32_t toPollMask(uint32_t events) {
+    return (events & ~static_cast<uint32_t>(EPOLLET)) | EPOLLERR | EPOLLHUP;
+}
+
+}  // namespace
+
+const unsigned IoUringPoller::kRingEntries;
+const unsigned IoUringPoller::kCompletionEntries;
+const uint32_t IoUringPoller::kTokenMask;
+const unsigned IoUringPoller::kRecvBuffers;
+const size_t IoUringPoller::kRecvBufferSize;
+const int IoUringPoller::kMaxLinkedSends;
+
+IoUringPoller *IoUringPoller::create(EventLoop *loop) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kCompletionEntries;
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, kRingEntries, &params));
+    if (fd < 0) {
+        LOG_INFO("IoUringPoller::create - io_uring_setup error: %d", errno);
+        return nullptr;
+    }
+    //!NOTE: multishot poll 没有对应的 feature 位，用同为 5.13 引入的 IORING_FEAT_RSRC_TAGS 判断内核版本
+    if (!(params.features & IORING_FEAT_RSRC_TAGS) || !(params.features & IORING_FEAT_NODROP)) {
+        LOG_INFO("IoUringPoller::create - kernel too old, features = 0x%x", params.features);
+        ::close(fd);
+        return nullptr;
+    }
+    IoUringPoller *poller = new IoUringPoller(loop, fd, &params);
+    if (!poller->mapRings(&params)) {
+        delete poller;
+        return nullptr;
+    }
+    return poller;
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop, int ringFd, const void *params)
+    : Poller(loop)
+    , ringFd_(ringFd)
+    , extArg_((static_cast<const io_uring_params *>(params)->features & IORING_FEAT_EXT_ARG) != 0)
+    , sqRing_(MAP_FAILED)
+    , sqRingSize_(0)
+    , cqRing_(MAP_FAILED)
+    , cqRingSize_(0)
+    , sqes_(nullptr)
+    , sqesSize_(0)
+    , sqHead_(nullptr)
+    , sqTail_(nullptr)
+    , sqFlags_(nullptr)
+    , sqMask_(0)
+    , sqEntries_(0)
+    , sqArray_(nullptr)
+    , cqHead_(nullptr)
+    , cqTail_(nullptr)
+    , cqMask_(0)
+    , cqes_(nullptr)
+    , pending_(0)
+    , nextToken_(1)
+    , batch_(0)
+    , bufRing_(nullptr)
+    , bufTail_(0)
+    , bufferCapacity_(0) {}
+
+bool IoUringPoller::mapRings(const void *rawParams) {
+    const io_uring_params *p = static_cast<const io_uring_params *>(rawParams);
+    sqRingSize_ = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    cqRingSize_ = p->cq_off.cqes + p->cq_entries * sizeof(io_uring_cqe);
+    bool single = (p->features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sqRingSize_ = cqRingSize_ = sqRingSize_ > cqRingSize_ ? sqRingSize_ : cqRingSize_;
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        LOG_ERROR("IoUringPoller::mapRings - mmap sq ring error: %d", errno);
+        return false;
+    }
+    if (single) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_,
+                         IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            LOG_ERROR("IoUringPoller::mapRings - mmap cq ring error: %d", errno);
+            return false;
+        }
+    }
+    sqesSize_ = p->sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOG_ERROR("IoUringPoller::mapRings - mmap sqes error: %d", errno);
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + p->sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + p->sq_off.tail);
+    sqFlags_ = reinterpret_cast<unsigned *>(sq + p->sq_off.flags);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + p->sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned *>(sq + p->sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + p->sq_off.array);
+
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + p->cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + p->cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + p->cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p->cq_off.cqes);
+    return true;
+}
+
+IoUringPoller::~IoUringPoller() {
+#ifdef MUDUO_HAVE_IO_URING_COMPLETIONS
+    if (bufRing_ != nullptr) {
+        // 先注销，内核不会再往内存块里写，再把内存块还给 ChunkPool
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = kBufferGroup;
+        ::syscall(__NR_io_uring_register, ringFd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        ::munmap(bufRing_, kRecvBuffers * sizeof(io_uring_buf));
+        for (char *buffer : buffers_) {
+            pool_->deallocate(buffer, bufferCapacity_);
+        }
+    }
+#endif
+    if (sqes_ != nullptr) {
+        ::munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+        ::munmap(sqRing_, sqRingSize_);
+    }
+    ::close(ringFd_);
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels) {
+    return wait(timeoutMs < 0 ? -1 : timeoutMs * 1000000LL, activeChannels);
+}
+
+Timestamp IoUringPoller::pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels) {
+    return wait(timeoutUs < 0 ? -1 : timeoutUs * 1000, activeChannels);
+}
+
+//!NOTE: 完成队列中已经有事件或者超时为 0 时不等待，没有要提交的 sqe 时也不进入内核(忙等轮询不产生系统调用)
+Timestamp IoUringPoller::wait(int64_t timeoutNs, ChannelList *activeChannels) {
+    bool ready = loadAcquire(cqTail_) != *cqHead_;
+    if (!ready && timeoutNs != 0) {
+        if (enter(true, timeoutNs) < 0 && errno != ETIME && errno != EINTR) {
+            LOG_ERROR("IoUringPoller::poll - io_uring_enter error: %d", errno);
+        }
+    } else if (pending_ > 0) {
+        enter(false, 0);
+    }
+    Timestamp now(Timestamp::now());
+    reapCompletions(activeChannels);
+    return now;
+}
+
+int IoUringPoller::enter(bool waitForEvents, int64_t timeoutNs) {
+    unsigned toSubmit = pending_;
+    unsigned flags = 0;
+    const void *arg = nullptr;
+    size_t argSize = 0;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg eventsArg;
+    if (waitForEvents) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutNs >= 0) {
+            if (extArg_) {
+                ts.tv_sec = timeoutNs / 1000000000LL;
+                ts.tv_nsec = timeoutNs % 1000000000LL;
+                memset(&eventsArg, 0, sizeof(eventsArg));
+                eventsArg.ts = reinterpret_cast<uint64_t>(&ts);
+                arg = &eventsArg;
+                argSize = sizeof(eventsArg);
+                flags |= IORING_ENTER_EXT_ARG;
+            } else {
+                // 5.11 之前没有带超时的 io_uring_enter，这里只在 ≥ 5.13 的内核上运行，不会走到
+                waitForEvents = false;
+                flags &= ~IORING_ENTER_GETEVENTS;
+            }
+        }
+    }
+
+    int ret;
+    do {
+        ret = static_cast<int>(::syscall(__NR_io_uring_enter, ringFd_, toSubmit, waitForEvents ? 1 : 0, flags, arg, argSize));
+    } while (ret < 0 && errno == EINTR && !waitForEvents);
+    if (ret >= 0) {
+        pending_ -= static_cast<unsigned>(ret) < pending_ ? static_cast<unsigned>(ret) : pending_;
+    }
+    return ret;
+}
+
+void IoUringPoller::reapCompletions(ChannelList *activeChannels) {
+    ++batch_;
+    unsigned head = *cqHead_;
+    unsigned tail = loadAcquire(cqTail_);
+    for (; head != tail; ++head) {
+        const io_uring_cqe &cqe = cqes_[head & cqMask_];
+        if (cqe.user_data == 0) {
+            continue;  // POLL_REMOVE 自己的完成事件
+        }
+        if (userDataKind(cqe.user_data) != kPollOp) {
+#ifdef MUDUO_HAVE_IO_URING_COMPLETIONS
+            queueCompletion(cqe);
+#endif
+            continue;
+        }
+        int fd = userDataFd(cqe.user_data);
+        uint32_t token = userDataToken(cqe.user_data);
+        ChannelSlot *s = const_cast<ChannelSlot *>(findSlot(fd));
+        if (s == nullptr || s->channel == nullptr || s->state != kAdded || s->token != token) {
+            continue;  // 已经取消或者修改过的旧请求
+        }
+
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            // one-shot 完成，或者 multishot 被内核终止，下一轮 flushUpdates 时重新提交
+            s->state = kDeleted;
+            s->events = 0;
+            s->token = 0;
+            markDirty(fd, s);
+        }
+        if (cqe.res < 0) {
+            if (cqe.res != -ECANCELED) {
+                LOG_ERROR("IoUringPoller::poll - poll fd = %d error: %d", fd, -cqe.res);
+            }
+            continue;
+        }
+
+        Channel *channel = s->channel;
+        if (static_cast<size_t>(fd) >= activeBatch_.size()) {
+            activeBatch_.resize(fd + 1, 0);
+        }
+        if (activeBatch_[fd] == batch_) {
+            channel->set_revents(channel->revents() | cqe.res);
+        } else {
+            activeBatch_[fd] = batch_;
+            channel->set_revents(cqe.res);
+            activeChannels->push_back(channel);
+        }
+    }
+    storeRelease(cqHead_, head);
+    if (!completed_.empty()) {
+        completionChannel_->set_revents(EPOLLIN);
+        activeChannels->push_back(completionChannel_.get());
+    }
+
+    // 完成队列溢出时内核暂存的事件，下一次 io_uring_enter(GETEVENTS) 才会搬进完成队列
+    if (loadAcquire(sqFlags_) & IORING_SQ_CQ_OVERFLOW) {
+        enter(true, 0);
+    }
+}
+
+io_uring_sqe *IoUringPoller::getSqe() {
+    unsigned tail = *sqTail_;
+    if (tail - loadAcquire(sqHead_) >= sqEntries_) {
+        // 提交队列满了，先把已有的提交给内核
+        updateSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (enter(false, 0) < 0) {
+            LOG_FATAL("IoUringPoller::getSqe - io_uring_enter error: %d", errno);
+        }
+        tail = *sqTail_;
+    }
+    unsigned index = tail & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    storeRelease(sqTail_, tail + 1);
+    ++pending_;
+    return sqe;
+}
+
+uint32_t IoUringPoller::newToken() {
+    uint32_t token = nextToken_;
+    nextToken_ = (nextToken_ + 1) & kTokenMask;
+    if (nextToken_ == 0) {
+        nextToken_ = 1;
+    }
+    return token;
+}
+
+void IoUringPoller::arm(int fd, ChannelSlot *s, uint32_t events) {
+    uint32_t token = newToken();
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = toPollMask(events);
+    sqe->len = (events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = makeUserData(fd, token);
+
+    s->state = kAdded;
+    s->events = events;
+    s->token = token;
+}
+
+void IoUringPoller::cancel(ChannelSlot *s) {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(s->channel->fd(), s->token);
+    sqe->user_data = 0;
+
+    s->state = kDeleted;
+    s->events = 0;
+    s->token = 0;
+}
+
+// 和内核中的 poll 请求比较: 关注的事件变了就取消旧请求、提交新请求
+void IoUringPoller::commit(ChannelSlot *s) {
+    Channel *channel = s->channel;
+    uint32_t want = channel->isNoneEvent() ? 0 : static_cast<uint32_t>(channel->pollEvents());
+    if (s->state == kAdded) {
+        if (want == s->events) {
+            return;
+        }
+        cancel(s);
+    }
+    if (want != 0) {
+        arm(channel->fd(), s, want);
+    }
+}
+
+void IoUringPoller::unregister(ChannelSlot *s) { cancel(s); }
+
+//!NOTE: 没有完成的 poll 请求持有 fd 对应文件的引用，POLL_REMOVE 留在提交队列里的话，之后 close(fd) 不会真正关闭 socket
+// (对端收不到 FIN，SO_REUSEPORT 的 listen socket 还会继续分到连接)，所以这里立即提交；旧请求的完成事件按序号丢弃
+// 完成模式的 recv/send/accept 同理，按 fd 一次取消全部
+void IoUringPoller::removeChannel(Channel *channel) {
+    int fd = channel->fd();
+    Poller::removeChannel(channel);
+#ifdef MUDUO_HAVE_IO_URING_COMPLETIONS
+    CompletionSlot *cs = findCompletionSlot(fd, channel);
+    if (cs != nullptr) {
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = 0;
+        *cs = CompletionSlot();
+    }
+#endif
+    if (pending_ > 0) {
+        updateSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (enter(false, 0) < 0) {
+            LOG_ERROR("IoUringPoller::removeChannel - io_uring_enter error: %d", errno);
+        }
+    }
+}
+
+#ifdef MUDUO_HAVE_IO_URING_COMPLETIONS
+
+//!NOTE: multishot recv 没有对应的 feature 位，用同为 6.0 引入的 IORING_OP_SEND_ZC 是否被支持判断内核版本
+bool IoUringPoller::enableCompletions(const std::shared_ptr<ChunkPool> &pool) {
+    if (bufRing_ != nullptr) {
+        return true;
+    }
+    std::vector<char> probeStorage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(probeStorage.data());
+    if (::syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        LOG_INFO("IoUringPoller::enableCompletions - probe error: %d", errno);
+        return false;
+    }
+    if (probe->ops_len <= IORING_OP_SEND_ZC || !(probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED)) {
+        LOG_INFO("IoUringPoller::enableCompletions - kernel too old, no multishot recv");
+        return false;
+    }
+
+    size_t ringSize = kRecvBuffers * sizeof(io_uring_buf);
+    void *ring = ::mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        LOG_ERROR("IoUringPoller::enableCompletions - mmap buffer ring error: %d", errno);
+        return false;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = kRecvBuffers;
+    reg.bgid = kBufferGroup;
+    if (::syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        LOG_INFO("IoUringPoller::enableCompletions - register buffer ring error: %d", errno);
+        ::munmap(ring, ringSize);
+        return false;
+    }
+
+    pool_ = pool;
+    bufRing_ = static_cast<io_uring_buf *>(ring);
+    buffers_.resize(kRecvBuffers);
+    for (unsigned bid = 0; bid < kRecvBuffers; ++bid) {
+        buffers_[bid] = pool_->allocate(kRecvBufferSize, &bufferCapacity_);
+        provideBuffer(static_cast<uint16_t>(bid));
+    }
+    completionChannel_.reset(new Channel(ownerLoop(), ringFd_));
+    completionChannel_->setReadCallback(std::bind(&IoUringPoller::dispatchCompletions, this));
+    return true;
+}
+
+void IoUringPoller::provideBuffer(uint16_t bid) {
+    io_uring_buf &buf = bufRing_[bufTail_ & (kRecvBuffers - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffers_[bid]);
+    buf.len = static_cast<uint32_t>(bufferCapacity_);
+    buf.bid = bid;
+    ++bufTail_;
+    __atomic_store_n(&bufRing_[0].resv, bufTail_, __ATOMIC_RELEASE);
+}
+
+IoUringPoller::CompletionSlot *IoUringPoller::completionSlot(Channel *channel) {
+    int fd = channel->fd();
+    if (static_cast<size_t>(fd) >= completionSlots_.size()) {
+        completionSlots_.resize(std::max(static_cast<size_t>(fd) + 1, completionSlots_.size() * 2));
+    }
+    CompletionSlot *cs = &completionSlots_[fd];
+    if (cs->channel != channel) {
+        *cs = CompletionSlot();
+        cs->channel = channel;
+        cs->token = newToken();
+    }
+    return cs;
+}
+
+IoUringPoller::CompletionSlot *IoUringPoller::findCompletionSlot(int fd, Channel *channel) {
+    if (fd < 0 || static_cast<size_t>(fd) >= completionSlots_.size() || completionSlots_[fd].channel != channel) {
+        return nullptr;
+    }
+    return &completionSlots_[fd];
+}
+
+void IoUringPoller::startRecv(Channel *channel) {
+    CompletionSlot *cs = completionSlot(channel);
+    cs->recvWanted = true;
+    if (!cs->recvArmed) {
+        armRecv(channel->fd(), cs);
+    }
+}
+
+void IoUringPoller::stopRecv(Channel *channel) {
+    int fd = channel->fd();
+    CompletionSlot *cs = findCompletionSlot(fd, channel);
+    if (cs == nullptr) {
+        return;
+    }
+    cs->recvWanted = false;
+    if (cs->recvArmed) {
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = makeUserData(fd, cs->token, kRecvOp, cs->recvGen);
+        sqe->user_data = 0;
+        cs->recvArmed = false;
+    }
+}
+
+void IoUringPoller::armRecv(int fd, CompletionSlot *cs) {
+    cs->recvGen = (cs->recvGen + 1) & 0x3f;
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = makeUserData(fd, cs->token, kRecvOp, cs->recvGen);
+    cs->recvArmed = true;
+}
+
+void IoUringPoller::startAccept(Channel *channel) {
+    CompletionSlot *cs = completionSlot(channel);
+    if (!cs->acceptArmed) {
+        armAccept(channel->fd(), cs);
+    }
+}
+
+void IoUringPoller::armAccept(int fd, CompletionSlot *cs) {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = makeUserData(fd, cs->token, kAcceptOp);
+    cs->acceptArmed = true;
+}
+
+//!NOTE: 一条链必须在同一次 io_uring_enter 中提交，被提交队列拆开的两段会变成两条互不等待的链，所以先保证放得下
+// MSG_WAITALL 让内核在 socket 写满时等待可写再继续，而不是以部分发送结束整条链
+void IoUringPoller::send(Channel *channel, const struct iovec *slices, int count) {
+    int fd = channel->fd();
+    CompletionSlot *cs = completionSlot(channel);
+    if (sqEntries_ - (*sqTail_ - loadAcquire(sqHead_)) < static_cast<unsigned>(count)) {
+        updateSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (enter(false, 0) < 0) {
+            LOG_FATAL("IoUringPoller::send - io_uring_enter error: %d", errno);
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(slices[i].iov_base);
+        sqe->len = static_cast<uint32_t>(slices[i].iov_len);
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->flags = i + 1 < count ? IOSQE_IO_LINK : 0;
+        sqe->user_data = makeUserData(fd, cs->token, kSendOp);
+    }
+}
+
+/**
+ * 收割时只记录结果和更新 multishot 的状态，不回调(回调中可能提交新的 sqe、remove channel)
+ * - channel 已经 remove 或者 fd 被复用的旧结果直接丢弃，带着的内存块放回 buffer ring
+ * - recv 的结束事件(没有 IORING_CQE_F_MORE)只对当前代次有效，被取消的旧 recv 的 -ECANCELED 不交给 channel
+ */
+void IoUringPoller::queueCompletion(const io_uring_cqe &cqe) {
+    int fd = userDataFd(cqe.user_data);
+    uint32_t token = userDataToken(cqe.user_data);
+    unsigned kind = userDataKind(cqe.user_data);
+    bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+    CompletionSlot *cs = nullptr;
+    if (static_cast<size_t>(fd) < completionSlots_.size() && completionSlots_[fd].channel != nullptr &&
+        completionSlots_[fd].token == token) {
+        cs = &completionSlots_[fd];
+    }
+    if (cs == nullptr) {
+        if (hasBuffer) {
+            provideBuffer(bid);
+        }
+        return;
+    }
+
+    PendingCompletion p;
+    p.channel = cs->channel;
+    p.fd = fd;
+    p.token = token;
+    p.deliver = true;
+    p.rearm = false;
+    p.hasBuffer = hasBuffer;
+    p.bid = bid;
+    Completion &c = p.completion;
+    c.result = cqe.res;
+    c.more = more;
+    c.data = hasBuffer ? buffers_[bid] : nullptr;
+    c.capacity = hasBuffer ? bufferCapacity_ : 0;
+    c.taken = false;
+
+    if (kind == kRecvOp) {
+        c.op = Completion::kRecv;
+        bool current = userDataGen(cqe.user_data) == cs->recvGen;
+        if (!more && current && cs->recvArmed) {
+            cs->recvArmed = false;
+            p.rearm = cqe.res > 0 || cqe.res == -ENOBUFS;  // 数据之后被终止，或者 buffer ring 暂时用完
+        }
+        if (cqe.res == -ENOBUFS || (cqe.res <= 0 && !current)) {
+            p.deliver = false;
+        }
+    } else if (kind == kAcceptOp) {
+        c.op = Completion::kAccept;
+        if (!more) {
+            cs->acceptArmed = false;
+            p.rearm = cqe.res >= 0;
+        }
+    } else {
+        c.op = Completion::kSend;
+    }
+    completed_.push_back(p);
+}
+
+// completionChannel_ 的读回调: 按收割顺序交给各个 channel，然后回收内存块、重新提交被终止的 multishot 请求
+void IoUringPoller::dispatchCompletions() {
+    for (size_t i = 0; i < completed_.size(); ++i) {
+        PendingCompletion &p = completed_[i];
+        bool live = findCompletionSlot(p.fd, p.channel) != nullptr && completionSlots_[p.fd].token == p.token;
+        if (live && p.deliver) {
+            p.channel->handleCompletion(p.completion);
+        }
+        if (p.hasBuffer) {
+            if (p.completion.taken) {
+                buffers_[p.bid] = pool_->allocate(kRecvBufferSize, &bufferCapacity_);  // 原来的内存块归接管方
+            }
+            provideBuffer(p.bid);
+        }
+    }
+    for (const PendingCompletion &p : completed_) {
+        if (!p.rearm) {
+            continue;
+        }
+        CompletionSlot *cs = findCompletionSlot(p.fd, p.channel);
+        if (cs == nullptr || cs->token != p.token) {
+            continue;
+        }
+        if (p.completion.op == Completion::kRecv && cs->recvWanted && !cs->recvArmed) {
+            armRecv(p.fd, cs);
+        } else if (p.completion.op == Completion::kAccept && !cs->acceptArmed) {
+            armAccept(p.fd, cs);
+        }
+    }
+    completed_.clear();
+}
+
+#endif  // MUDUO_HAVE_IO_URING_COMPLETIONS
+
+#else  // 没有 io_uring 头文件或者头文件太旧
+
+IoUringPoller *IoUringPoller::create(EventLoop *) {
+    LOG_INFO("IoUringPoller::create - built without io_uring support");
+    return nullptr;
+}
+
+#endif
+
+#ifndef MUDUO_HAVE_IO_URING_COMPLETIONS
+
+bool IoUringPoller::enableCompletions(const std::shared_ptr<ChunkPool> &) {
+    LOG_INFO("IoUringPoller::enableCompletions - built without multishot recv support");
+    return false;
+}
+
+// enableCompletions 总是失败，下面这些不会被调用
+void IoUringPoller::startRecv(Channel *) {}
+void IoUringPoller::stopRecv(Channel *) {}
+void IoUringPoller::startAccept(Channel *) {}
+void IoUringPoller::send(Channel *, const struct iovec *, int) {}
+
+#endif
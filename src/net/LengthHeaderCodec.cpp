@@ -0,0 +1,91 @@
+#include "LengthHeaderCodec.h"
+
+#include "Buffer.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+#include <endian.h>
+#include <string.h>
+
+const size_t LengthHeaderCodec::kHeaderLen;
+const size_t LengthHeaderCodec::kDefaultMaxFrameLength;
+
+namespace {
+// 每个 IO 线程复用一个帧数组，onMessage 不用每次分配
+thread_local std::vector<LengthHeaderCodec::Frame> t_frames;
+}  // namespace
+
+LengthHeaderCodec::LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameLength)
+    : frameCallback_(cb), maxFrameLength_(maxFrameLength) {}
+
+/**
+ * 第一遍只读长度头，算出所有完整帧一共占多少字节；
+ * 然后把这段数据 pullup 成连续内存(连续模式下不拷贝)，切成帧交给回调，最后一次 retrieve
+ * 非法的长度头之前的完整帧照常交付，之后再报错
+ */
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime) {
+    size_t readable = buf->readableBytes();
+    size_t total = 0;
+    bool invalid = false;
+    int32_t invalidLength = 0;
+    while (readable - total >= kHeaderLen) {
+        int32_t be32 = 0;
+        buf->peekAt(total, &be32, kHeaderLen);
+        int32_t len = be32toh(be32);
+        if (len < 0 || static_cast<size_t>(len) > maxFrameLength_) {
+            invalid = true;
+            invalidLength = len;
+            break;
+        }
+        if (readable - total - kHeaderLen < static_cast<size_t>(len)) {
+            break;  // 最后一帧还没收全
+        }
+        total += kHeaderLen + len;
+    }
+
+    if (total > 0) {
+        const char *base = buf->pullup(total);
+
+        //!NOTE: 先把线程的数组换出来，回调里即使再进入 onMessage 也不会互相覆盖
+        std::vector<Frame> frames;
+        frames.swap(t_frames);
+        frames.clear();
+        for (size_t offset = 0; offset < total;) {
+            int32_t be32 = 0;
+            memcpy(&be32, base + offset, kHeaderLen);
+            Frame frame;
+            frame.data = base + offset + kHeaderLen;
+            frame.length = be32toh(be32);
+            frames.push_back(frame);
+            offset += kHeaderLen + frame.length;
+        }
+
+        frameCallback_(conn, frames, receiveTime);
+        buf->retrieve(total);
+        frames.swap(t_frames);
+    }
+
+    if (invalid) {
+        if (errorCallback_) {
+            errorCallback_(conn, invalidLength);
+        } else {
+            LOG_ERROR("LengthHeaderCodec::onMessage [%s] invalid frame length %d", conn->name().c_str(), invalidLength);
+            conn->shutdown();
+        }
+    }
+}
+
+void LengthHeaderCodec::encode(Buffer *payload) {
+    payload->prependInt32(static_cast<int32_t>(payload->readableBytes()));
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *payload) const {
+    encode(payload);
+    conn->send(payload);
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const void *data, size_t len) const {
+    Buffer buf;
+    buf.append(data, len);
+    send(conn, &buf);
+}
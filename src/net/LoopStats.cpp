@@ -0,0 +1,86 @@
+#include "LoopStats.h"
+
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+LoopStats::Snapshot::Snapshot() : iterations(0) { memset(syscalls, 0, sizeof(syscalls)); }
+
+void LoopStats::Snapshot::merge(const Snapshot &other) {
+    iterations += other.iterations;
+    pollTime.merge(other.pollTime);
+    activeChannels.merge(other.activeChannels);
+    for (int i = 0; i < kNumEventTypes; ++i) {
+        eventTime[i].merge(other.eventTime[i]);
+    }
+    functorTime.merge(other.functorTime);
+    functorDepth.merge(other.functorDepth);
+    timerTime.merge(other.timerTime);
+    for (int i = 0; i < kNumSyscalls; ++i) {
+        syscalls[i] += other.syscalls[i];
+    }
+}
+
+LoopStats::LoopStats() : iterations_(0) {
+    for (int i = 0; i < kNumSyscalls; ++i) {
+        syscalls_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+//!NOTE: clock_gettime(CLOCK_MONOTONIC) 走 vDSO，不进入内核
+int64_t LoopStats::nowNanos() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 和 Channel::handleEventWithGuard 的判断一致
+LoopStats::EventType LoopStats::eventType(int revents) {
+    if ((revents & EPOLLERR) || ((revents & EPOLLHUP) && !(revents & EPOLLIN))) {
+        return kErrorEvent;
+    }
+    bool readable = (revents & (EPOLLIN | EPOLLPRI | EPOLLRDHUP)) != 0;
+    bool writable = (revents & EPOLLOUT) != 0;
+    if (readable && writable) {
+        return kReadWriteEvent;
+    }
+    return writable ? kWriteEvent : kReadEvent;
+}
+
+const char *LoopStats::eventTypeName(EventType type) {
+    static const char *const kNames[kNumEventTypes] = {"read", "write", "read+write", "error"};
+    return kNames[type];
+}
+
+const char *LoopStats::syscallName(Syscall call) {
+    static const char *const kNames[kNumSyscalls] = {"read", "write", "epoll_ctl", "eventfd"};
+    return kNames[call];
+}
+
+void LoopStats::recordPoll(int64_t nanos, size_t activeChannels) {
+    relaxedAdd(iterations_, 1);
+    pollTime_.record(nanos);
+    activeChannels_.record(activeChannels);
+}
+
+void LoopStats::recordFunctors(int64_t nanos, size_t depth) {
+    functorTime_.record(nanos);
+    functorDepth_.record(depth);
+}
+
+LoopStats::Snapshot LoopStats::snapshot() const {
+    Snapshot s;
+    s.iterations = iterations_.load(std::memory_order_relaxed);
+    s.pollTime = pollTime_.snapshot();
+    s.activeChannels = activeChannels_.snapshot();
+    for (int i = 0; i < kNumEventTypes; ++i) {
+        s.eventTime[i] = eventTime_[i].snapshot();
+    }
+    s.functorTime = functorTime_.snapshot();
+    s.functorDepth = functorDepth_.snapshot();
+    s.timerTime = timerTime_.snapshot();
+    for (int i = 0; i < kNumSyscalls; ++i) {
+        s.syscalls[i] = syscalls_[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
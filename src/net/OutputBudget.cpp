@@ -0,0 +1,34 @@
+#include "OutputBudget.h"
+
+OutputBudget::OutputBudget() : queued_(0), queuedBytes_(0), peakBytes_(0), pauses_(0), evictions_(0) {}
+
+void OutputBudget::add(size_t n) {
+    queued_ += n;
+    queuedBytes_.store(queued_, std::memory_order_relaxed);
+    if (queued_ > peakBytes_.load(std::memory_order_relaxed)) {
+        peakBytes_.store(queued_, std::memory_order_relaxed);
+    }
+}
+
+void OutputBudget::remove(size_t n) {
+    queued_ = n < queued_ ? queued_ - n : 0;
+    queuedBytes_.store(queued_, std::memory_order_relaxed);
+
+    if (!waiters_.empty() && queued_ <= loopLowMark()) {
+        //!NOTE: 先换出来再回调，回调中可能再次登记
+        std::vector<DrainCallback> waiters;
+        waiters.swap(waiters_);
+        for (const DrainCallback &cb : waiters) {
+            cb();
+        }
+    }
+}
+
+OutputBudget::Snapshot OutputBudget::snapshot() const {
+    Snapshot s;
+    s.queuedBytes = queuedBytes_.load(std::memory_order_relaxed);
+    s.peakBytes = peakBytes_.load(std::memory_order_relaxed);
+    s.pauses = pauses_.load(std::memory_order_relaxed);
+    s.evictions = evictions_.load(std::memory_order_relaxed);
+    return s;
+}
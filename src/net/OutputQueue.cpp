@@ -0,0 +1,267 @@
+#include "OutputQueue.h"
+
+#include "Logger.h"
+
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const int OutputQueue::kMaxIovecs;
+const size_t OutputQueue::kMinZeroCopyThreshold;
+
+// sendfile 单次最多传输 0x7ffff000 字节
+static const size_t kMaxSendfileBytes = 0x7ffff000;
+
+OutputQueue::OutputQueue(const std::shared_ptr<ChunkPool> &pool)
+    : buffer_(pool)
+    , readable_(0)
+    , fileBytes_(0)
+    , zeroCopyThreshold_(0)
+    , nextSeq_(0)
+    , pinnedBytes_(0)
+    , lastWriteShort_(false)
+    , zeroCopyFallbacks_(0) {}
+
+OutputQueue::~OutputQueue() {
+    for (const Entry &entry : entries_) {
+        if (entry.type == Entry::kFile) {
+            ::close(entry.fd);
+        }
+    }
+}
+
+void OutputQueue::append(const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    buffer_.append(data, len);
+    if (!entries_.empty() && entries_.back().type == Entry::kBuffered) {
+        entries_.back().length += len;
+    } else {
+        entries_.emplace_back(Entry::kBuffered, len);
+    }
+    readable_ += len;
+}
+
+void OutputQueue::append(std::string &&slice, size_t offset) {
+    if (offset >= slice.size()) {
+        return;
+    }
+    entries_.emplace_back(Entry::kOwned, slice.size() - offset);
+    entries_.back().data.swap(slice);
+    entries_.back().offset = offset;
+    readable_ += entries_.back().length;
+}
+
+void OutputQueue::append(const PayloadPtr &payload, size_t offset) {
+    if (!payload || offset >= payload->size()) {
+        return;
+    }
+    entries_.emplace_back(Entry::kShared, payload->size() - offset);
+    entries_.back().shared = payload;
+    entries_.back().offset = offset;
+    readable_ += entries_.back().length;
+}
+
+size_t OutputQueue::footprint() const {
+    size_t bytes = buffer_.footprint();
+    for (const Entry &entry : entries_) {
+        bytes += entry.data.capacity();
+    }
+    for (const Pinned &pinned : pinned_) {
+        bytes += pinned.data.capacity();
+    }
+    return bytes;
+}
+
+void OutputQueue::setZeroCopyThreshold(size_t threshold) {
+    zeroCopyThreshold_ = threshold == 0 ? 0 : std::max(threshold, kMinZeroCopyThreshold);
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, size_t length) {
+    if (length == 0) {
+        ::close(fd);
+        return;
+    }
+    entries_.emplace_back(Entry::kFile, length);
+    entries_.back().fd = fd;
+    entries_.back().fileOffset = offset;
+    readable_ += length;
+    fileBytes_ += length;
+}
+
+//!NOTE: kBuffered 的数据在 buffer_ 中是首尾相接的，bufferOffset 记录当前 entry 在 buffer_ 中的起点
+ssize_t OutputQueue::writeFd(int fd, int *saveErrno) {
+    if (!entries_.empty() && entries_.front().type == Entry::kFile) {
+        return sendFile(entries_.front(), fd, saveErrno);
+    }
+    if (!entries_.empty() && useZeroCopy(entries_.front())) {
+        return sendZeroCopy(entries_.front(), fd, saveErrno);
+    }
+
+    // 文件和 zerocopy 数据之前的内存数据一次 writev 写出，它们留到下一次写事件
+    struct iovec vec[kMaxIovecs];
+    int iovcnt = peekIovecs(vec, kMaxIovecs);
+
+    size_t offered = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        offered += vec[i].iov_len;
+    }
+
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0) {
+        *saveErrno = errno;
+    }
+    lastWriteShort_ = n < 0 || static_cast<size_t>(n) < offered;
+    return n;
+}
+
+//!NOTE: 普通数据不能和 MSG_ZEROCOPY 混在一次调用里，否则 Buffer 中的内存在完成通知之前就可能被复用
+int OutputQueue::peekIovecs(struct iovec *vec, int maxIovecs) const {
+    int iovcnt = 0;
+    size_t bufferOffset = 0;
+    for (const Entry &entry : entries_) {
+        if (iovcnt == maxIovecs || entry.type == Entry::kFile || useZeroCopy(entry)) {
+            break;
+        }
+        if (entry.type == Entry::kBuffered) {
+            iovcnt += buffer_.peekIovecs(bufferOffset, entry.length, vec + iovcnt, maxIovecs - iovcnt);
+            bufferOffset += entry.length;
+        } else {
+            vec[iovcnt].iov_base = const_cast<char *>(entry.peek());
+            vec[iovcnt].iov_len = entry.length;
+            ++iovcnt;
+        }
+    }
+    return iovcnt;
+}
+
+// 文件被截断时 sendfile 返回 0，数据再也发不完，按 ENODATA 报错交给连接关闭
+ssize_t OutputQueue::sendFile(Entry &entry, int fd, int *saveErrno) {
+    off_t offset = entry.fileOffset;
+    size_t offered = std::min(entry.length, kMaxSendfileBytes);
+    ssize_t n = ::sendfile(fd, entry.fd, &offset, offered);
+    lastWriteShort_ = n < 0 || static_cast<size_t>(n) < offered;
+    if (n < 0) {
+        *saveErrno = errno;
+    } else if (n == 0) {
+        *saveErrno = ENODATA;
+        n = -1;
+    }
+    return n;
+}
+
+/**
+ * 一次 sendmsg(MSG_ZEROCOPY) 发送 entry 剩余的数据，成功时内核给这次调用分配序号 nextSeq_，
+ * optmem 不足 (ENOBUFS) 时这一次退化为普通 send
+ */
+ssize_t OutputQueue::sendZeroCopy(Entry &entry, int fd, int *saveErrno) {
+    struct iovec vec;
+    vec.iov_base = const_cast<char *>(entry.peek());
+    vec.iov_len = entry.length;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+
+    ssize_t n = ::sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (n >= 0) {
+        entry.zeroCopy = true;
+        entry.lastSeq = nextSeq_++;
+        lastWriteShort_ = static_cast<size_t>(n) < vec.iov_len;
+        return n;
+    }
+    if (errno == ENOBUFS) {
+        n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+    }
+    if (n < 0) {
+        *saveErrno = errno;
+    }
+    lastWriteShort_ = n < 0 || static_cast<size_t>(n) < vec.iov_len;
+    return n;
+}
+
+int OutputQueue::handleZeroCopyCompletions(int fd) {
+    int count = 0;
+    for (;;) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("OutputQueue::handleZeroCopyCompletions - errno = %d", errno);
+            }
+            break;
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            const struct sock_extended_err *serr = reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            ++count;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                ++zeroCopyFallbacks_;
+            }
+
+            // [ee_info, ee_data] 范围内的发送都已完成，TCP 的完成通知按序号递增到达
+            const uint32_t hi = serr->ee_data;
+            while (!pinned_.empty() && static_cast<int32_t>(hi - pinned_.front().seq) >= 0) {
+                pinnedBytes_ -= pinned_.front().bytes;
+                pinned_.pop_front();
+            }
+        }
+    }
+    return count;
+}
+
+// 用 MSG_ZEROCOPY 发送过的数据要等完成通知到达才能释放
+void OutputQueue::popFront() {
+    Entry &front = entries_.front();
+    if (front.type == Entry::kFile) {
+        ::close(front.fd);
+    } else if (front.zeroCopy) {
+        Pinned pinned;
+        pinned.seq = front.lastSeq;
+        pinned.bytes = front.type == Entry::kShared ? front.shared->size() : front.data.size();
+        pinned.data.swap(front.data);
+        pinned.shared.swap(front.shared);
+        pinnedBytes_ += pinned.bytes;
+        pinned_.push_back(std::move(pinned));
+    }
+    entries_.pop_front();
+}
+
+void OutputQueue::retrieve(size_t len) {
+    len = std::min(len, readable_);
+    readable_ -= len;
+    while (len > 0) {
+        Entry &front = entries_.front();
+        size_t n = std::min(len, front.length);
+        if (front.type == Entry::kBuffered) {
+            buffer_.retrieve(n);
+        } else if (front.type == Entry::kOwned || front.type == Entry::kShared) {
+            front.offset += n;
+        } else {
+            front.fileOffset += n;
+            fileBytes_ -= n;
+        }
+        front.length -= n;
+        len -= n;
+        if (front.length == 0) {
+            popFront();
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#include "PollPoller.h"
+
+#include "Channel.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+
+PollPoller::PollPoller(EventLoop *loop) : Poller(loop) {}
+
+PollPoller::~PollPoller() = default;
+
+Timestamp PollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
+    LOG_DEBUG("PollPoller::poll - fd total count: %lu", pollfds_.size());
+
+    int numEvents = ::poll(pollfds_.data(), pollfds_.size(), timeoutMs);
+    return handleEvents(numEvents, errno, activeChannels);
+}
+
+Timestamp PollPoller::pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeoutUs / Timestamp::kMicroSecondsPerSecond);
+    ts.tv_nsec = static_cast<long>((timeoutUs % Timestamp::kMicroSecondsPerSecond) * 1000);
+    int numEvents = ::ppoll(pollfds_.data(), pollfds_.size(), &ts, nullptr);
+    return handleEvents(numEvents, errno, activeChannels);
+}
+
+Timestamp PollPoller::handleEvents(int numEvents, int savedErrno, ChannelList *activeChannels) {
+    Timestamp now(Timestamp::now());
+
+    if (numEvents > 0) {
+        LOG_DEBUG("PollPoller::poll - %d events happened", numEvents);
+        fillActiveChannels(numEvents, activeChannels);
+    } else if (numEvents == 0) {
+        LOG_DEBUG("PollPoller::poll - timeout!");
+    } else {
+        if (savedErrno != EINTR) {
+            errno = savedErrno;
+            LOG_ERROR("PollPoller::poll err! errno=%d", errno);
+        }
+    }
+    return now;
+}
+
+//!NOTE: poll 的 POLLIN/POLLOUT/POLLRDHUP 等和 epoll 的同名常量取值相同，revents 可以直接交给 Channel
+void PollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels) const {
+    for (PollFdList::const_iterator pfd = pollfds_.begin(); pfd != pollfds_.end() && numEvents > 0; ++pfd) {
+        if (pfd->revents == 0) {
+            continue;
+        }
+        --numEvents;
+        Channel *channel = findSlot(pfd->fd)->channel;
+        int revents = pfd->revents;
+        if (revents & POLLNVAL) {  // fd 没有 removeChannel 就被关闭了，epoll 中没有对应的事件，当作错误交给 channel
+            LOG_ERROR("PollPoller::fillActiveChannels - fd = %d POLLNVAL", pfd->fd);
+            revents |= EPOLLERR;
+        }
+        channel->set_revents(revents);
+        activeChannels->push_back(channel);
+    }
+}
+
+// 和 EPollPoller::commit 的状态转换相同，只是 ADD/MOD/DEL 换成修改 pollfds_
+void PollPoller::commit(ChannelSlot *s) {
+    Channel *channel = s->channel;
+    uint32_t events = static_cast<uint32_t>(channel->pollEvents()) & ~static_cast<uint32_t>(EPOLLET);
+    if (s->state != kAdded) {
+        if (!channel->isNoneEvent()) {
+            struct pollfd pfd;
+            pfd.fd = channel->fd();
+            pfd.events = static_cast<short>(events);
+            pfd.revents = 0;
+            s->state = kAdded;
+            s->events = events;
+            s->token = static_cast<uint32_t>(pollfds_.size());
+            pollfds_.push_back(pfd);
+        }
+    } else if (channel->isNoneEvent()) {
+        erase(s);
+        s->state = kDeleted;
+    } else if (events != s->events) {
+        pollfds_[s->token].events = static_cast<short>(events);
+        s->events = events;
+    }
+}
+
+void PollPoller::unregister(ChannelSlot *s) { erase(s); }
+
+void PollPoller::erase(ChannelSlot *s) {
+    size_t index = s->token;
+    if (index + 1 != pollfds_.size()) {
+        pollfds_[index] = pollfds_.back();
+        slot(pollfds_[index].fd)->token = static_cast<uint32_t>(index);
+    }
+    pollfds_.pop_back();
+    s->events = 0;
+    s->token = 0;
+}
@@ -1,12 +1,144 @@
 #include "Poller.h"
 
 #include "Channel.h"
+#include "Logger.h"
 
-Poller::Poller(EventLoop *loop) : ownerLoop_(loop) {}
+#include <limits.h>
+
+Poller::Poller(EventLoop *loop)
+    : updateRequests_(0)
+    , updateSyscalls_(0)
+    , deferredUpdates_(false)
+    , ownerLoop_(loop) {
+    ChannelSlot empty = {nullptr, kNew, 0, false, 0};
+    slots_.assign(kInitSlots, empty);
+}
+
+Timestamp Poller::pollMicroseconds(int64_t timeoutUs, ChannelList *activeChannels) {
+    int64_t timeoutMs = (timeoutUs + 999) / 1000;
+    return poll(static_cast<int>(timeoutMs < INT_MAX ? timeoutMs : INT_MAX), activeChannels);
+}
+
+void Poller::updateChannel(Channel *channel, const std::string &type) {
+    (void)type;  // 没有定义 MUDEBUG 时 LOG_DEBUG 为空
+    LOG_DEBUG("Poller::updateChannel - fd = %d, events = %d for %s", channel->fd(), channel->pollEvents(), type.c_str());
+    updateChannel(channel);
+}
+
+/**
+ * 调用关系
+ * [Channel] update/remove -> [EventLoop] updateChannel/removeChannel -> [Poller] updateChannel/removeChannel
+ * -> [EPollPoller/PollPoller/IoUringPoller] commit/unregister
+ *
+ *           EventLoop
+ *  ChannelList     Poller
+ *                  slots_[fd] = {channel*, state, events}
+ */
+void Poller::updateChannel(Channel *channel) {
+    int fd = channel->fd();
+    ChannelSlot *s = slot(fd);
+    if (s->channel != channel) {  // 新的 channel，或者 fd 被关闭后复用
+        s->channel = channel;
+        s->state = kNew;
+        s->events = 0;
+        s->token = 0;
+    }
+    updateRequests_.fetch_add(1, std::memory_order_relaxed);
+    LOG_DEBUG("Poller::updateChannel - fd = %d, events = %d, state = %d", fd, channel->pollEvents(), s->state);
+
+    if (!defer(fd, s)) {
+        commit(s);
+    }
+}
+
+// 还没提交的变化直接丢弃，没有注册过的 fd 不需要 unregister
+void Poller::removeChannel(Channel *channel) {
+    int fd = channel->fd();
+    LOG_DEBUG("Poller::removeChannel - fd = %d", fd);
+
+    const ChannelSlot *s = findSlot(fd);
+    if (s == nullptr || s->channel != channel) {
+        return;
+    }
+    updateRequests_.fetch_add(1, std::memory_order_relaxed);
+    if (s->state == kAdded) {
+        unregister(slot(fd));
+    }
+    resetSlot(fd);
+}
 
 bool Poller::hasChannel(Channel *channel) const {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    const ChannelSlot *s = findSlot(channel->fd());
+    return s != nullptr && s->channel == channel;
+}
+
+// 按 2 倍扩容，fd 的上限由 RLIMIT_NOFILE 决定，扩容次数很少
+Poller::ChannelSlot *Poller::slot(int fd) {
+    if (fd < 0) {
+        LOG_FATAL("Poller::slot - invalid fd %d", fd);
+    }
+    size_t index = static_cast<size_t>(fd);
+    if (index >= slots_.size()) {
+        size_t size = slots_.size() * 2;
+        while (size <= index) {
+            size *= 2;
+        }
+        ChannelSlot empty = {nullptr, kNew, 0, false, 0};
+        slots_.resize(size, empty);
+    }
+    return &slots_[index];
+}
+
+const Poller::ChannelSlot *Poller::findSlot(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= slots_.size()) {
+        return nullptr;
+    }
+    return &slots_[fd];
+}
+
+void Poller::resetSlot(int fd) {
+    if (fd >= 0 && static_cast<size_t>(fd) < slots_.size()) {
+        ChannelSlot &s = slots_[fd];
+        s.channel = nullptr;
+        s.state = kNew;
+        s.events = 0;
+        s.dirty = false;
+        s.token = 0;
+    }
+}
+
+void Poller::setDeferredUpdates(bool on) {
+    if (!on) {
+        flushUpdates();
+    }
+    deferredUpdates_ = on;
+}
+
+bool Poller::defer(int fd, ChannelSlot *s) {
+    if (!deferredUpdates_) {
+        return false;
+    }
+    markDirty(fd, s);
+    return true;
+}
+
+void Poller::markDirty(int fd, ChannelSlot *s) {
+    if (!s->dirty) {
+        s->dirty = true;
+        dirtyFds_.push_back(fd);
+    }
+}
+
+//!NOTE: commit 只向内核提交注册变化，不会回调用户代码，遍历期间 dirtyFds_ 和 slots_ 都不会变化
+void Poller::flushUpdates() {
+    for (int fd : dirtyFds_) {
+        ChannelSlot &s = slots_[fd];
+        if (s.dirty) {
+            s.dirty = false;
+            commit(&s);
+        }
+    }
+    dirtyFds_.clear();
 }
 
 Poller::~Poller() = default;
@@ -0,0 +1,22 @@
+#include "ReadStats.h"
+
+#include "RelaxedCounter.h"
+
+ReadStats::ReadStats() : events_(0), budgetExhausted_(0) {}
+
+void ReadStats::recordEvent(bool budgetExhausted) {
+    relaxedAdd(events_, 1);
+    if (budgetExhausted) {
+        relaxedAdd(budgetExhausted_, 1);
+    }
+}
+
+ReadStats::Snapshot ReadStats::snapshot() const {
+    Snapshot s;
+    s.sizes = sizes_.snapshot();
+    s.reads = s.sizes.count;
+    s.bytes = s.sizes.sum;
+    s.events = events_.load(std::memory_order_relaxed);
+    s.budgetExhausted = budgetExhausted_.load(std::memory_order_relaxed);
+    return s;
+}
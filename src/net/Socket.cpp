@@ -69,4 +69,27 @@ void Socket::setReusePort(bool on) {
 void Socket::setKeepAlive(bool on) {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
+}
+
+// Enable/disable SO_ZEROCOPY (Linux 4.14+)，开启之后 send 才能带 MSG_ZEROCOPY
+bool Socket::setZeroCopy(bool on) {
+    int optval = on ? 1 : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval)) == 0;
+}
+
+// SO_BUSY_POLL: 阻塞读和 epoll 等待时先在网卡队列上忙等 usec 微秒，超过 net.core.busy_read 需要 CAP_NET_ADMIN
+// SO_PREFER_BUSY_POLL (Linux 5.11+): 忙等期间推迟软中断处理，由应用线程收包
+bool Socket::setBusyPoll(int usec, bool prefer) {
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+        return false;
+    }
+    if (prefer) {
+#ifdef SO_PREFER_BUSY_POLL
+        int optval = 1;
+        return ::setsockopt(sockfd_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &optval, sizeof(optval)) == 0;
+#else
+        return false;
+#endif
+    }
+    return true;
 }
\ No newline at end of file
@@ -2,16 +2,26 @@
 
 #include "Channel.h"
 #include "EventLoop.h"
+#include "IoUringPoller.h"
 #include "Logger.h"
 #include "Socket.h"
 
 #include <errno.h>
 #include <netinet/tcp.h>
 #include <strings.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+const size_t ReadOptions::kDefaultBudget;
+
+namespace {
+// 完成模式下不小于这个大小的 recv 数据直接接管 buffer ring 的内存块，更小的拷贝，免得一个 16K 的块只装几十字节
+const size_t kAdoptMinBytes = 4096;
+}  // namespace
+
 static EventLoop *CheckLoopNotNull(EventLoop *loop) {
     if (loop == nullptr) {
         LOG_FATAL("TcpConnection [static]CheckLoopNotNull - Loop is null!");
@@ -28,17 +38,35 @@ TcpConnection::TcpConnection(EventLoop *loop,
     , name_(nameArg)
     , state_(kConnecting)
     , reading_(true)
+    , readHolds_(0)
     , socket_(new Socket(sockfd))
     , channel_(new Channel(loop, sockfd))
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
-    , highWaterMark_(64 * 1024 * 1024) {
+    , highWaterMark_(64 * 1024 * 1024)
+    , inputBuffer_(loop->chunkPool())
+    , outputQueue_(loop->chunkPool())
+    , budgetedBytes_(0)
+    , overBudget_(false)
+    , waitingLoopBudget_(false)
+    , throttling_(false)
+    , budgetEpisode_(0)
+    , bufferIdleTimeout_(0.0)
+    , bufferTimerPending_(false)
+    , uring_(nullptr)
+    , recving_(false)
+    , inputPending_(false)
+    , sendsInFlight_(0)
+    , sendFailed_(false) {
     //!NOTE: 和 acceptChannel 区分开，那个是 listenfd 只关心 setReadCallback，这个 channel 是 connfd 需要关心读写关闭以及错误
     // 下面给 channel_ 设置相应的回调函数，poller 给 channel 通知感兴趣的事件发生了，channel 会回调相应的操作函数
     channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
     channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
     channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleClose, this));
+    // EPOLLERR 既可能是连接出错，也可能只是 error queue 上有 zerocopy 完成通知，由 handleError 区分
+    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+
+    inputBuffer_.setAdaptiveRead(readOptions_.adaptive);
 
     LOG_INFO("TcpConnection::ctor[%s] at fd=%d", name_.c_str(), (int)state_);
     socket_->setKeepAlive(true);
@@ -48,13 +76,67 @@ TcpConnection::~TcpConnection() {
     LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d", name_.c_str(), channel_->fd(), (int)state_);
 }
 
+int TcpConnection::fd() const { return channel_->fd(); }
+
+size_t TcpConnection::memoryFootprint() const {
+    return sizeof(TcpConnection) + sizeof(Socket) + sizeof(Channel) + inputBuffer_.footprint() + outputQueue_.footprint();
+}
+
+void TcpConnection::shrinkBuffers() {
+    inputBuffer_.shrink();
+    if (outputQueue_.empty()) {
+        outputQueue_.shrink();
+    }
+}
+
+void TcpConnection::scheduleBufferRelease() {
+    if (bufferIdleTimeout_ <= 0 || bufferTimerPending_) {
+        return;
+    }
+    bufferTimerPending_ = true;
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    loop_->runAfter(bufferIdleTimeout_, [weakConn]() {
+        TcpConnectionPtr conn = weakConn.lock();
+        if (conn) {
+            conn->onBufferIdleTimer();
+        }
+    });
+}
+
+/**
+ * 定时器到期时检查最近一次读写的时间: 已经空闲够久就归还存储；
+ * 期间有过读写就按剩余时间重新等待，避免每次读写都新建定时器
+ */
+void TcpConnection::onBufferIdleTimer() {
+    bufferTimerPending_ = false;
+    if (state_ == kDisconnected || (inputBuffer_.footprint() == 0 && outputQueue_.footprint() == 0)) {
+        return;
+    }
+    double idle = timeDifference(Timestamp::now(), lastActive_);
+    if (idle >= bufferIdleTimeout_) {
+        if (inputBuffer_.readableBytes() == 0 && outputQueue_.empty()) {
+            shrinkBuffers();
+        }
+        return;
+    }
+    bufferTimerPending_ = true;
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    loop_->runAfter(bufferIdleTimeout_ - idle, [weakConn]() {
+        TcpConnectionPtr conn = weakConn.lock();
+        if (conn) {
+            conn->onBufferIdleTimer();
+        }
+    });
+}
+
 // 发送数据
 void TcpConnection::send(const std::string &buf) {
     if (state_ == kConnected) {
         if (loop_->isInLoopThread()) {
             sendInLoop(buf.c_str(), buf.size());
         } else {
-            loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+            //!NOTE: 跨线程时必须拷贝一份数据，调用者的 buf 在 loop 执行之前可能已经释放
+            send(std::string(buf));
         }
     }
 }
@@ -62,17 +144,117 @@ void TcpConnection::send(const std::string &buf) {
 void TcpConnection::send(Buffer *buf) {
     if (state_ == kConnected) {
         if (loop_->isInLoopThread()) {
-            sendInLoop(buf->peek(), buf->readableBytes());
-            buf->retrieveAll(); // 将读缓冲区全部发送
+            sendBufferInLoop(buf);
         } else {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop, 
-                this, 
-                buf->retrieveAllAsString().c_str(), 
-                buf->retrieveAllAsString().size())
-            );
+            send(buf->retrieveAllAsString());
+        }
+    }
+}
+
+void TcpConnection::send(std::string &&message) {
+    if (state_ != kConnected || message.empty()) {
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        std::vector<std::string> slices(1);
+        slices[0].swap(message);
+        sendvInLoop(slices);
+        return;
+    }
+    queuePendingSend(PendingSend(std::move(message)));
+}
+
+void TcpConnection::send(Buffer &&buf) {
+    if (state_ != kConnected || buf.readableBytes() == 0) {
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        sendBufferInLoop(&buf);
+        return;
+    }
+    queuePendingSend(PendingSend(std::move(buf)));
+}
+
+/**
+ * 其他线程的各种发送都按调用顺序进入同一个队列，一次 flush 之前积累的数据只投递一次回调，
+ * 而且不会被之后 runInLoop 投递的发送插队
+ */
+void TcpConnection::queuePendingSend(PendingSend &&item) {
+    bool scheduleFlush = false;
+    {
+        std::unique_lock<std::mutex> lock(pendingMutex_);
+        scheduleFlush = pendingSends_.empty();
+        pendingSends_.push_back(std::move(item));
+    }
+    if (scheduleFlush) {
+        loop_->queueInLoop(std::bind(&TcpConnection::flushPendingSends, shared_from_this()));
+    }
+}
+
+// 分段模式的 Buffer 逐段发送，连续模式只会循环一次
+void TcpConnection::sendBufferInLoop(Buffer *buf) {
+    while (buf->readableBytes() > 0) {
+        size_t len = buf->contiguousBytes();
+        sendInLoop(buf->peek(), len);
+        buf->retrieve(len);
+    }
+}
+
+/**
+ * 一次取走其他线程积累的所有数据，按放入的顺序发送，相邻的 string 和 sendv 的多段数据合成一次 sendv(一次 writev)，
+ * 之后再到达的数据会投递新的 flush
+ */
+void TcpConnection::flushPendingSends() {
+    std::vector<PendingSend> pending;
+    {
+        std::unique_lock<std::mutex> lock(pendingMutex_);
+        pending.swap(pendingSends_);
+    }
+    if (state_ == kDisconnected) {
+        LOG_ERROR("TcpConnection::flushPendingSends - disconnected, give up writing!");
+        for (const PendingSend &item : pending) {
+            if (item.kind == PendingSend::kFile) {
+                ::close(item.fileFd);
+            }
+        }
+        return;
+    }
+
+    std::vector<std::string> slices;
+    slices.reserve(pending.size());
+    for (PendingSend &item : pending) {
+        if (item.kind == PendingSend::kString) {
+            slices.push_back(std::move(item.data));
+            continue;
+        }
+        if (item.kind == PendingSend::kSlices) {
+            for (std::string &slice : item.slices) {
+                slices.push_back(std::move(slice));
+            }
+            continue;
+        }
+
+        if (!slices.empty()) {
+            sendvInLoop(slices);
+            slices.clear();
+        }
+        switch (item.kind) {
+            case PendingSend::kBuffer:
+                sendBufferInLoop(item.buffer.get());
+                break;
+            case PendingSend::kPayload:
+                sendPayloadInLoop(item.payload);
+                break;
+            case PendingSend::kFile:
+                sendFileInLoop(item.fileFd, item.fileOffset, item.fileLength);
+                break;
+            default:
+                break;
         }
     }
+    if (!slices.empty()) {
+        sendvInLoop(slices);
+    }
 }
 
 /**
@@ -90,13 +272,15 @@ void TcpConnection::sendInLoop(const void *data, size_t len) {
     }
 
     // 表示 channel 第一次开始写数据，而且缓冲区没有发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
+    bool tried = uring_ == nullptr && !channel_->isWriting() && outputQueue_.empty();
+    if (tried) {
+        loop_->loopStats().countSyscall(LoopStats::kWrite);
         nwrote = ::write(channel_->fd(), data, len);
         if (nwrote >= 0) {
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_) {
                 // 既然这里数据全部发送完成，就不用再给 channel 设置 epollout 事件
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                queueWriteComplete();
             }
         } else {  // nwrote < 0
             nwrote = 0;
@@ -117,17 +301,247 @@ void TcpConnection::sendInLoop(const void *data, size_t len) {
      */
     if (!faultError && remaining > 0) {
         // 目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_) {
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+        size_t oldLen = outputQueue_.readableBytes();
+        outputQueue_.append(static_cast<const char *>(data) + nwrote, remaining);
+        queueOutput(oldLen, remaining, tried);
+    }
+}
+
+void TcpConnection::sendv(std::vector<std::string> &&slices) {
+    if (state_ == kConnected) {
+        if (loop_->isInLoopThread()) {
+            sendvInLoop(slices);
+        } else {
+            // slices 被移动进待发送队列，跨线程也只移动不拷贝
+            queuePendingSend(PendingSend(std::move(slices)));
+        }
+    }
+}
+
+/**
+ * 和 sendInLoop 一样，先尝试直接 writev，没写完的部分按顺序接管进 outputQueue_，不做拷贝
+ */
+void TcpConnection::sendvInLoop(std::vector<std::string> &slices) {
+    if (state_ == kDisconnected) {
+        LOG_ERROR("TcpConnection::sendvInLoop - disconnected, give up writing!");
+        return;
+    }
+
+    size_t total = 0;
+    for (const std::string &slice : slices) {
+        total += slice.size();
+    }
+    if (total == 0) {
+        return;
+    }
+
+    // 有需要 zerocopy 的大块数据时不走直接 writev，全部入队由 handleWrite 按顺序发送
+    bool zeroCopy = false;
+    if (outputQueue_.zeroCopyThreshold() > 0) {
+        for (const std::string &slice : slices) {
+            if (slice.size() >= outputQueue_.zeroCopyThreshold()) {
+                zeroCopy = true;
+                break;
+            }
+        }
+    }
+
+    size_t nwrote = 0;
+    bool socketFull = false;  // 写入的少于交给 writev 的数据，slices 超过 kMaxIovecs 时没写完不代表写满
+    if (!zeroCopy && uring_ == nullptr && !channel_->isWriting() && outputQueue_.empty()) {
+        struct iovec vec[OutputQueue::kMaxIovecs];
+        int iovcnt = 0;
+        size_t offered = 0;
+        for (const std::string &slice : slices) {
+            if (iovcnt == OutputQueue::kMaxIovecs) {
+                break;
+            }
+            if (!slice.empty()) {
+                vec[iovcnt].iov_base = const_cast<char *>(slice.data());
+                vec[iovcnt].iov_len = slice.size();
+                offered += slice.size();
+                ++iovcnt;
+            }
+        }
+
+        loop_->loopStats().countSyscall(LoopStats::kWrite);
+        ssize_t n = ::writev(channel_->fd(), vec, iovcnt);
+        socketFull = n < 0 || static_cast<size_t>(n) < offered;
+        if (n >= 0) {
+            nwrote = n;
+            if (nwrote == total && writeCompleteCallback_) {
+                queueWriteComplete();
+            }
+        } else if (errno != EWOULDBLOCK) {
+            LOG_ERROR("TcpConnection::sendvInLoop - errno = %d", errno);
+            if (errno == EPIPE || errno == ECONNRESET) {
+                return;
+            }
+        }
+    }
+
+    if (nwrote < total) {
+        size_t oldLen = outputQueue_.readableBytes();
+        size_t skip = nwrote;
+        for (std::string &slice : slices) {
+            if (skip >= slice.size()) {
+                skip -= slice.size();
+                continue;
+            }
+            outputQueue_.append(std::move(slice), skip);
+            skip = 0;
+        }
+        queueOutput(oldLen, total - nwrote, socketFull);
+    }
+}
+
+void TcpConnection::send(const PayloadPtr &payload) {
+    if (state_ == kConnected && payload) {
+        if (loop_->isInLoopThread()) {
+            sendPayloadInLoop(payload);
+        } else {
+            queuePendingSend(PendingSend(payload));
+        }
+    }
+}
+
+// 和 sendInLoop 一样先尝试直接写，没写完的部分只引用 payload 并记录偏移，不拷贝
+void TcpConnection::sendPayloadInLoop(const PayloadPtr &payload) {
+    if (state_ == kDisconnected) {
+        LOG_ERROR("TcpConnection::sendPayloadInLoop - disconnected, give up writing!");
+        return;
+    }
+
+    size_t total = payload->size();
+    if (total == 0) {
+        return;
+    }
+
+    size_t nwrote = 0;
+    bool zeroCopy = outputQueue_.zeroCopyThreshold() > 0 && total >= outputQueue_.zeroCopyThreshold();
+    bool tried = !zeroCopy && uring_ == nullptr && !channel_->isWriting() && outputQueue_.empty();
+    if (tried) {
+        loop_->loopStats().countSyscall(LoopStats::kWrite);
+        ssize_t n = ::write(channel_->fd(), payload->data(), total);
+        if (n >= 0) {
+            nwrote = n;
+            if (nwrote == total && writeCompleteCallback_) {
+                queueWriteComplete();
+            }
+        } else if (errno != EWOULDBLOCK) {
+            LOG_ERROR("TcpConnection::sendPayloadInLoop - errno = %d", errno);
+            if (errno == EPIPE || errno == ECONNRESET) {
+                return;
+            }
+        }
+    }
+
+    if (nwrote < total) {
+        size_t oldLen = outputQueue_.readableBytes();
+        outputQueue_.append(payload, nwrote);
+        queueOutput(oldLen, total - nwrote, tried);
+    }
+}
+
+void TcpConnection::setZeroCopyThreshold(size_t threshold) {
+    if (threshold > 0 && !socket_->setZeroCopy(true)) {
+        LOG_ERROR("TcpConnection::setZeroCopyThreshold - SO_ZEROCOPY not supported, fd = %d errno = %d", channel_->fd(), errno);
+        return;
+    }
+    outputQueue_.setZeroCopyThreshold(threshold);
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length) {
+    if (state_ != kConnected || length == 0) {
+        return;
+    }
+    int fileFd = ::dup(fd);
+    if (fileFd < 0) {
+        LOG_ERROR("TcpConnection::sendFile - dup fd = %d errno = %d", fd, errno);
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        sendFileInLoop(fileFd, offset, length);
+    } else {
+        queuePendingSend(PendingSend(fileFd, offset, length));
+    }
+}
+
+/**
+ * 队列为空时直接 sendfile，发不完的部分(或者前面还有数据没发完)挂到 outputQueue_ 尾部，
+ * 由 handleWrite 按顺序继续发送
+ */
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length) {
+    if (state_ == kDisconnected) {
+        LOG_ERROR("TcpConnection::sendFileInLoop - disconnected, give up writing!");
+        ::close(fd);
+        return;
+    }
+
+    size_t nwrote = 0;
+    bool socketFull = false;  // 只有 EAGAIN 才确定写满了，sendfile 返回得少也可能是单次上限或者文件被截断
+    if (uring_ == nullptr && !channel_->isWriting() && outputQueue_.empty()) {
+        off_t off = offset;
+        loop_->loopStats().countSyscall(LoopStats::kWrite);
+        ssize_t n = ::sendfile(channel_->fd(), fd, &off, length);
+        socketFull = n < 0;
+        if (n >= 0) {
+            nwrote = n;
+            if (nwrote == length) {
+                ::close(fd);
+                if (writeCompleteCallback_) {
+                    queueWriteComplete();
+                }
+                return;
+            }
+        } else if (errno != EWOULDBLOCK) {
+            LOG_ERROR("TcpConnection::sendFileInLoop - errno = %d", errno);
+            if (errno == EPIPE || errno == ECONNRESET) {
+                ::close(fd);
+                return;
+            }
         }
-        outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
+    }
 
-        //!NOTE: 这里一定要注册 channel 的写事件，否则 poller 不会给 channel 通知 epollout
-        if (!channel_->isWriting()) {
-            channel_->enableWriting();
+    size_t oldLen = outputQueue_.readableBytes();
+    outputQueue_.appendFile(fd, offset + nwrote, length - nwrote);
+    queueOutput(oldLen, length - nwrote, socketFull);
+}
+
+//!NOTE: 只绑定成员函数和 shared_ptr，不拷贝用户的 std::function(拷贝可能申请内存)，执行时再从连接上取回调
+void TcpConnection::queueWriteComplete() {
+    loop_->queueInLoop(std::bind(&TcpConnection::runWriteComplete, shared_from_this()));
+}
+
+void TcpConnection::runWriteComplete() {
+    if (writeCompleteCallback_) {
+        writeCompleteCallback_(shared_from_this());
+    }
+}
+
+void TcpConnection::runHighWaterMark(size_t queued) {
+    if (highWaterMarkCallback_) {
+        highWaterMarkCallback_(shared_from_this(), queued);
+    }
+}
+
+void TcpConnection::queueOutput(size_t oldLen, size_t remaining, bool socketFull) {
+    if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_) {
+        loop_->queueInLoop(std::bind(&TcpConnection::runHighWaterMark, shared_from_this(), oldLen + remaining));
+    }
+
+    //!NOTE: 这里一定要注册 channel 的写事件，否则 poller 不会给 channel 通知 epollout
+    if (uring_ != nullptr || sendsInFlight_ > 0) {
+        submitSends();  // 完成模式不直接写，全部入队之后提交
+    } else if (!channel_->isWriting()) {
+        channel_->enableWriting();
+        // 边缘触发: 没有写满 socket 就不会再有新的写事件，自己补一次写
+        if (channel_->edgeTriggered() && !socketFull) {
+            loop_->queueInLoop(std::bind(&TcpConnection::resumeWrite, shared_from_this()));
         }
     }
+
+    updateOutputBudget();
 }
 
 // 关闭连接
@@ -140,7 +554,7 @@ void TcpConnection::shutdown() {
 
 //!NOTE: shutdown 过程有 channel_ 还没有写完，直到 readableBytes() == 0，和 handleWrite() 关联
 void TcpConnection::shutdownInLoop() {
-    if (!channel_->isWriting()) // 说明 outputBuffer 中的数据已经全部发送完成
+    if (!channel_->isWriting() && sendsInFlight_ == 0) // 说明 outputBuffer 中的数据已经全部发送完成
     { 
         socket_->shutdownWrite(); // 关闭写端，EPOLLHUP 自动注册
     }
@@ -151,12 +565,32 @@ void TcpConnection::connectEstablished() {
     setState(kConnected);
     //!NOTE: 防止上层将 TcpConnection 给 remove 掉而 callback 执行出错
     channel_->tie(shared_from_this());
+    // 旁路和 zerocopy(完成通知在 error queue 上)都依赖就绪事件，这样的连接不用完成模式
+    uring_ = rawReadCallback_ || outputQueue_.zeroCopyThreshold() > 0 ? nullptr : loop_->completionPoller();
+    if (uring_ != nullptr) {
+        //!NOTE: 交给内核的数据在 send 完成之前不能移动，发送队列的 Buffer 固定使用分段模式(追加时不搬移已有数据)
+        outputQueue_.setBufferMode(Buffer::kSegmented);
+        channel_->setCompletionCallback(std::bind(&TcpConnection::handleCompletion, this, std::placeholders::_1));
+        updateReading();  // 提交 multishot recv，建立之前已经被下游暂停时不提交
+    } else {
+        channel_->setEdgeTriggered(loop_->edgeTriggered() && !rawReadCallback_);
 #ifdef CHANNELTYPE
-    channel_->enableReading("connChannel in " + name());  // 向 poller 注册 channel 的 epollin 事件
+        channel_->enableReading("connChannel in " + name());  // 向 poller 注册 channel 的 epollin 事件
 #else
-    channel_->enableReading();  // 向 poller 注册 channel 的 epollin 事件
+        channel_->enableReading();  // 向 poller 注册 channel 的 epollin 事件
 #endif
 
+        if (readHolds_ > 0) {
+            updateReading();  // 建立之前已经被下游暂停
+        }
+    }
+
+    const BusyPollOptions &busyPoll = loop_->busyPollOptions();
+    if (busyPoll.socketBusyPollMicroseconds > 0 &&
+        !socket_->setBusyPoll(busyPoll.socketBusyPollMicroseconds, busyPoll.preferBusyPoll)) {
+        LOG_ERROR("TcpConnection::connectEstablished - [%s] SO_BUSY_POLL failed: %d", name_.c_str(), errno);
+    }
+
     // 新连接建立，执行回调
     connectionCallback_(shared_from_this());
 }
@@ -185,6 +619,264 @@ void TcpConnection::forceCloseWithDelay(double seconds)
     }
 }
 
+void TcpConnection::startRead() {
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop() {
+    reading_ = true;
+    updateReading();
+}
+
+void TcpConnection::stopRead() {
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop() {
+    reading_ = false;
+    updateReading();
+}
+
+//!NOTE: 只在连接建立之后操作 channel，connectEstablished 之前的 hold 由 connectEstablished 处理
+void TcpConnection::updateReading() {
+    if (state_ != kConnected && state_ != kDisconnecting) {
+        return;
+    }
+    bool want = reading_ && readHolds_ == 0;
+    if (uring_ != nullptr) {
+        if (want && !recving_) {
+            recving_ = true;
+            uring_->startRecv(channel_.get());
+            if (inputPending_) {
+                loop_->queueInLoop(std::bind(&TcpConnection::deliverPendingInput, shared_from_this()));
+            }
+        } else if (!want && recving_) {
+            recving_ = false;
+            uring_->stopRecv(channel_.get());
+        }
+        return;
+    }
+    if (want && !channel_->isReading()) {
+        channel_->enableReading();
+        // 边缘触发: 暂停期间到达的数据不会再产生读事件
+        if (channel_->edgeTriggered()) {
+            loop_->queueInLoop(std::bind(&TcpConnection::resumeRead, shared_from_this()));
+        }
+    } else if (!want && channel_->isReading()) {
+        channel_->disableReading();
+    }
+}
+
+void TcpConnection::holdRead() {
+    if (loop_->isInLoopThread()) {
+        holdReadInLoop();
+    } else {
+        loop_->runInLoop(std::bind(&TcpConnection::holdReadInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::releaseRead() {
+    if (loop_->isInLoopThread()) {
+        releaseReadInLoop();
+    } else {
+        loop_->runInLoop(std::bind(&TcpConnection::releaseReadInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::holdReadInLoop() {
+    ++readHolds_;
+    updateReading();
+}
+
+void TcpConnection::releaseReadInLoop() {
+    if (readHolds_ > 0) {
+        --readHolds_;
+    }
+    updateReading();
+}
+
+void TcpConnection::addFeeder(const TcpConnectionPtr &peer) {
+    loop_->runInLoop(std::bind(&TcpConnection::addFeederInLoop, shared_from_this(), std::weak_ptr<TcpConnection>(peer)));
+}
+
+void TcpConnection::removeFeeder(const TcpConnectionPtr &peer) {
+    loop_->runInLoop(
+        std::bind(&TcpConnection::removeFeederInLoop, shared_from_this(), std::weak_ptr<TcpConnection>(peer)));
+}
+
+void TcpConnection::addFeederInLoop(const std::weak_ptr<TcpConnection> &peer) {
+    feeders_.push_back(peer);
+    // 已经处于反压状态时，新的 feeder 也要暂停
+    TcpConnectionPtr feeder = peer.lock();
+    if (throttling_ && feeder) {
+        feeder->holdRead();
+    }
+}
+
+void TcpConnection::removeFeederInLoop(const std::weak_ptr<TcpConnection> &peer) {
+    for (auto it = feeders_.begin(); it != feeders_.end(); ++it) {
+        if (!it->owner_before(peer) && !peer.owner_before(*it)) {
+            TcpConnectionPtr feeder = it->lock();
+            if (throttling_ && feeder) {
+                feeder->releaseRead();
+            }
+            feeders_.erase(it);
+            return;
+        }
+    }
+}
+
+/**
+ * 把 outputQueue_ 的变化计入 loop 的预算，然后依次检查:
+ * 超过 hardLimit 立即断开；超过连接预算暂停读(kEvictSlow 时启动定时器)；loop 超过预算时有数据排队的连接也暂停读
+ */
+void TcpConnection::updateOutputBudget() {
+    OutputBudget &budget = loop_->outputBudget();
+    const OutputBudgetOptions &options = budget.options();
+    size_t queued = outputQueue_.memoryBytes();  // sendFile 的文件区间不占内存，不计入预算
+    if (queued > budgetedBytes_) {
+        budget.add(queued - budgetedBytes_);
+    } else if (queued < budgetedBytes_) {
+        budget.remove(budgetedBytes_ - queued);  // 可能恢复其他连接
+    }
+    budgetedBytes_ = queued;
+
+    if (options.hardLimit > 0 && queued > options.hardLimit) {
+        LOG_ERROR("TcpConnection::updateOutputBudget [%s] - %zu bytes queued, over hard limit, closing", name_.c_str(), queued);
+        budget.recordEviction();
+        forceClose();
+        return;
+    }
+
+    if (options.connectionHighMark > 0 && !overBudget_ && queued > options.connectionHighMark) {
+        overBudget_ = true;
+        ++budgetEpisode_;
+        if (options.eviction == OutputBudgetOptions::kEvictSlow) {
+            std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+            uint64_t episode = budgetEpisode_;
+            loop_->runAfter(options.evictSeconds, [weakConn, episode]() {
+                TcpConnectionPtr conn = weakConn.lock();
+                if (conn) {
+                    conn->evictIfOverBudget(episode);
+                }
+            });
+        }
+    } else if (overBudget_ && queued <= budget.connectionLowMark()) {
+        overBudget_ = false;
+        ++budgetEpisode_;
+    }
+
+    if (!waitingLoopBudget_ && queued > 0 && budget.overLoopLimit()) {
+        waitingLoopBudget_ = true;
+        std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+        budget.waitForDrain([weakConn]() {
+            TcpConnectionPtr conn = weakConn.lock();
+            if (conn) {
+                conn->onLoopBudgetDrained();
+            }
+        });
+    }
+
+    setThrottling(overBudget_ || waitingLoopBudget_);
+}
+
+void TcpConnection::onLoopBudgetDrained() {
+    waitingLoopBudget_ = false;
+    if (state_ != kDisconnected) {
+        setThrottling(overBudget_);
+    }
+}
+
+void TcpConnection::evictIfOverBudget(uint64_t episode) {
+    if (overBudget_ && budgetEpisode_ == episode && state_ != kDisconnected) {
+        LOG_ERROR("TcpConnection::evictIfOverBudget [%s] - %zu bytes queued for too long, closing",
+                  name_.c_str(), outputQueue_.memoryBytes());
+        loop_->outputBudget().recordEviction();
+        forceClose();
+    }
+}
+
+void TcpConnection::setThrottling(bool on) {
+    if (on == throttling_) {
+        return;
+    }
+    throttling_ = on;
+    if (on) {
+        loop_->outputBudget().recordPause();
+        holdReadInLoop();
+    } else {
+        releaseReadInLoop();
+    }
+    for (const std::weak_ptr<TcpConnection> &peer : feeders_) {
+        TcpConnectionPtr feeder = peer.lock();
+        if (!feeder) {
+            continue;
+        }
+        if (on) {
+            feeder->holdRead();
+        } else {
+            feeder->releaseRead();
+        }
+    }
+}
+
+// 连接关闭之后发送队列不会再变化，归还预算，被本连接暂停的 feeders 恢复读
+void TcpConnection::releaseOutputBudget() {
+    if (budgetedBytes_ > 0) {
+        size_t n = budgetedBytes_;
+        budgetedBytes_ = 0;
+        loop_->outputBudget().remove(n);
+    }
+    overBudget_ = false;
+    waitingLoopBudget_ = false;
+    setThrottling(false);
+}
+
+// outputQueue 中还有数据时必须继续关注写事件，由 handleWrite 在发完后取消
+void TcpConnection::setRawReadCallback(const RawEventCallback &cb) {
+    rawReadCallback_ = cb;
+    if (rawReadCallback_ && channel_->edgeTriggered()) {
+        channel_->setEdgeTriggered(false);
+    }
+    if (rawReadCallback_ && uring_ != nullptr) {
+        leaveCompletionMode();
+    }
+}
+
+//!NOTE: 取消之前已经完成的 recv 仍然会交给 handleRecvCompletion，追加到 inputBuffer_；
+// 在途的 send 完成之后，剩下的数据由 submitSends 转交给 handleWrite
+void TcpConnection::leaveCompletionMode() {
+    if (recving_) {
+        recving_ = false;
+        uring_->stopRecv(channel_.get());
+    }
+    uring_ = nullptr;
+    updateReading();
+}
+
+void TcpConnection::resumeRead() {
+    if ((state_ == kConnected || state_ == kDisconnecting) && channel_->isReading()) {
+        handleRead(Timestamp::now());
+    }
+}
+
+void TcpConnection::resumeWrite() {
+    if (channel_->isWriting()) {
+        handleWrite();
+    }
+}
+
+void TcpConnection::setWriteInterest(bool on) {
+    if (state_ == kDisconnected) {
+        return;
+    }
+    if (on && !channel_->isWriting()) {
+        channel_->enableWriting();
+    } else if (!on && channel_->isWriting() && outputQueue_.empty()) {
+        channel_->disableWriting();
+    }
+}
+
 void TcpConnection::forceCloseInLoop()
 {
     if (state_ == kConnected || state_ == kDisconnecting)
@@ -201,49 +893,116 @@ void TcpConnection::connectDestroyed() {
         channel_->disableAll();  // 把 channel 所有感兴趣的事件，从 poller 中 del 掉
         connectionCallback_(shared_from_this());
     }
+    releaseOutputBudget();
 
     channel_->remove();  // 把 channel 从 poller 中删除掉
 }
 
 // 从 connfd 读取数据到 inputBuffer_ 并执行上层设置的 messageCallback_
+//!NOTE: drain 模式下循环读取，直到某次没有读满(socket 已经读空)、遇到 EOF/错误或者用完预算，最后只回调一次
 void TcpConnection::handleRead(Timestamp receiveTime) {
+    if (rawReadCallback_) {
+        rawReadCallback_();
+        return;
+    }
+
+    ReadStats &stats = loop_->readStats();
+    //!NOTE: 边缘触发必须读到 socket 读空(读不满就说明读空了)，否则不会再有读事件
+    bool drain = readOptions_.drain || channel_->edgeTriggered();
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-    if (n > 0) {
+    size_t total = 0;
+    ssize_t n = 0;
+    for (;;) {
+        loop_->loopStats().countSyscall(LoopStats::kRead);
+        n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+        stats.recordRead(n);
+        if (!drain || !inputBuffer_.lastReadFilled() || total >= readOptions_.budget) {
+            break;
+        }
+    }
+    bool budgetExhausted = drain && n > 0 && inputBuffer_.lastReadFilled() && total >= readOptions_.budget;
+    stats.recordEvent(budgetExhausted);
+    if (budgetExhausted && channel_->edgeTriggered()) {
+        // 用完预算还没读空: 先让同一 loop 上的其他连接处理，之后自己接着读
+        loop_->queueInLoop(std::bind(&TcpConnection::resumeRead, shared_from_this()));
+    }
+
+    if (total > 0) {
         // 已经建立连接的用户，有可读事件发生了，调用用户传入的回调操作 onMessage
         //!NOTE: shared_from_this() 返回当前对象的 shared_ptr
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
-    } else if (n == 0) { // 断开连接
+        lastActive_ = receiveTime;
+        if (inputBuffer_.readableBytes() == 0) {
+            scheduleBufferRelease();
+        }
+    }
+
+    if (n == 0) { // 断开连接
         handleClose();
-    } else {
+    } else if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK) {
         errno = savedErrno;
         LOG_ERROR("TcpConnection::handleRead - errno = %d", errno);
         handleError();
     }
 }
 
-// 从 connfd 写数据到 outputBuffer_ 并执行上层设置的 writeCompleteCallback_
+// 从 outputQueue_ 写数据到 connfd 并执行上层设置的 writeCompleteCallback_
 void TcpConnection::handleWrite() {
     if (channel_->isWriting()) {
+        if (outputQueue_.empty() && rawWriteCallback_) {
+            rawWriteCallback_();
+            return;
+        }
+        if (sendsInFlight_ > 0) {
+            return;  // 刚退出完成模式，队头的数据还在内核的 send 中
+        }
+
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0) {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0) {
+        ssize_t total = 0;
+        ssize_t n = 0;
+        //!NOTE: 边缘触发时要写到 socket 写满或者队列写空，否则不会再有写事件
+        do {
+            loop_->loopStats().countSyscall(LoopStats::kWrite);
+            n = outputQueue_.writeFd(channel_->fd(), &savedErrno);
+            if (n > 0) {
+                outputQueue_.retrieve(n);
+                total += n;
+            }
+        } while (n > 0 && channel_->edgeTriggered() && !outputQueue_.empty() && !outputQueue_.lastWriteShort());
+
+        if (total > 0) {
+            updateOutputBudget();
+            lastActive_ = loop_->pollReturnTime();
+            if (outputQueue_.empty()) {
                 channel_->disableWriting();  // 写完了变成不可写
+                scheduleBufferRelease();
 
                 //!NOTE: 唤醒 loop_ 对应的 thread 线程，执行回调，实际上就是本线程调用的
                 // 可以直接回调，类似于 handleRead 中 messageCallback_
                 if (writeCompleteCallback_) {
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                    queueWriteComplete();
                 }
 
                 if (state_ == kDisconnecting) {
                     shutdownInLoop();
                 }
+
+                // 旁路模式下队列发完之后轮到旁路的数据
+                if (rawWriteCallback_) {
+                    rawWriteCallback_();
+                }
+            }
+        }
+        if ((n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK) || (n == 0 && total == 0)) {
+            LOG_ERROR("TcpConnection::handleWrite() - errno = %d", savedErrno);
+            if (savedErrno == ENODATA) {
+                // sendFile 的文件比声明的长度短，剩下的数据永远发不出去，只能断开
+                handleClose();
             }
-        } else {
-            LOG_ERROR("TcpConnection::handleWrite() - errno = %d", errno);
         }
     } else {
         LOG_ERROR("TcpConnection::handleWrite() - fd = %d is down, no more writing", channel_->fd());
@@ -253,8 +1012,17 @@ void TcpConnection::handleWrite() {
 // poller => channel::closeCallback => TcpConnection::handleClose
 void TcpConnection::handleClose() {
     LOG_INFO("TcpConnection::handleClose() - fd = %d, state = %d", channel_->fd(), (int)state_);
+    //!NOTE: 同一次事件里 EPOLLERR 和 EPOLLIN 可能先后走到这里，只关闭一次
+    if (state_ == kDisconnected) {
+        return;
+    }
     setState(kDisconnected);
     channel_->disableAll();
+    if (recving_) {
+        recving_ = false;
+        uring_->stopRecv(channel_.get());
+    }
+    releaseOutputBudget();
 
     //!NOTE: 这里再次调用 connectionCallback_ 处理断开事件的 callback，实际上是给用户一个提示 disConnected，没有处理
     TcpConnectionPtr connPtr(shared_from_this());
@@ -263,6 +1031,11 @@ void TcpConnection::handleClose() {
 }
 
 void TcpConnection::handleError() {
+    // 先处理 zerocopy 完成通知，释放已经被内核发送完的数据
+    if (outputQueue_.zeroCopyThreshold() > 0 || outputQueue_.pinnedBytes() > 0) {
+        outputQueue_.handleZeroCopyCompletions(channel_->fd());
+    }
+
     int optval;
     socklen_t optlen = sizeof(optval);
     int err = 0;
@@ -272,5 +1045,127 @@ void TcpConnection::handleError() {
         err = optval;
     }
 
-    LOG_ERROR("TcpConnection::handleError() - name: %s, SO_ERROR: %d", name_.c_str(), err);
+    if (err != 0) {
+        LOG_ERROR("TcpConnection::handleError() - name: %s, SO_ERROR: %d", name_.c_str(), err);
+        handleClose();
+    }
+}
+
+void TcpConnection::handleCompletion(Completion &completion) {
+    if (completion.op == Completion::kRecv) {
+        handleRecvCompletion(completion);
+    } else if (completion.op == Completion::kSend) {
+        handleSendCompletion(completion);
+    }
+}
+
+/**
+ * multishot recv 的一个结果: 大块数据直接接管 buffer ring 的内存块(Buffer::adopt)，不再拷贝，然后和 handleRead 一样回调
+ * 读到 0 或者出错时 recv 已经结束，关闭连接
+ */
+void TcpConnection::handleRecvCompletion(Completion &completion) {
+    if (state_ == kDisconnected) {
+        return;
+    }
+    if (completion.result > 0) {
+        size_t n = static_cast<size_t>(completion.result);
+        ReadStats &stats = loop_->readStats();
+        stats.recordRead(n);
+        stats.recordEvent(false);
+        if (n >= kAdoptMinBytes && inputBuffer_.adopt(completion.data, completion.capacity, n, loop_->chunkPool().get())) {
+            completion.taken = true;
+        } else {
+            inputBuffer_.append(completion.data, n);
+        }
+        //!NOTE: 取消 recv 之前内核可能已经收了一整个 buffer ring 的数据，暂停读时先攒着，和就绪模式一样不回调
+        if (!recving_) {
+            inputPending_ = true;
+            return;
+        }
+        inputPending_ = false;
+
+        Timestamp receiveTime = loop_->pollReturnTime();
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        lastActive_ = receiveTime;
+        if (inputBuffer_.readableBytes() == 0) {
+            scheduleBufferRelease();
+        }
+        return;
+    }
+
+    if (!completion.more) {
+        recving_ = false;
+    }
+    if (completion.result == 0) {
+        if (inputPending_) {
+            inputPending_ = false;
+            messageCallback_(shared_from_this(), &inputBuffer_, loop_->pollReturnTime());  // 关闭之前交出攒着的数据
+        }
+        handleClose();
+    } else if (completion.result != -ECANCELED) {
+        //!NOTE: recv 返回错误时已经取走了 SO_ERROR，不能再交给 handleError 判断
+        LOG_ERROR("TcpConnection::handleRecvCompletion - [%s] errno = %d", name_.c_str(), -completion.result);
+        handleClose();
+    }
+}
+
+/**
+ * 一条链中的 send 按顺序完成，每个结果 retrieve 对应的字节数；链上的 send 全部有结果之后再提交下一条
+ * 部分发送之后的 send 以 -ECANCELED 结束，数据还在队列中，重新提交即可；其他错误关闭连接
+ */
+void TcpConnection::handleSendCompletion(const Completion &completion) {
+    --sendsInFlight_;
+    if (completion.result > 0) {
+        outputQueue_.retrieve(static_cast<size_t>(completion.result));
+    } else if (completion.result < 0 && completion.result != -ECANCELED && !sendFailed_) {
+        sendFailed_ = true;
+        LOG_ERROR("TcpConnection::handleSendCompletion - [%s] errno = %d", name_.c_str(), -completion.result);
+    }
+    if (sendsInFlight_ > 0 || state_ == kDisconnected) {
+        return;
+    }
+    if (sendFailed_) {
+        handleClose();
+        return;
+    }
+
+    updateOutputBudget();
+    lastActive_ = loop_->pollReturnTime();
+    if (!outputQueue_.empty()) {
+        submitSends();
+        return;
+    }
+    scheduleBufferRelease();
+    if (writeCompleteCallback_) {
+        queueWriteComplete();
+    }
+    if (state_ == kDisconnecting) {
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::deliverPendingInput() {
+    if (!inputPending_ || !recving_ || state_ == kDisconnected) {
+        return;
+    }
+    inputPending_ = false;
+    Timestamp now(Timestamp::now());
+    messageCallback_(shared_from_this(), &inputBuffer_, now);
+    lastActive_ = now;
+}
+
+// 队头是 sendFile 的文件区间时没有可以 send 的内存，改为关注写事件由 handleWrite 发送，之后的数据也由它发完
+void TcpConnection::submitSends() {
+    if (sendsInFlight_ > 0 || channel_->isWriting() || outputQueue_.empty()) {
+        return;
+    }
+    struct iovec vec[IoUringPoller::kMaxLinkedSends];
+    int count = uring_ != nullptr ? outputQueue_.peekIovecs(vec, IoUringPoller::kMaxLinkedSends) : 0;
+    if (count == 0) {
+        channel_->enableWriting();
+        return;
+    }
+    sendFailed_ = false;
+    sendsInFlight_ = count;
+    uring_->send(channel_.get(), vec, count);
 }
@@ -0,0 +1,242 @@
+#include "TcpRelay.h"
+
+#include "Buffer.h"
+#include "Connector.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const int TcpRelay::kDefaultPipeSize;
+
+TcpRelay::TcpRelay(const TcpConnectionPtr &a, const TcpConnectionPtr &b) : started_(false), stopped_(false) {
+    dirs_[0].from = a;
+    dirs_[0].to = b;
+    dirs_[1].from = b;
+    dirs_[1].to = a;
+
+    for (int i = 0; i < 2; ++i) {
+        Direction &dir = dirs_[i];
+        if (::pipe2(dir.pipefd, O_NONBLOCK | O_CLOEXEC) < 0) {
+            LOG_ERROR("TcpRelay::ctor - pipe2 error: %d", errno);
+            dir.pipefd[0] = dir.pipefd[1] = -1;
+            continue;
+        }
+        // 调大 pipe 容量可以减少 splice 次数，失败(超过 /proc/sys/fs/pipe-max-size)时保持默认的 64K
+        ::fcntl(dir.pipefd[1], F_SETPIPE_SZ, kDefaultPipeSize);
+        int size = ::fcntl(dir.pipefd[1], F_GETPIPE_SZ);
+        dir.pipeSize = size > 0 ? static_cast<size_t>(size) : 65536;
+    }
+}
+
+TcpRelay::~TcpRelay() {
+    // relay 没有被 stop 就释放时，两个连接的读事件已经交给了 relay，不关闭的话会一直挂着
+    if (started_ && !stopped_) {
+        dirs_[0].from->forceClose();
+        dirs_[1].from->forceClose();
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (dirs_[i].pipefd[0] >= 0) {
+            ::close(dirs_[i].pipefd[0]);
+            ::close(dirs_[i].pipefd[1]);
+        }
+    }
+}
+
+void TcpRelay::start() {
+    dirs_[0].from->getLoop()->runInLoop(std::bind(&TcpRelay::startInLoop, shared_from_this()));
+}
+
+void TcpRelay::stop() {
+    dirs_[0].from->getLoop()->runInLoop(std::bind(&TcpRelay::stopInLoop, shared_from_this()));
+}
+
+void TcpRelay::startInLoop() {
+    if (started_ || stopped_) {
+        return;
+    }
+    started_ = true;
+
+    if (dirs_[0].pipefd[0] < 0 || dirs_[1].pipefd[0] < 0) {
+        stopInLoop();
+        return;
+    }
+
+    //!NOTE: 回调只持有 weak_ptr，relay 的生命期由调用者管理，relay 释放之后回调什么也不做
+    std::weak_ptr<TcpRelay> weakRelay(shared_from_this());
+    for (int i = 0; i < 2; ++i) {
+        const TcpConnectionPtr &conn = dirs_[i].from;
+        // conn 可读: 搬运方向 i；conn 可写: 把方向 1-i 的 pipe 写到 conn
+        conn->setRawReadCallback([weakRelay, i]() {
+            std::shared_ptr<TcpRelay> relay = weakRelay.lock();
+            if (relay) {
+                relay->handleReadable(&relay->dirs_[i]);
+            }
+        });
+        conn->setRawWriteCallback([weakRelay, i]() {
+            std::shared_ptr<TcpRelay> relay = weakRelay.lock();
+            if (relay) {
+                relay->flush(&relay->dirs_[1 - i]);
+            }
+        });
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        Direction &dir = dirs_[i];
+        Buffer *leftover = dir.from->inputBuffer();
+        if (leftover->readableBytes() > 0) {
+            dir.bytes += leftover->readableBytes();
+            dir.to->send(leftover);
+        }
+    }
+
+    dirs_[0].from->startRead();
+    dirs_[1].from->startRead();
+}
+
+void TcpRelay::handleReadable(Direction *dir) {
+    if (stopped_) {
+        return;
+    }
+
+    if (!dir->eof && dir->pending < dir->pipeSize) {
+        ssize_t n = ::splice(dir->from->fd(), NULL, dir->pipefd[1], NULL, dir->pipeSize - dir->pending,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            dir->pending += n;
+            dir->bytes += n;
+        } else if (n == 0) {
+            dir->eof = true;
+            dir->from->stopRead();
+        } else if (errno != EAGAIN && errno != EINTR) {
+            LOG_ERROR("TcpRelay::handleReadable - splice from %s error: %d", dir->from->name().c_str(), errno);
+            stopInLoop();
+            return;
+        }
+    }
+
+    flush(dir);
+}
+
+void TcpRelay::flush(Direction *dir) {
+    if (stopped_) {
+        return;
+    }
+
+    // 目标连接 outputQueue 中的数据要先发完，保证顺序
+    if (dir->pending > 0 && !dir->to->hasPendingOutput()) {
+        while (dir->pending > 0) {
+            ssize_t n = ::splice(dir->pipefd[0], NULL, dir->to->fd(), NULL, dir->pending,
+                                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                dir->pending -= n;
+            } else if (n < 0 && errno == EAGAIN) {
+                break;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                LOG_ERROR("TcpRelay::flush - splice to %s error: %d", dir->to->name().c_str(), errno);
+                stopInLoop();
+                return;
+            }
+        }
+    }
+
+    if (dir->pending > 0) {
+        // 目标写不动: 停止读来源，等目标可写时再由 rawWriteCallback 回到这里
+        if (dir->from->isReading()) {
+            dir->from->stopRead();
+        }
+        dir->to->setWriteInterest(true);
+        return;
+    }
+
+    dir->to->setWriteInterest(false);
+    if (!dir->eof) {
+        if (!dir->from->isReading()) {
+            dir->from->startRead();
+        }
+    } else if (!dir->done && !dir->to->hasPendingOutput()) {
+        dir->done = true;
+        dir->to->shutdown();
+        if (dirs_[0].done && dirs_[1].done) {
+            stopInLoop();
+        }
+    }
+}
+
+void TcpRelay::stopInLoop() {
+    if (stopped_) {
+        return;
+    }
+    stopped_ = true;
+    LOG_INFO("TcpRelay::stop [%s] <-> [%s] forwarded %llu bytes, backward %llu bytes",
+             dirs_[0].from->name().c_str(), dirs_[1].from->name().c_str(),
+             (unsigned long long)dirs_[0].bytes, (unsigned long long)dirs_[1].bytes);
+    dirs_[0].from->forceClose();
+    dirs_[1].from->forceClose();
+}
+
+void TcpRelay::connect(const TcpConnectionPtr &client, const InetAddress &backend, const RelayCallback &cb) {
+    EventLoop *loop = client->getLoop();
+    std::weak_ptr<TcpConnection> weakClient(client);
+    std::shared_ptr<Connector> connector(new Connector(loop, backend));
+
+    connector->setNewConnectionCallback([loop, weakClient, backend, cb](int sockfd) {
+        TcpConnectionPtr client = weakClient.lock();
+        if (!client || !client->connected()) {  // 连接后端期间 client 已经断开
+            ::close(sockfd);
+            if (cb) {
+                cb(std::shared_ptr<TcpRelay>());
+            }
+            return;
+        }
+
+        sockaddr_in local;
+        ::memset(&local, 0, sizeof local);
+        socklen_t addrlen = static_cast<socklen_t>(sizeof local);
+        if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0) {
+            LOG_ERROR("TcpRelay::connect - getsockname error: %d", errno);
+        }
+
+        std::string name = client->name() + "-backend";
+        TcpConnectionPtr conn(new TcpConnection(loop, name, sockfd, InetAddress(local), backend));
+        std::shared_ptr<TcpRelay> relay(new TcpRelay(client, conn));
+
+        std::weak_ptr<TcpRelay> weakRelay(relay);
+        conn->setConnectionCallback([weakRelay](const TcpConnectionPtr &c) {
+            if (!c->connected()) {
+                std::shared_ptr<TcpRelay> r = weakRelay.lock();
+                if (r) {
+                    r->stop();
+                }
+            }
+        });
+        // relay 启动之前不会处理后端的读事件，这里只是兜底
+        conn->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        // 后端连接不属于任何 TcpServer，断开后自己销毁
+        conn->setCloseCallback([](const TcpConnectionPtr &c) {
+            c->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+        });
+        conn->connectEstablished();
+
+        if (cb) {
+            cb(relay);
+        }
+        relay->start();
+    });
+
+    connector->setErrorCallback([cb](int err) {
+        LOG_ERROR("TcpRelay::connect - connect backend error: %d", err);
+        if (cb) {
+            cb(std::shared_ptr<TcpRelay>());
+        }
+    });
+
+    connector->start();
+}
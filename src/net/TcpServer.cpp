@@ -19,6 +19,14 @@ TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::
     , threadPool_(new EventLoopThreadPool(loop, name_))
     , connectionCallback_()
     , messageCallback_()
+    , bufferMode_(Buffer::kContiguous)
+    , zeroCopyThreshold_(0)
+    , bufferIdleTimeout_(0.0)
+    , hasOutputBudget_(false)
+    , timerMode_(TimerQueue::kTimerfd)
+    , edgeTriggered_(false)
+    , deferredUpdates_(false)
+    , completionMode_(false)
     , nextConnId_(1) 
     , started_(0)
 {
@@ -46,6 +54,36 @@ void TcpServer::start() {
     if (started_++ == 0)  // 防止一个 TcpServer 对象被 start 多次
     {
         threadPool_->start(threadInitCallback_);                          // 启动底层的 loop 线程池
+        if (hasOutputBudget_) {
+            //!NOTE: 预算只在 loop 线程中访问，排在 listen 之前，新连接建立时已经生效
+            for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+                ioLoop->runInLoop(std::bind(&OutputBudget::setOptions, &ioLoop->outputBudget(), outputBudget_));
+            }
+        }
+        if (timerMode_ != TimerQueue::kTimerfd) {
+            loop_->setTimerMode(timerMode_);
+            for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+                ioLoop->setTimerMode(timerMode_);
+            }
+        }
+        if (edgeTriggered_) {
+            loop_->setEdgeTriggered(true);
+            for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+                ioLoop->setEdgeTriggered(true);
+            }
+        }
+        if (deferredUpdates_) {
+            loop_->setDeferredUpdates(true);
+            for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+                ioLoop->setDeferredUpdates(true);
+            }
+        }
+        if (completionMode_) {
+            loop_->setCompletionMode(true);
+            for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+                ioLoop->setCompletionMode(true);
+            }
+        }
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));  // listen
     }
 }
@@ -82,6 +120,12 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setBufferMode(bufferMode_);
+    conn->setReadOptions(readOptions_);
+    conn->setBufferIdleTimeout(bufferIdleTimeout_);
+    if (zeroCopyThreshold_ > 0) {
+        conn->setZeroCopyThreshold(zeroCopyThreshold_);
+    }
 
     // 设置了如何关闭连接的回调
     conn->setCloseCallback(
@@ -1,4 +1,25 @@
 #include "Timer.h"
+#include "NodeCache.h"
+
+Timer* Timer::create(TimerCallback cb, Timestamp when, double interval)
+{
+    Timer* timer = NodeCache<Timer>::get();
+    if (timer == nullptr)
+    {
+        return new Timer(std::move(cb), when, interval);
+    }
+    timer->callback_ = std::move(cb);
+    timer->expiration_ = when;
+    timer->interval_ = interval;
+    timer->repeat_ = interval > 0.0;
+    return timer;
+}
+
+void Timer::destroy(Timer* timer)
+{
+    timer->callback_ = nullptr;
+    NodeCache<Timer>::put(timer);
+}
 
 void Timer::restart(Timestamp now)
 {
@@ -4,6 +4,9 @@
 #include "Timer.h"
 #include "TimerQueue.h"
 
+#include <algorithm>
+#include <errno.h>
+#include <sys/prctl.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 #include <string.h>
@@ -30,7 +33,9 @@ TimerQueue::TimerQueue(EventLoop* loop)
     : loop_(loop),
       timerfd_(createTimerfd()),
       timerfdChannel_(loop_, timerfd_),
-      timers_()
+      timers_(),
+      callingExpiredTimers_(false),
+      mode_(kTimerfd)
 {
     timerfdChannel_.setReadCallback(
         std::bind(&TimerQueue::handleRead, this));
@@ -47,9 +52,9 @@ TimerQueue::~TimerQueue()
     timerfdChannel_.remove();
     ::close(timerfd_);
     // 删除所有定时器
-    for (const Entry& timer : timers_)
+    for (Timer* timer : timers_)
     {
-        delete timer.second;
+        Timer::destroy(timer);
     }
 }
 
@@ -57,7 +62,7 @@ void TimerQueue::addTimer(TimerCallback cb,
                           Timestamp when,
                           double interval)
 {
-    Timer* timer = new Timer(std::move(cb), when, interval);
+    Timer* timer = Timer::create(std::move(cb), when, interval);
     loop_->runInLoop(
         std::bind(&TimerQueue::addTimerInLoop, this, timer));
 }
@@ -68,7 +73,8 @@ void TimerQueue::addTimerInLoop(Timer* timer)
     bool eraliestChanged = insert(timer);
 
     // 我们需要重新设置timerfd_触发时间
-    if (eraliestChanged)
+    //!NOTE: kPollTimeout 模式下 loop 每次 poll 之前都会重新计算超时，不需要任何系统调用
+    if (eraliestChanged && mode_ == kTimerfd)
     {
         resetTimerfd(timerfd_, timer->expiration());
     }
@@ -111,19 +117,30 @@ void ReadTimerFd(int timerfd)
     }
 }
 
-// 返回删除的定时器节点 （std::vector<Entry> expired）
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now)
+namespace
 {
-    std::vector<Entry> expired;
+// std::push_heap/pop_heap 默认是最大堆，比较反过来，最早到期的在堆顶
+bool laterThan(const Timer* lhs, const Timer* rhs)
+{
+    return rhs->expiration() < lhs->expiration();
+}
+}  // namespace
 
-    Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
-    TimerList::iterator end = timers_.lower_bound(sentry);
-    
-    //!TODO: back_inserter()
-    std::copy(timers_.begin(), end, back_inserter(expired));
-    timers_.erase(timers_.begin(), end);
-    
-    return expired;
+Timestamp TimerQueue::earliest() const
+{
+    return timers_.front()->expiration();
+}
+
+// 把到期时间不晚于 now 的定时器从堆中取出，按到期顺序放进 expired_
+void TimerQueue::getExpired(Timestamp now)
+{
+    expired_.clear();
+    while (!timers_.empty() && !(now < earliest()))
+    {
+        std::pop_heap(timers_.begin(), timers_.end(), laterThan);
+        expired_.push_back(timers_.back());
+        timers_.pop_back();
+    }
 }
 
 // 到期之后会触发 POLLIN 事件，进而调用 handleRead() 处理到期定时器
@@ -131,59 +148,123 @@ void TimerQueue::handleRead()
 {
     Timestamp now = Timestamp::now();
     ReadTimerFd(timerfd_);
+    processExpired(now);
+}
 
-    std::vector<Entry> expired = getExpired(now);
+void TimerQueue::processExpired(Timestamp now)
+{
+    getExpired(now);
 
-    // 遍历到期的定时器，调用回调函数
+    // 遍历到期的定时器，调用回调函数；回调中添加的定时器进入 timers_，不影响 expired_
     callingExpiredTimers_ = true;
-    for (const Entry& it : expired)
+    for (Timer* timer : expired_)
     {
-        it.second->run();
+        int64_t start = LoopStats::nowNanos();
+        timer->run();
+        loop_->loopStats().recordTimer(LoopStats::nowNanos() - start);
     }
     callingExpiredTimers_ = false;
     
     // 重新设置这些定时器
-    reset(expired, now);
+    reset(now);
 }
 
-void TimerQueue::reset(const std::vector<Entry>& expired, Timestamp now)
+void TimerQueue::reset(Timestamp now)
 {
-    Timestamp nextExpire;
-    for (const Entry& it : expired)
+    for (Timer* timer : expired_)
     {
         //!TODO: 重复任务则继续执行
-        if (it.second->repeat())
+        if (timer->repeat())
         {
-            auto timer = it.second;
             timer->restart(Timestamp::now());
             insert(timer);
         }
         else
         {
-            delete it.second;
+            Timer::destroy(timer);
         }
+    }
+    expired_.clear();
+
+    //!NOTE: 所有重复定时器插入之后只设置一次 timerfd，kPollTimeout 模式下不需要设置
+    if (mode_ == kTimerfd && !timers_.empty())
+    {
+        resetTimerfd(timerfd_, earliest());
+    }
+}
+
+void TimerQueue::setMode(Mode mode)
+{
+    if (mode == mode_)
+    {
+        return;
+    }
+    mode_ = mode;
 
-        // 如果重新插入了定时器，需要继续重置 timerfd
-        if (!timers_.empty())
+    //!NOTE: epoll 超时默认有 50us 的 timer slack(timerfd 没有)，会吃掉微秒精度，只调整 loop 线程自己的 slack；
+    // 切回 timerfd 时传 0 恢复默认值
+    if (::prctl(PR_SET_TIMERSLACK, mode_ == kPollTimeout ? 1UL : 0UL, 0UL, 0UL, 0UL) < 0)
+    {
+        LOG_ERROR("TimerQueue::setMode - prctl(PR_SET_TIMERSLACK) error: %d", errno);
+    }
+
+    if (mode_ == kPollTimeout)
+    {
+        // 停掉 timerfd，避免切换之前设置的到期时间再唤醒一次
+        struct itimerspec stop;
+        memset(&stop, '\0', sizeof(stop));
+        if (::timerfd_settime(timerfd_, 0, &stop, nullptr))
         {
-            resetTimerfd(timerfd_, (timers_.begin()->second)->expiration());
+            LOG_ERROR("timerfd_settime faield()");
         }
     }
+    else if (!timers_.empty())
+    {
+        resetTimerfd(timerfd_, earliest());
+    }
+}
+
+int64_t TimerQueue::nextTimeoutUs(Timestamp now, int64_t maxUs) const
+{
+    if (timers_.empty())
+    {
+        return maxUs;
+    }
+    int64_t diff = earliest().microSecondsSinceEpoch() - now.microSecondsSinceEpoch();
+    if (diff <= 0)
+    {
+        return 0;
+    }
+    return diff < maxUs ? diff : maxUs;
+}
+
+void TimerQueue::runExpired()
+{
+    if (timers_.empty())
+    {
+        return;
+    }
+    Timestamp now = Timestamp::now();
+    if (now < earliest())
+    {
+        return;
+    }
+    processExpired(now);
 }
 
 bool TimerQueue::insert(Timer* timer)
 {
     bool earliestChanged = false;
     Timestamp when = timer->expiration();
-    TimerList::iterator it = timers_.begin();
-    if (it == timers_.end() || when < it->first)
+    if (timers_.empty() || when < earliest())
     {
         // 说明最早的定时器已经被替换了
         earliestChanged = true;
     }
 
-    // 定时器管理红黑树插入此新定时器
-    timers_.insert(Entry(when, timer));
+    // 定时器插入最小堆
+    timers_.push_back(timer);
+    std::push_heap(timers_.begin(), timers_.end(), laterThan);
 
     return earliestChanged;
 }